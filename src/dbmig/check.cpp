@@ -27,7 +27,10 @@ void check(
     const std::string &conn_str,
     const std::string &changeset,
     const bool verbose,
-    const std::string &repository_path)
+    const std::string &repository_path,
+    const bool use_hash_cache,
+    const bool use_script_index,
+    const unsigned int jobs)
 {
     using std::string;
     using nowide::cout;
@@ -35,7 +38,12 @@ void check(
     using std::endl;
 
     // Perform the check.
-    auto report = dbmig::perform_check(conn_str, changeset, repository_path);
+    dbmig::check_options options;
+    options.use_hash_cache = use_hash_cache;
+    options.use_script_index = use_script_index;
+    options.jobs = jobs;
+    auto report = dbmig::perform_check(conn_str, changeset, repository_path,
+                                       options);
     auto num_issues = report.size();
 
     // Print results as needed.
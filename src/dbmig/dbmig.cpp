@@ -20,6 +20,7 @@
 #include <boost/program_options.hpp>
 #include <nowide/iostream.hpp>
 
+#include <check.hpp>
 #include "services.hpp"
 #include "console_util.hpp"
 
@@ -45,6 +46,8 @@ static void print_usage(std::ostream &os, const po::options_description &od)
        << "check repository compatibility against a database" << endl;
     os << "  migrate             - "
        << "migrate a database to a new version" << endl;
+    os << "  pack                - "
+       << "pack a repository into a single bundle file" << endl;
     os << "  purge               - "
        << "permanently delete the whole of a database" << endl;
     os << "  create-unversioned  - "
@@ -136,7 +139,16 @@ int main(int argc, char *argv[])
             po::options_description ck_desc("check options");
             ck_desc.add_options()
                 ("repo-dir", po::value<string>()->default_value("."),
-                 "path to repository");
+                 "path to repository")
+                ("no-hash-cache", po::bool_switch(),
+                 "hash every script afresh, rather than using (and updating) "
+                 "the hash cache kept in the repository")
+                ("no-script-index", po::bool_switch(),
+                 "scan every script directory afresh, rather than using (and "
+                 "updating) the index kept alongside it")
+                ("jobs,j", po::value<unsigned int>()->default_value(
+                     dbmig::check_options::default_jobs()),
+                 "number of scripts to hash concurrently");
         
             // Any unrecognised options from the first pass are assumed to
             // belong to this sub-command.
@@ -152,7 +164,10 @@ int main(int argc, char *argv[])
                 vm["target"].as<string>(),
                 vm["changeset"].as<string>(),
                 verbose,
-                vm["repo-dir"].as<string>());
+                vm["repo-dir"].as<string>(),
+                !vm["no-hash-cache"].as<bool>(),
+                !vm["no-script-index"].as<bool>(),
+                vm["jobs"].as<unsigned int>());
         }
         else if (cmd == "override-version")
         {
@@ -193,7 +208,22 @@ int main(int argc, char *argv[])
                 ("version", po::value<string>(),
                  "target version to migrate to")
                 ("repo-dir", po::value<string>()->default_value("."),
-                 "path to repository");
+                 "path to repository")
+                ("lazy-scan", po::bool_switch(),
+                 "scan only those version sub-directories needed for the "
+                 "migration, rather than every script directory (through "
+                 "the index kept alongside it)")
+                ("no-script-index", po::bool_switch(),
+                 "scan every script directory afresh, rather than using (and "
+                 "updating) the index kept alongside it")
+                ("single-transaction", po::bool_switch(),
+                 "run every script in a single transaction, so that either "
+                 "all of them are applied or none are; refuses to run any "
+                 "script that cannot run inside a transaction block")
+                ("batch-commit", po::value<unsigned int>(),
+                 "commit after every arg scripts, rather than after each one")
+                ("slow-statement-threshold", po::value<double>(),
+                 "report each statement taking at least arg seconds to run");
         
             // Any unrecognised options from the first pass are assumed to
             // belong to this sub-command.
@@ -205,12 +235,45 @@ int main(int argc, char *argv[])
             po::store(po::command_line_parser(opts).options(mg_desc).run(), vm);
             
             check_target(vm);
+            
+            // How many scripts to run in each transaction (zero for all).
+            unsigned int batch_size = 1;
+            if (vm.count("batch-commit")) {
+                if (vm["single-transaction"].as<bool>()) {
+                    throw std::domain_error(
+                        "--single-transaction and --batch-commit cannot "
+                        "both be given");
+                }
+                batch_size = vm["batch-commit"].as<unsigned int>();
+                if (batch_size == 0) {
+                    throw std::domain_error(
+                        "--batch-commit must be given at least 1 script");
+                }
+            }
+            else if (vm["single-transaction"].as<bool>()) {
+                batch_size = 0;
+            }
+            
+            // Whether to time each statement (negative for not).
+            double slow_threshold = -1.0;
+            if (vm.count("slow-statement-threshold")) {
+                slow_threshold = vm["slow-statement-threshold"].as<double>();
+                if (slow_threshold < 0) {
+                    throw std::domain_error(
+                        "--slow-statement-threshold cannot be negative");
+                }
+            }
+            
             if (!vm.count("version")) {
                 // Migrate to latest version.
                 migrate(
                     vm["target"].as<string>(),
                     vm["changeset"].as<string>(),
                     verbose, force,
+                    vm["lazy-scan"].as<bool>(),
+                    !vm["no-script-index"].as<bool>(),
+                    batch_size,
+                    slow_threshold,
                     vm["repo-dir"].as<string>());
             }
             else {
@@ -219,10 +282,44 @@ int main(int argc, char *argv[])
                     vm["target"].as<string>(),
                     vm["changeset"].as<string>(),
                     verbose, force,
+                    vm["lazy-scan"].as<bool>(),
+                    !vm["no-script-index"].as<bool>(),
+                    batch_size,
+                    slow_threshold,
                     vm["repo-dir"].as<string>(),
                     vm["version"].as<string>());
             }
         }
+        else if (cmd == "pack")
+        {
+            // pack has some specific options
+            po::options_description pk_desc("pack options");
+            pk_desc.add_options()
+                ("repo-dir", po::value<string>()->default_value("."),
+                 "path to repository")
+                ("output,o", po::value<string>(),
+                 "path of bundle file to write");
+        
+            // Any unrecognised options from the first pass are assumed to
+            // belong to this sub-command.
+            std::vector<string> opts = po::collect_unrecognized(
+                parsed.options, po::include_positional);
+            opts.erase(opts.begin()); // Remove the command itself.
+
+            // Parse again...
+            po::store(po::command_line_parser(opts).options(pk_desc).run(), vm);
+            
+            if (!vm.count("output")) {
+                throw std::domain_error(
+                    "a bundle file must be provided for pack "
+                    "(see the --output option)");
+            }
+            
+            pack(
+                verbose,
+                vm["repo-dir"].as<string>(),
+                vm["output"].as<string>());
+        }
         else if (
             cmd == "purge" ||
             cmd == "create-unversioned")
@@ -17,11 +17,18 @@
 */
 
 #include <nowide/iostream.hpp>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
 #include <string>
 #include <stdexcept>
+#include <vector>
+#include <soci/soci.h>
 #include <repository.hpp>
 #include <changelog.hpp>
 #include <migrate.hpp>
+#include <script_prefetch.hpp>
 
 #include "console_util.hpp"
 
@@ -30,17 +37,123 @@ using std::string;
 using nowide::cout;
 using nowide::cerr;
 using std::endl;
+using std::chrono::steady_clock;
+
+///
+/// Print how long a script took to run, from the given start time
+///
+static void print_time_taken(const steady_clock::time_point &start_time)
+{
+    std::chrono::duration<double> taken = steady_clock::now() - start_time;
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", taken.count());
+    cout << "  took " << buf << "s" << endl;
+}
+
+///
+/// Report each statement of a script that took at least the threshold time
+/// to run
+///
+static void report_slow_statements(
+    const std::string &script_path,
+    const dbmig::statement_timing_list &timings,
+    const double slow_threshold)
+{
+    for (auto &timing : timings) {
+        if (timing.seconds < slow_threshold)
+            continue;
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3f", timing.seconds);
+        cerr << "Slow statement: " << script_path << ", statement "
+             << timing.ordinal;
+        if (timing.first_line == timing.last_line && timing.first_line)
+            cerr << " (line " << timing.first_line << ")";
+        else if (timing.first_line)
+            cerr << " (lines " << timing.first_line << "-"
+                 << timing.last_line << ")";
+        cerr << ", took " << buf << "s" << endl;
+    }
+}
+
+///
+/// Run a script, timing it if verbose, and timing its statements if there
+/// is a slow-statement threshold (that is, if it is not negative)
+///
+/// Slow statements are reported even if the script fails, since the
+/// statement that failed may well be the one that was slow.
+///
+template<typename RunFunc>
+static void run_timed(
+    const std::string &script_path,
+    const bool verbose,
+    const double slow_threshold,
+    RunFunc run)
+{
+    dbmig::statement_timing_list timings;
+    auto timings_wanted = slow_threshold >= 0 ? &timings : nullptr;
+    auto start_time = steady_clock::now();
+    try {
+        run(timings_wanted);
+    }
+    catch (...) {
+        report_slow_statements(script_path, timings, slow_threshold);
+        throw;
+    }
+    if (verbose)
+        print_time_taken(start_time);
+    report_slow_statements(script_path, timings, slow_threshold);
+}
+
+///
+/// Scripts already prepared (and checked) by check_single_transaction(), in
+/// the order that they are to be run
+///
+typedef std::deque<dbmig::prepared_script> prepared_script_queue;
+
+///
+/// Take the next script to run, from the scripts already prepared if there
+/// are any, or else from the prefetcher
+///
+static dbmig::prepared_script next_script(prepared_script_queue *prepared,
+                                          dbmig::script_prefetcher *prefetcher)
+{
+    if (!prepared)
+        return prefetcher->next();
+    if (prepared->empty())
+        throw std::out_of_range{"No more prepared scripts"};
+    auto script = std::move(prepared->front());
+    prepared->pop_front();
+    return script;
+}
+
+///
+/// Start preparing the scripts at the given paths, unless they have been
+/// prepared already
+///
+static std::unique_ptr<dbmig::script_prefetcher> prefetch_unless_prepared(
+    const prepared_script_queue *prepared,
+    const dbmig::repository &repo,
+    const dbmig::script_action action,
+    const std::vector<std::string> &paths)
+{
+    std::unique_ptr<dbmig::script_prefetcher> prefetcher;
+    if (!prepared)
+        prefetcher.reset(new dbmig::script_prefetcher{repo, action, paths});
+    return prefetcher;
+}
 
 ///
 /// Install a baseline version into the target environment
 ///
 static dbmig::semver install_baseline(
-    const std::string &conn_str,
+    dbmig::transaction_batch &batch,
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const double slow_threshold,
     dbmig::repository &repo,
-    const dbmig::semver &target_version)
+    const dbmig::semver &target_version,
+    prepared_script_queue *prepared)
 {
     using std::range_error;
 
@@ -75,21 +188,30 @@ static dbmig::semver install_baseline(
     }
     
     // Run the install script and write to changelog (in one txn!)
-    dbmig::run_install_script(conn_str, changeset, install_script->first,
-            repo.install_script_path(), install_script->second);
+    auto script = prepared
+        ? next_script(prepared, nullptr)
+        : dbmig::prepared_script{repo, dbmig::script_action::install,
+                                 install_script->second};
+    run_timed(install_script->second, verbose, slow_threshold,
+              [&](dbmig::statement_timing_list *timings) {
+        dbmig::run_install_script(batch, changeset, install_script->first,
+                                  script, timings);
+    });
     
     // Return the new version of the baseline installation.
     return install_script->first;
 }
 
 static dbmig::semver upgrade(
-    const std::string &conn_str,
+    dbmig::transaction_batch &batch,
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const double slow_threshold,
     dbmig::repository &repo,
     const dbmig::semver &from_version,
-    const dbmig::semver &target_version)
+    const dbmig::semver &target_version,
+    prepared_script_queue *prepared)
 {
     if (verbose) {
         cout << "Finding upgrade scripts to go from "
@@ -97,6 +219,14 @@ static dbmig::semver upgrade(
     }
     
     auto uscripts = repo.upgrade_scripts(from_version, target_version);
+    
+    // Prepare the scripts ahead of time, while earlier ones are running.
+    std::vector<std::string> paths;
+    for (auto s = uscripts.first; s != uscripts.second; ++s)
+        paths.push_back(s->second);
+    auto prefetcher = prefetch_unless_prepared(
+        prepared, repo, dbmig::script_action::upgrade, paths);
+    
     dbmig::semver current_version = from_version;
     for (auto s = uscripts.first; s != uscripts.second; ++s) {
         auto ver = s->first;
@@ -114,8 +244,11 @@ static dbmig::semver upgrade(
         }
         
         // Run the script and write to changelog (in one txn!)
-        dbmig::run_upgrade_script(conn_str, changeset, ver,
-                repo.upgrade_script_path(), path);
+        auto script = next_script(prepared, prefetcher.get());
+        run_timed(path, verbose, slow_threshold,
+                  [&](dbmig::statement_timing_list *timings) {
+            dbmig::run_upgrade_script(batch, changeset, ver, script, timings);
+        });
         
         // Count up the version.
         current_version = ver;
@@ -125,13 +258,15 @@ static dbmig::semver upgrade(
 }
 
 static dbmig::semver rollback(
-    const std::string &conn_str,
+    dbmig::transaction_batch &batch,
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const double slow_threshold,
     dbmig::repository &repo,
     const dbmig::semver &start_from_version,
-    const dbmig::semver &target_version)
+    const dbmig::semver &target_version,
+    prepared_script_queue *prepared)
 {
     using std::out_of_range;
 
@@ -141,7 +276,7 @@ static dbmig::semver rollback(
     }
 
     // Try to obtain rollback steps to our desired target version.
-    dbmig::changelog cl{conn_str, changeset};
+    dbmig::changelog cl{batch.session(), changeset};
     auto rollback_steps = cl.rollback_steps(target_version);
     if (verbose) {
         int n = rollback_steps.size();
@@ -167,6 +302,19 @@ static dbmig::semver rollback(
                            start_from_version.to_str()};
     }
     
+    // Prepare the scripts ahead of time, while earlier ones are running.
+    // Should any script be missing, those before it are still rolled back,
+    // and the loop below stops at it.
+    std::vector<std::string> paths;
+    for (auto &step : rollback_steps) {
+        auto range = repo.upgrade_script_at(step.from_version);
+        if (range.first == range.second)
+            break;
+        paths.push_back(range.first->second);
+    }
+    auto prefetcher = prefetch_unless_prepared(
+        prepared, repo, dbmig::script_action::rollback, paths);
+    
     // Go through all the rollback steps.
     dbmig::semver current_version = start_from_version;
     for (auto step : rollback_steps) {
@@ -200,28 +348,95 @@ static dbmig::semver rollback(
             if (!console_confirmation(msg.c_str()))
                 throw user_driven_cancel{};
         }
-        current_version = dbmig::run_rollback_script(conn_str, changeset,
-            to_ver, repo.upgrade_script_path(), script_path, cl_hash);
+        auto script = next_script(prepared, prefetcher.get());
+        run_timed(script_path, verbose, slow_threshold,
+                  [&](dbmig::statement_timing_list *timings) {
+            current_version = dbmig::run_rollback_script(batch, changeset,
+                to_ver, script, cl_hash, timings);
+        });
     }
     
     return current_version;
 }
 
+///
+/// Check that every script that a migration will run can share the one
+/// transaction, before running any of them
+///
+/// Returns the scripts, prepared, in the order that they are to be run, so
+/// that they need not be prepared again.
+///
+static prepared_script_queue check_single_transaction(
+    soci::session &session,
+    const std::string &changeset,
+    dbmig::repository &repo,
+    const dbmig::semver &current_version,
+    const dbmig::semver &target_version)
+{
+    prepared_script_queue prepared;
+    auto check = [&](dbmig::script_action action, const std::string &path)
+    {
+        prepared.emplace_back(repo, action, path);
+        dbmig::check_joinable(session, prepared.back());
+    };
+    
+    // The scripts are found just as install_baseline(), upgrade() and
+    // rollback() will find them, which report anything missing.
+    auto from_version = current_version;
+    if (from_version.is_zero()) {
+        auto install_scripts = repo.nearest_install_script(target_version);
+        if (install_scripts.first == install_scripts.second)
+            return prepared;
+        check(dbmig::script_action::install, install_scripts.first->second);
+        from_version = install_scripts.first->first;
+    }
+    
+    if (target_version > from_version) {
+        auto uscripts = repo.upgrade_scripts(from_version, target_version);
+        for (auto s = uscripts.first; s != uscripts.second; ++s)
+            check(dbmig::script_action::upgrade, s->second);
+    }
+    else if (target_version < from_version) {
+        dbmig::changelog cl{session, changeset};
+        for (auto &step : cl.rollback_steps(target_version)) {
+            auto range = repo.upgrade_script_at(step.from_version);
+            if (range.first == range.second)
+                break;
+            check(dbmig::script_action::rollback, range.first->second);
+        }
+    }
+    return prepared;
+}
+
 static void migrate(
     const std::string &conn_str,
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const unsigned int batch_size,
+    const double slow_threshold,
     dbmig::repository &repo,
     const dbmig::semver &target_version)
 {
+    // One connection serves the whole migration, rather than one for each
+    // script.
+    soci::session session{conn_str};
+    dbmig::transaction_batch batch{session, batch_size};
+    
     // Do we need to install an initial version of the database?
-    dbmig::changelog cl{conn_str, changeset};
+    dbmig::changelog cl{session, changeset};
     auto current_version = cl.version();
+    prepared_script_queue checked;
+    if (batch_size == 0) {
+        checked = check_single_transaction(session, changeset, repo,
+                                           current_version, target_version);
+    }
+    auto prepared = batch_size == 0 ? &checked : nullptr;
     if (current_version.is_zero()) {
         // Install a baseline version.
-        current_version = install_baseline(conn_str, changeset, verbose, force,
-                                           repo, target_version);
+        current_version = install_baseline(batch, changeset, verbose, force,
+                                           slow_threshold, repo,
+                                           target_version, prepared);
     }
     else {
         cout << "Currently-installed version is " << current_version << endl;
@@ -230,8 +445,9 @@ static void migrate(
     // Are we going forward or backwards?
     if (target_version > current_version) {
         // Upgrade!
-        current_version = upgrade(conn_str, changeset, verbose, force, repo,
-                                  current_version, target_version);
+        current_version = upgrade(batch, changeset, verbose, force,
+                                  slow_threshold, repo,
+                                  current_version, target_version, prepared);
 
         if (verbose) {
             cout << "Upgraded to version " << current_version << endl;
@@ -239,8 +455,10 @@ static void migrate(
     }
     else if (target_version < current_version) {
         // Rollback!
-        current_version = rollback(conn_str, changeset, verbose, force, repo,
-                                   current_version, target_version);
+        current_version = rollback(batch, changeset, verbose, force,
+                                   slow_threshold, repo,
+                                   current_version, target_version,
+                                   prepared);
         
         if (verbose) {
             cout << "Rolled back to version " << current_version << endl;
@@ -254,6 +472,9 @@ static void migrate(
         }
     }
     
+    // Commit whatever the last batch left open.
+    batch.commit();
+    
     // Check we reached the version.
     if (current_version != target_version) {
         cerr << "Warning: migrated to version " << current_version
@@ -262,6 +483,18 @@ static void migrate(
     }
 }
 
+///
+/// How to read the repository's script directories, given the options
+///
+static dbmig::script_loading script_loading_for(const bool lazy_scan,
+                                                const bool use_script_index)
+{
+    if (lazy_scan)
+        return dbmig::script_loading::lazy;
+    return use_script_index
+        ? dbmig::script_loading::indexed : dbmig::script_loading::full_scan;
+}
+
 ///
 /// Migrate a database to the latest version
 ///
@@ -270,9 +503,14 @@ void migrate(
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const bool lazy_scan,
+    const bool use_script_index,
+    const unsigned int batch_size,
+    const double slow_statement_threshold,
     const std::string &repository_path)
 {
-    dbmig::repository repo{repository_path};
+    dbmig::repository repo{repository_path,
+        script_loading_for(lazy_scan, use_script_index)};
     
     // Find the latest version in the repository.
     auto target_version = repo.latest_version();
@@ -281,7 +519,9 @@ void migrate(
              << endl;
     }
     
-    migrate(conn_str, changeset, verbose, force, repo, target_version);
+    migrate(conn_str, changeset, verbose, force, batch_size,
+            slow_statement_threshold, repo,
+            target_version);
 }
 
 ///
@@ -292,10 +532,15 @@ void migrate(
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const bool lazy_scan,
+    const bool use_script_index,
+    const unsigned int batch_size,
+    const double slow_statement_threshold,
     const std::string &repository_path,
     const std::string &version_str)
 {
-    dbmig::repository repo{repository_path};
+    dbmig::repository repo{repository_path,
+        script_loading_for(lazy_scan, use_script_index)};
     
     // Parse the version.
     auto target_version = dbmig::semver::parse(version_str);
@@ -304,6 +549,8 @@ void migrate(
              << target_version << endl;
     }
     
-    migrate(conn_str, changeset, verbose, force, repo, target_version);
+    migrate(conn_str, changeset, verbose, force, batch_size,
+            slow_statement_threshold, repo,
+            target_version);
 }
 
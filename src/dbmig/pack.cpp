@@ -0,0 +1,55 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nowide/iostream.hpp>
+#include <iterator>
+#include <string>
+#include <repository.hpp>
+#include <bundle.hpp>
+
+using nowide::cout;
+using std::endl;
+
+///
+/// Pack a repository into a bundle
+///
+void pack(
+    const bool verbose,
+    const std::string &repository_path,
+    const std::string &bundle_path)
+{
+    dbmig::repository repo{repository_path};
+    
+    if (verbose) {
+        auto num_install = std::distance(
+            repo.scripts(dbmig::script_action::install).begin(),
+            repo.scripts(dbmig::script_action::install).end());
+        auto num_upgrade = std::distance(
+            repo.scripts(dbmig::script_action::upgrade).begin(),
+            repo.scripts(dbmig::script_action::upgrade).end());
+        cout << "Packing " << num_install << " install and " << num_upgrade
+             << " upgrade scripts, up to version " << repo.latest_version()
+             << endl;
+    }
+    
+    dbmig::write_bundle(repo, bundle_path);
+    
+    if (verbose) {
+        cout << "Wrote bundle " << bundle_path << endl;
+    }
+}
@@ -35,7 +35,10 @@ void check(
     const std::string &conn_str,
     const std::string &changeset,
     const bool verbose,
-    const std::string &repository_path);
+    const std::string &repository_path,
+    const bool use_hash_cache,
+    const bool use_script_index,
+    const unsigned int jobs);
 
 ///
 /// Forcibly override the version in a given database
@@ -59,23 +62,56 @@ void override_version(
 ///
 /// Migrate a database to the latest version
 ///
+/// Scripts are committed batch_size at a time, or all together in one
+/// transaction if batch_size is zero, in which case a script that cannot
+/// run inside a transaction block is refused before anything is run.  Any
+/// statement taking at least slow_statement_threshold seconds is reported,
+/// unless it is negative.  The repository is scanned lazily if lazy_scan,
+/// or else through its script index unless use_script_index is false.
+///
 void migrate(
     const std::string &conn_str,
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const bool lazy_scan,
+    const bool use_script_index,
+    const unsigned int batch_size,
+    const double slow_statement_threshold,
     const std::string &repository_path);
 
 ///
 /// Migrate a database to a given version
 ///
+/// Scripts are committed batch_size at a time, or all together in one
+/// transaction if batch_size is zero, in which case a script that cannot
+/// run inside a transaction block is refused before anything is run.  Any
+/// statement taking at least slow_statement_threshold seconds is reported,
+/// unless it is negative.  The repository is scanned lazily if lazy_scan,
+/// or else through its script index unless use_script_index is false.
+///
 void migrate(
     const std::string &conn_str,
     const std::string &changeset,
     const bool verbose,
     const bool force,
+    const bool lazy_scan,
+    const bool use_script_index,
+    const unsigned int batch_size,
+    const double slow_statement_threshold,
     const std::string &repository_path,
     const std::string &version_str);
 
+///
+/// Pack a repository into a bundle
+///
+/// The bundle can subsequently be used in place of the repository directory
+/// (see the --repo-dir option) by any other command.
+///
+void pack(
+    const bool verbose,
+    const std::string &repository_path,
+    const std::string &bundle_path);
+
 #endif // DBMIG_CLI_SERVICES_INCLUDED
 
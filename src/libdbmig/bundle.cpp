@@ -0,0 +1,419 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bundle.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <nowide/fstream.hpp>
+
+#include "fs_encoding.hpp"
+#include "mapped_script.hpp"
+#include "repository.hpp"
+#include "exception.hpp"
+
+namespace dbmig {
+
+// Bundle file layout, with all integers little-endian:
+//
+//   header     magic, u32 format version, u32 script count,
+//              u64 statement count, u64 blob offset, u64 blob size
+//   scripts    one fixed-size record per script (see below), install
+//              scripts first and then upgrade scripts, each in version order
+//   statements one span per statement
+//   blob       the text of every version, path, digest and statement
+//
+// A span is a u64 offset into the blob followed by a u64 length.  Each script
+// record is a u32 action and u32 (reserved) padding, spans for its version,
+// path and hex digest, and then the u64 index of its first statement followed
+// by u32 counts of its forward and rollback statements, which are contiguous.
+static const char bundle_magic[8] = {'D', 'B', 'M', 'I', 'G', 'P', 'K', '\0'};
+static const std::uint32_t bundle_format_version = 1;
+static const std::size_t header_size = 40;
+static const std::size_t span_size = 16;
+static const std::size_t script_record_size = 8 + 3 * span_size + 16;
+
+// Action codes as stored in script records.
+static const std::uint32_t install_code = 0;
+static const std::uint32_t upgrade_code = 1;
+
+static void put_u32(std::string &out, std::uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+static void put_u64(std::string &out, std::uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+static std::uint32_t get_u32(const char *p)
+{
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+        v |= std::uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+static std::uint64_t get_u64(const char *p)
+{
+    std::uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+        v |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+///
+/// Rollback statements live in upgrade scripts.
+///
+static std::uint32_t action_code(const script_action action)
+{
+    return action == script_action::install ? install_code : upgrade_code;
+}
+
+
+// Private impl class
+struct bundle::impl
+{
+    explicit impl(const std::string &path);
+    
+    struct script_record
+    {
+        std::uint32_t action;
+        statement_type version;
+        statement_type path;
+        std::string sha256_sum;
+        std::uint64_t first_statement;
+        std::uint32_t forward_count;
+        std::uint32_t rollback_count;
+    };
+    
+    const script_record &find(const script_action action,
+                              const std::string &script_path) const;
+    statement_type span(const char *p, const char *what) const;
+    
+    const std::string path_;
+    boost::iostreams::mapped_file_source file_;
+    const char *statements_;
+    std::uint64_t statement_count_;
+    const char *blob_;
+    std::uint64_t blob_size_;
+    
+    std::vector<script_record> scripts_;
+    // Index of each script in scripts_, keyed on action code and path.
+    std::unordered_map<std::string, std::size_t> index_;
+};
+
+static std::string index_key(std::uint32_t code, boost::string_ref path)
+{
+    std::string key(1, static_cast<char>('0' + code));
+    key.append(path.data(), path.size());
+    return key;
+}
+
+
+bundle::bundle(const std::string &path)
+    : pimpl_(new impl(path))
+{}
+
+bundle::~bundle() = default;
+
+bundle::impl::impl(const std::string &path) :
+    path_(path), statements_(nullptr), statement_count_(0), blob_(nullptr),
+    blob_size_(0)
+{
+    namespace fs = boost::filesystem;
+    
+    // A bundle always has a header, so is never empty (which cannot be
+    // mapped).  This also throws a filesystem_error if it does not exist.
+    fs::path p(utf8_to_fs<fs::path::value_type>(path));
+    if (fs::file_size(p) < header_size)
+        throw bad_bundle{path, "truncated header"};
+    file_.open(p);
+    const char *data = file_.data();
+    std::uint64_t size = file_.size();
+    
+    if (std::memcmp(data, bundle_magic, sizeof(bundle_magic)) != 0)
+        throw bad_bundle{path, "bad magic number"};
+    if (get_u32(data + 8) != bundle_format_version)
+        throw bad_bundle{path, "unsupported format version"};
+    std::uint64_t script_count = get_u32(data + 12);
+    statement_count_ = get_u64(data + 16);
+    std::uint64_t blob_offset = get_u64(data + 24);
+    blob_size_ = get_u64(data + 32);
+    
+    // The tables must lie between the header and the blob, and the blob
+    // within the file.  Guard against overflow from absurd counts.
+    std::uint64_t tables_end = header_size + script_count * script_record_size;
+    if (tables_end > size ||
+        statement_count_ > (size - tables_end) / span_size)
+        throw bad_bundle{path, "truncated tables"};
+    tables_end += statement_count_ * span_size;
+    if (blob_offset < tables_end || blob_offset > size ||
+        blob_size_ > size - blob_offset)
+        throw bad_bundle{path, "truncated blob"};
+    statements_ = data + header_size + script_count * script_record_size;
+    blob_ = data + blob_offset;
+    
+    // Check every statement span once, so they can be used freely later.
+    for (std::uint64_t i = 0; i < statement_count_; ++i)
+        span(statements_ + i * span_size, "statement");
+    
+    scripts_.reserve(script_count);
+    const char *rec = data + header_size;
+    for (std::uint64_t i = 0; i < script_count; ++i,
+         rec += script_record_size) {
+        script_record s;
+        s.action = get_u32(rec);
+        if (s.action != install_code && s.action != upgrade_code)
+            throw bad_bundle{path, "unknown script action"};
+        s.version = span(rec + 8, "version");
+        s.path = span(rec + 8 + span_size, "path");
+        auto sum = span(rec + 8 + 2 * span_size, "digest");
+        s.sha256_sum.assign(sum.data(), sum.size());
+        s.first_statement = get_u64(rec + 8 + 3 * span_size);
+        s.forward_count = get_u32(rec + 16 + 3 * span_size);
+        s.rollback_count = get_u32(rec + 20 + 3 * span_size);
+        std::uint64_t count = std::uint64_t(s.forward_count) + s.rollback_count;
+        if (s.first_statement > statement_count_ ||
+            count > statement_count_ - s.first_statement)
+            throw bad_bundle{path, "statement index out of range"};
+        
+        if (!index_.emplace(index_key(s.action, s.path), i).second)
+            throw bad_bundle{path, "duplicate script " + s.path.to_string()};
+        scripts_.push_back(std::move(s));
+    }
+}
+
+///
+/// Resolve (and bounds-check) a span into the blob.
+///
+bundle::statement_type bundle::impl::span(const char *p, const char *what) const
+{
+    std::uint64_t offset = get_u64(p);
+    std::uint64_t length = get_u64(p + 8);
+    if (offset > blob_size_ || length > blob_size_ - offset)
+        throw bad_bundle{path_, std::string(what) + " out of range"};
+    return statement_type{blob_ + offset, static_cast<std::size_t>(length)};
+}
+
+const bundle::impl::script_record &
+bundle::impl::find(const script_action action,
+                   const std::string &script_path) const
+{
+    auto it = index_.find(index_key(action_code(action), script_path));
+    if (it == index_.end()) {
+        throw std::out_of_range{"No " + to_string(action) + " script " +
+                                script_path + " in bundle " + path_};
+    }
+    return scripts_[it->second];
+}
+
+///
+/// The path of the bundle file.
+///
+const std::string &bundle::path() const
+{
+    return pimpl_->path_;
+}
+
+///
+/// All scripts in the bundle for a given action, keyed on version.
+///
+script_dir::list_type bundle::scripts(const script_action action) const
+{
+    // Records are already in version order.
+    script_dir::list_type scripts;
+    auto code = action_code(action);
+    for (auto &s : pimpl_->scripts_) {
+        if (s.action != code)
+            continue;
+        auto &v = s.version;
+        scripts.emplace_back(semver::parse(v.data(), v.data() + v.size()),
+                             s.path.to_string());
+    }
+    return scripts;
+}
+
+///
+/// The statements of a given script relevant to a given action.
+///
+bundle::list_type bundle::statements(const script_action action,
+                                     const std::string &script_path) const
+{
+    auto &s = pimpl_->find(action, script_path);
+    std::uint64_t first = s.first_statement;
+    std::uint32_t count = s.forward_count;
+    if (action == script_action::rollback) {
+        first += s.forward_count;
+        count = s.rollback_count;
+    }
+    
+    list_type statements;
+    statements.reserve(count);
+    const char *p = pimpl_->statements_ + first * span_size;
+    for (std::uint32_t i = 0; i < count; ++i, p += span_size) {
+        statements.emplace_back(pimpl_->blob_ + get_u64(p),
+                                static_cast<std::size_t>(get_u64(p + 8)));
+    }
+    return statements;
+}
+
+///
+/// The SHA256 digest of the whole of a given script.
+///
+const std::string &bundle::sha256_sum(const script_action action,
+                                      const std::string &script_path) const
+{
+    return pimpl_->find(action, script_path).sha256_sum;
+}
+
+///
+/// Find out whether a (UTF-8) path refers to a bundle.
+///
+bool is_bundle(const std::string &path)
+{
+    namespace fs = boost::filesystem;
+    
+    // Repositories are directories, so any regular file is taken to be a
+    // bundle (and will be rejected when opened if it is not one).
+    boost::system::error_code ec;
+    return fs::is_regular_file(utf8_to_fs<fs::path::value_type>(path), ec);
+}
+
+///
+/// Accumulates the tables and blob of a bundle as scripts are added
+///
+class bundle_writer
+{
+public:
+    bundle_writer() : script_count_(0), statement_count_(0) {}
+    
+    void add(const script_action action, const semver &version,
+             const std::string &script_path, const std::string &full_path)
+    {
+        mapped_script script{full_path};
+        
+        put_u32(scripts_, action_code(action));
+        put_u32(scripts_, 0);
+        put_span(scripts_, version.to_str());
+        put_span(scripts_, script_path);
+        put_span(scripts_, script.sha256_sum());
+        put_u64(scripts_, statement_count_);
+        if (action == script_action::install) {
+            put_u32(scripts_, add_statements(
+                script.statements(script_action::install)));
+            put_u32(scripts_, 0);
+        }
+        else {
+            put_u32(scripts_, add_statements(
+                script.statements(script_action::upgrade)));
+            put_u32(scripts_, add_statements(
+                script.statements(script_action::rollback)));
+        }
+        ++script_count_;
+    }
+    
+    void write(std::ostream &os) const
+    {
+        std::string header(bundle_magic, sizeof(bundle_magic));
+        put_u32(header, bundle_format_version);
+        put_u32(header, script_count_);
+        put_u64(header, statement_count_);
+        put_u64(header, header_size + scripts_.size() + statements_.size());
+        put_u64(header, blob_.size());
+        
+        os.write(header.data(), header.size());
+        os.write(scripts_.data(), scripts_.size());
+        os.write(statements_.data(), statements_.size());
+        os.write(blob_.data(), blob_.size());
+    }
+    
+private:
+    
+    void put_span(std::string &out, boost::string_ref text)
+    {
+        put_u64(out, blob_.size());
+        put_u64(out, text.size());
+        blob_.append(text.data(), text.size());
+    }
+    
+    std::uint32_t add_statements(const mapped_script::list_type &statements)
+    {
+        for (auto &statement : statements)
+            put_span(statements_, statement);
+        statement_count_ += statements.size();
+        return static_cast<std::uint32_t>(statements.size());
+    }
+    
+    std::uint32_t script_count_;
+    std::uint64_t statement_count_;
+    std::string scripts_;
+    std::string statements_;
+    std::string blob_;
+};
+
+///
+/// Pack every script of a repository on disk into a bundle
+///
+void write_bundle(const repository &repo, const std::string &path)
+{
+    namespace fs = boost::filesystem;
+    
+    if (repo.script_bundle())
+        throw std::invalid_argument{"Repository is already a bundle"};
+    
+    bundle_writer writer;
+    for (auto action : {script_action::install, script_action::upgrade}) {
+        auto &base = action == script_action::install
+            ? repo.install_script_path() : repo.upgrade_script_path();
+        for (auto &script : repo.scripts(action))
+            writer.add(action, script.first, script.second,
+                       base + "/" + script.second);
+    }
+    
+    // Write a temporary file alongside the bundle, and rename it over the
+    // top, so that a bundle is never seen half-written.
+    fs::path p{utf8_to_fs<fs::path::value_type>(path)};
+    fs::path tmp = p;
+    tmp += fs::unique_path(".tmp-%%%%-%%%%-%%%%");
+    try {
+        {
+            nowide::ofstream ofs{fs_to_utf8(tmp.native()).c_str(),
+                                 std::ios::out | std::ios::binary};
+            writer.write(ofs);
+            ofs.close();
+            if (!ofs)
+                throw std::runtime_error{"Cannot write bundle " + path};
+        }
+        fs::rename(tmp, p);
+    }
+    catch (...) {
+        boost::system::error_code ec;
+        fs::remove(tmp, ec);
+        throw;
+    }
+}
+
+} // dbmig namespace
@@ -0,0 +1,112 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_BUNDLE_INCLUDED
+#define DBMIG_BUNDLE_INCLUDED
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "script_action.hpp"
+#include "script_dir.hpp"
+
+namespace dbmig
+{
+    class repository;
+    
+    // Conventional file extension for bundles.
+    const std::string bundle_file_extension = ".dbmig";
+    
+    ///
+    /// A precompiled repository, packed into a single memory-mapped file
+    ///
+    /// A bundle holds every install and upgrade script of a repository, with
+    /// their versions already in order, their statements already split into
+    /// upgrade and rollback partitions, and their SHA256 digests already
+    /// calculated.  Opening one therefore needs no directory scan, filename
+    /// parsing, statement splitting or hashing; the file is simply mapped and
+    /// its tables bounds-checked.  Statements are views into the mapping, and
+    /// remain valid for the lifetime of the object.
+    ///
+    /// Scripts are identified by action and by path relative to their script
+    /// directory, exactly as they are for a repository on disk.  As ever,
+    /// rollback statements live in the same script as upgrade statements.
+    ///
+    class bundle
+    {
+    public:
+        typedef boost::string_ref statement_type;
+        typedef std::vector<statement_type> list_type;
+        
+        ///
+        /// Map the bundle at the given (UTF-8) path.
+        ///
+        /// Throws bad_bundle if the file is not a well-formed bundle.
+        ///
+        explicit bundle(const std::string &path);
+        ~bundle();
+        
+        ///
+        /// The path of the bundle file.
+        ///
+        const std::string &path() const;
+        
+        ///
+        /// All scripts in the bundle for a given action, keyed on version.
+        ///
+        script_dir::list_type scripts(const script_action action) const;
+        
+        ///
+        /// The statements of a given script relevant to a given action.
+        ///
+        /// Throws std::out_of_range if the bundle has no such script.
+        ///
+        list_type statements(const script_action action,
+                             const std::string &script_path) const;
+        
+        ///
+        /// The SHA256 digest of the whole of a given script.
+        ///
+        /// Throws std::out_of_range if the bundle has no such script.
+        ///
+        const std::string &sha256_sum(const script_action action,
+                                      const std::string &script_path) const;
+        
+    private:
+    
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+    
+    ///
+    /// Find out whether a (UTF-8) path refers to a bundle, rather than to a
+    /// repository directory.
+    ///
+    bool is_bundle(const std::string &path);
+    
+    ///
+    /// Pack every script of a repository on disk into a bundle
+    ///
+    /// The bundle is written to a temporary file alongside the given path,
+    /// and only renamed into place once complete.
+    ///
+    void write_bundle(const repository &repo, const std::string &path);
+}
+
+#endif // DBMIG_BUNDLE_INCLUDED
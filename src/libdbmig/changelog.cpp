@@ -32,11 +32,22 @@ struct changelog::impl
         const std::string &conn_str,
         const std::string &changeset)
         :
-        session_{conn_str},
+        own_session_{new soci::session{conn_str}},
+        session_(*own_session_),
         cl_table_{session_, changeset}
     {}
     
-    soci::session session_;
+    impl(
+        soci::session &session,
+        const std::string &changeset)
+        :
+        session_(session),
+        cl_table_{session_, changeset}
+    {}
+    
+    // Only set if the session was opened by the changelog itself.
+    std::unique_ptr<soci::session> own_session_;
+    soci::session &session_;
     changelog_table cl_table_;
 };
 
@@ -48,6 +59,12 @@ changelog::changelog(
     : pimpl_(new impl(conn_str, changeset))
 {}
 
+changelog::changelog(
+    soci::session &session,
+    const std::string &changeset)
+    : pimpl_(new impl(session, changeset))
+{}
+
 changelog::~changelog() = default;
 
 ///
@@ -61,7 +78,7 @@ const bool changelog::installed() const
 ///
 /// Get the currently-installed version of the database.
 ///
-const semver changelog::version() const
+semver changelog::version() const
 {
     return pimpl_->cl_table_.version();
 }
@@ -69,7 +86,7 @@ const semver changelog::version() const
 ///
 /// Get the most recent previously-installed version of the database.
 ///
-const semver changelog::previous_version() const
+semver changelog::previous_version() const
 {
     return pimpl_->cl_table_.previous_version();
 }
@@ -77,7 +94,7 @@ const semver changelog::previous_version() const
 ///
 /// Get the version that the database could be rolled back to
 ///
-const semver changelog::rollback_version() const
+semver changelog::rollback_version() const
 {
     return pimpl_->cl_table_.rollback_version();
 }
@@ -26,6 +26,11 @@
 #include "changelog_entry.hpp"
 #include "semantic_version.hpp"
 
+namespace soci
+{
+    class session;
+}
+
 namespace dbmig
 {
     ///
@@ -35,6 +40,14 @@ namespace dbmig
     {
     public:
         changelog(const std::string &conn_str, const std::string &changeset);
+        
+        ///
+        /// Use an existing session, which must outlive the changelog
+        ///
+        /// This lets the changelog share a connection with the scripts being
+        /// run, rather than open one of its own.
+        ///
+        changelog(soci::session &session, const std::string &changeset);
         ~changelog();
 
         ///
@@ -45,17 +58,17 @@ namespace dbmig
         ///
         /// Get the currently-installed version of the database.
         ///
-        const semver version() const;
+        semver version() const;
         
         ///
         /// Get the most recent previously-installed version of the database.
         ///
-        const semver previous_version() const;
+        semver previous_version() const;
         
         ///
         /// Get the version that the database could be rolled back to
         ///
-        const semver rollback_version() const;
+        semver rollback_version() const;
         
         ///
         /// Get a list of steps to take to roll back to a given version
@@ -84,7 +84,7 @@ const bool changelog_table::installed() const
 ///
 /// Get the currently-installed version of the database.
 ///
-const semver changelog_table::version() const
+semver changelog_table::version() const
 {
     if (!installed())
         return semver::zero();
@@ -102,7 +102,7 @@ const semver changelog_table::version() const
 ///
 /// Get the most recent previously-installed version of the database.
 ///
-const semver changelog_table::previous_version() const
+semver changelog_table::previous_version() const
 {
     if (!installed())
         return semver::zero();
@@ -120,7 +120,7 @@ const semver changelog_table::previous_version() const
 ///
 /// Get the version that the database could be atomically rolled back to
 ///
-const semver changelog_table::rollback_version() const
+semver changelog_table::rollback_version() const
 {
     // TODO
     return semver{0,0,0};
@@ -168,7 +168,7 @@ changelog_table::rollback_steps(const semver &ver) const
         // Add to the list.
         auto from_ver = semver::parse(from_ver_str);
         auto to_ver   = semver::parse(to_ver_str);
-        steps.push_back({to_ver, from_ver, hash});
+        steps.push_back({std::move(to_ver), std::move(from_ver), hash});
     }
 
     return steps;
@@ -224,7 +224,8 @@ changelog_table::contiguous_history(bool exclude_rolled_back) const
         auto to_ver   = semver::parse(to_ver_str);
         // Note that we push onto the front, since the resultset is in
         // reverse chronological order, and we want to return chronological.
-        entries.push_front({script_path, action, from_ver, to_ver, hash});
+        entries.push_front({script_path, action, std::move(from_ver),
+                           std::move(to_ver), hash});
     }
     return entries;
 }
@@ -243,7 +244,7 @@ void changelog_table::override_version(const semver &ver)
     if (!installed())
         pimpl_->create_changelog();
 
-    auto now_local = time::localtime(time::now());
+    auto now_str = time::to_timestamp(std::chrono::system_clock::now());
     string script_path = ""; // No path when the version is forced
     string action_str = "override";
     string from_version;
@@ -256,7 +257,7 @@ void changelog_table::override_version(const semver &ver)
     // Insert a new changelog row.
     session_ << sql_.insert_sql,
         use(changeset_, "changeset"),
-        use(now_local, "applied"),
+        use(now_str, "applied"),
         use(script_path, "script_path"),
         use(action_str, "action"),
         use(from_version, from_version_ind, "from_version"),
@@ -269,7 +270,7 @@ void changelog_table::override_version(const semver &ver)
 /// Write a new entry to the changelog (when installing from scratch)
 ///
 void changelog_table::write(
-    const time_t &applied,
+    const std::chrono::system_clock::time_point &applied,
     const string &script_path,
     const semver &install_version,
     const string &sha256_hash,
@@ -284,29 +285,30 @@ void changelog_table::write(
     if (!installed())
         pimpl_->create_changelog();
 
-    auto applied_local = time::localtime(applied);
+    string applied_str = time::to_timestamp(applied);
     string action_str = to_string(script_action::install);
     string from_version_str;
     indicator from_version_ind = i_null;
     string to_version_str = install_version.to_str();
+    string interval = time::to_interval(seconds);
     
     // Insert a new changelog row.
     session_ << sql_.insert_sql,
         use(changeset_, "changeset"),
-        use(applied_local, "applied"),
+        use(applied_str, "applied"),
         use(script_path, "script_path"),
         use(action_str, "action"),
         use(from_version_str, from_version_ind, "from_version"),
         use(to_version_str, "to_version"),
         use(sha256_hash, "sha256_hash"),
-        use(seconds, "time_taken");
+        use(interval, "time_taken");
 }
 
 ///
 /// Write a new entry to the changelog (with from-version)
 ///
 void changelog_table::write(
-    const time_t &applied,
+    const std::chrono::system_clock::time_point &applied,
     const string &script_path,
     const script_action &action,
     const semver &from_version,
@@ -323,21 +325,22 @@ void changelog_table::write(
     if (!installed())
         pimpl_->create_changelog();
 
-    auto applied_local = time::localtime(applied);
+    string applied_str = time::to_timestamp(applied);
     string from_version_str = from_version.to_str();
     string to_version_str = to_version.to_str();
     string action_str = to_string(action);
+    string interval = time::to_interval(seconds);
     
     // Insert a new changelog row.
     session_ << sql_.insert_sql,
         use(changeset_, "changeset"),
-        use(applied_local, "applied"),
+        use(applied_str, "applied"),
         use(script_path, "script_path"),
         use(action_str, "action"),
         use(from_version_str, "from_version"),
         use(to_version_str, "to_version"),
         use(sha256_hash, "sha256_hash"),
-        use(seconds, "time_taken");
+        use(interval, "time_taken");
 }
 
 } // dbmig namespace
@@ -49,17 +49,17 @@ namespace dbmig
         ///
         /// Get the currently-installed version of the database.
         ///
-        const semver version() const;
+        semver version() const;
         
         ///
         /// Get the most recent previously-installed version of the database.
         ///
-        const semver previous_version() const;
+        semver previous_version() const;
         
         ///
         /// Get the version that the database could be atomically rolled back to
         ///
-        const semver rollback_version() const;
+        semver rollback_version() const;
         
         ///
         /// Get a list of steps to take to roll back to a given version
@@ -80,14 +80,17 @@ namespace dbmig
         ///
         /// Write a new entry to the changelog.
         ///
+        /// The time applied is recorded to the microsecond, as is the number
+        /// of seconds the script took to run.
+        ///
         void write(
-            const std::time_t &applied,
+            const std::chrono::system_clock::time_point &applied,
             const std::string &script_path,
             const semver &install_version,
             const std::string &sha256_hash,
             const double seconds);
         void write(
-            const std::time_t &applied,
+            const std::chrono::system_clock::time_point &applied,
             const std::string &script_path,
             const script_action &action,
             const semver &from_version,
@@ -0,0 +1,263 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "char_scan.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Vectorised scanning is only implemented for x86 (which is all that the
+// configure script supports), and relies on the GCC/Clang target attribute
+// so that AVX2 code can be compiled without requiring AVX2 at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DBMIG_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace dbmig {
+
+char_set::char_set(std::initializer_list<char> chars) :
+    size_(chars.size())
+{
+    if (size_ > max_size)
+        throw std::length_error{"Too many characters in char_set"};
+    std::copy(chars.begin(), chars.end(), chars_);
+    std::fill(table_, table_ + 256, false);
+    std::fill(low_table_, low_table_ + 16, 0);
+    std::fill(high_table_, high_table_ + 16, 0);
+    unsigned char bit = 1;
+    for (auto c : chars) {
+        auto u = static_cast<unsigned char>(c);
+        table_[u] = true;
+        low_table_[u & 0x0f] |= bit;
+        high_table_[u >> 4] |= bit;
+        bit <<= 1;
+    }
+}
+
+static const char *scalar_find_first_of(const char *b, const char *e,
+                                        const char_set &set)
+{
+    for (; b != e; ++b) {
+        if (set.contains(*b))
+            return b;
+    }
+    return e;
+}
+
+static const char *scalar_find_string(const char *b, const char *e,
+                                      const char *nb, const char *ne)
+{
+    return std::search(b, e, nb, ne);
+}
+
+#ifdef DBMIG_SCAN_X86
+
+// Return the index of the lowest set bit.
+static inline unsigned int lowest_bit(unsigned int mask)
+{
+    return __builtin_ctz(mask);
+}
+
+__attribute__((target("sse2")))
+static const char *sse2_find_first_of(const char *b, const char *e,
+                                      const char_set &set)
+{
+    __m128i needles[char_set::max_size];
+    std::size_t n = 0;
+    for (auto c : set)
+        needles[n++] = _mm_set1_epi8(c);
+    
+    for (; e - b >= 16; b += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+        __m128i eq = _mm_setzero_si128();
+        for (std::size_t i = 0; i < n; ++i)
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, needles[i]));
+        unsigned int mask = _mm_movemask_epi8(eq);
+        if (mask != 0)
+            return b + lowest_bit(mask);
+    }
+    return scalar_find_first_of(b, e, set);
+}
+
+///
+/// Classify 32 characters at once by looking up each nibble in the set's
+/// nibble tables, so that the cost does not depend on the size of the set.
+///
+__attribute__((target("avx2")))
+static const char *avx2_find_first_of(const char *b, const char *e,
+                                      const char_set &set)
+{
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(set.low_nibble_table())));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(set.high_nibble_table())));
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    
+    for (; e - b >= 32; b += 32) {
+        __m256i block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(b));
+        __m256i low = _mm256_shuffle_epi8(
+            low_table, _mm256_and_si256(block, low_mask));
+        __m256i high = _mm256_shuffle_epi8(
+            high_table,
+            _mm256_and_si256(_mm256_srli_epi16(block, 4), low_mask));
+        __m256i none = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero);
+        unsigned int mask = ~static_cast<unsigned int>(
+            _mm256_movemask_epi8(none));
+        if (mask != 0)
+            return b + lowest_bit(mask);
+    }
+    return sse2_find_first_of(b, e, set);
+}
+
+///
+/// Find a string by first finding blocks where both its first and last
+/// characters occur at the right distance apart, and only then comparing the
+/// characters in between.
+///
+__attribute__((target("sse2")))
+static const char *sse2_find_string(const char *b, const char *e,
+                                    const char *nb, const char *ne)
+{
+    const std::size_t k = ne - nb;
+    const __m128i first = _mm_set1_epi8(nb[0]);
+    const __m128i last = _mm_set1_epi8(nb[k - 1]);
+    
+    for (; e - b >= static_cast<std::ptrdiff_t>(k + 15); b += 16) {
+        __m128i block_first = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(b));
+        __m128i block_last = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(b + k - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(block_first, first),
+            _mm_cmpeq_epi8(block_last, last)));
+        while (mask != 0) {
+            auto i = lowest_bit(mask);
+            if (std::memcmp(b + i + 1, nb + 1, k - 2) == 0)
+                return b + i;
+            mask &= mask - 1;
+        }
+    }
+    return scalar_find_string(b, e, nb, ne);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_find_string(const char *b, const char *e,
+                                    const char *nb, const char *ne)
+{
+    const std::size_t k = ne - nb;
+    const __m256i first = _mm256_set1_epi8(nb[0]);
+    const __m256i last = _mm256_set1_epi8(nb[k - 1]);
+    
+    for (; e - b >= static_cast<std::ptrdiff_t>(k + 31); b += 32) {
+        __m256i block_first = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(b));
+        __m256i block_last = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(b + k - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(block_first, first),
+            _mm256_cmpeq_epi8(block_last, last)));
+        while (mask != 0) {
+            auto i = lowest_bit(mask);
+            if (std::memcmp(b + i + 1, nb + 1, k - 2) == 0)
+                return b + i;
+            mask &= mask - 1;
+        }
+    }
+    return sse2_find_string(b, e, nb, ne);
+}
+
+#endif // DBMIG_SCAN_X86
+
+static scan_isa detect_scan_isa()
+{
+#ifdef DBMIG_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return scan_isa::avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return scan_isa::sse2;
+#endif
+    return scan_isa::scalar;
+}
+
+///
+/// The best instruction set supported by the CPU we are running on.
+///
+scan_isa best_scan_isa()
+{
+    static const scan_isa isa = detect_scan_isa();
+    return isa;
+}
+
+///
+/// Find the first character in [b, e) that is in the given set, using a
+/// specific instruction set.
+///
+const char *find_first_of(const char *b, const char *e, const char_set &set,
+                          const scan_isa isa)
+{
+    switch (isa) {
+#ifdef DBMIG_SCAN_X86
+        case scan_isa::avx2:
+            return avx2_find_first_of(b, e, set);
+        case scan_isa::sse2:
+            return sse2_find_first_of(b, e, set);
+#endif
+        default:
+            return scalar_find_first_of(b, e, set);
+    }
+}
+
+///
+/// Find the first occurrence of a string [nb, ne) within [b, e).
+///
+const char *find_string(const char *b, const char *e,
+                        const char *nb, const char *ne)
+{
+    return find_string(b, e, nb, ne, best_scan_isa());
+}
+
+///
+/// Find the first occurrence of a string [nb, ne) within [b, e), using a
+/// specific instruction set.
+///
+const char *find_string(const char *b, const char *e,
+                        const char *nb, const char *ne, const scan_isa isa)
+{
+    // Strings too short to have distinct first and last characters are
+    // better left to the scalar search.
+    if (ne - nb < 2)
+        return scalar_find_string(b, e, nb, ne);
+    
+    switch (isa) {
+#ifdef DBMIG_SCAN_X86
+        case scan_isa::avx2:
+            return avx2_find_string(b, e, nb, ne);
+        case scan_isa::sse2:
+            return sse2_find_string(b, e, nb, ne);
+#endif
+        default:
+            return scalar_find_string(b, e, nb, ne);
+    }
+}
+
+} // dbmig namespace
@@ -0,0 +1,124 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_CHAR_SCAN_INCLUDED
+#define DBMIG_CHAR_SCAN_INCLUDED
+
+#include <cstddef>
+#include <initializer_list>
+
+namespace dbmig
+{
+    ///
+    /// Instruction set used to scan blocks of characters
+    ///
+    enum class scan_isa
+    {
+        scalar,
+        sse2,
+        avx2
+    };
+    
+    ///
+    /// A small set of characters to scan for
+    ///
+    class char_set
+    {
+    public:
+        static const std::size_t max_size = 8;
+        
+        ///
+        /// Construct a set of (at most max_size) characters.
+        ///
+        char_set(std::initializer_list<char> chars);
+        
+        bool contains(char c) const
+        {
+            return table_[static_cast<unsigned char>(c)];
+        }
+        
+        const char *begin() const { return chars_; }
+        const char *end() const   { return chars_ + size_; }
+        
+        ///
+        /// Tables giving, for each low and high nibble, a bit for each
+        /// character in the set with that nibble.  A character is in the set
+        /// if the entries for both of its nibbles have a bit in common.
+        ///
+        const unsigned char *low_nibble_table() const  { return low_table_; }
+        const unsigned char *high_nibble_table() const { return high_table_; }
+        
+    private:
+        char chars_[max_size];
+        std::size_t size_;
+        bool table_[256];
+        unsigned char low_table_[16];
+        unsigned char high_table_[16];
+    };
+    
+    ///
+    /// The best instruction set supported by the CPU we are running on.
+    ///
+    /// This is detected once, on first use.
+    ///
+    scan_isa best_scan_isa();
+    
+    ///
+    /// Find the first character in [b, e) that is in the given set, using a
+    /// specific instruction set (which must be supported by the CPU).
+    ///
+    const char *find_first_of(const char *b, const char *e,
+                              const char_set &set, const scan_isa isa);
+    
+    ///
+    /// Find the first character in [b, e) that is in the given set.
+    ///
+    /// Returns e if there is no such character.  The range is scanned in
+    /// blocks of 16 or 32 characters where the CPU supports it.
+    ///
+    inline const char *find_first_of(const char *b, const char *e,
+                                     const char_set &set)
+    {
+        // Characters of interest are often close together, so check the
+        // first few inline before paying for a call to the vectorised scan.
+        const char *prefix_end = e - b > 16 ? b + 16 : e;
+        for (; b != prefix_end; ++b) {
+            if (set.contains(*b))
+                return b;
+        }
+        return b == e ? e : find_first_of(b, e, set, best_scan_isa());
+    }
+    
+    ///
+    /// Find the first occurrence of a string [nb, ne) within [b, e).
+    ///
+    /// Returns e if there is no such occurrence.
+    ///
+    const char *find_string(const char *b, const char *e,
+                            const char *nb, const char *ne);
+    
+    ///
+    /// Find the first occurrence of a string [nb, ne) within [b, e), using a
+    /// specific instruction set (which must be supported by the CPU).
+    ///
+    const char *find_string(const char *b, const char *e,
+                            const char *nb, const char *ne,
+                            const scan_isa isa);
+}
+
+#endif // DBMIG_CHAR_SCAN_INCLUDED
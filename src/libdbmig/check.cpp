@@ -18,9 +18,15 @@
 
 #include "check.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "changelog.hpp"
 #include "repository.hpp"
-#include "script_stream.hpp"
+#include "hash_cache.hpp"
 #include "diff.hpp"
 
 namespace dbmig {
@@ -51,6 +57,7 @@ struct script_info
     script_action action;
     semver version;
     std::string path;
+    std::string hash;
 };
 
 struct changelog_entry_script_info_cmp
@@ -66,6 +73,62 @@ struct changelog_entry_script_info_eq
     }
 };
 
+///
+/// The default number of jobs: one per core
+///
+unsigned int check_options::default_jobs()
+{
+    // Zero means the number of cores could not be determined.
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+///
+/// Calculate the hash of every script, using up to the given number of threads
+///
+/// Each thread repeatedly claims the next unhashed script, so that a few
+/// large scripts do not hold up the rest.  If hashing any script fails, the
+/// first such exception is rethrown once all threads have finished.
+///
+template <typename HashFunc>
+static void hash_scripts(std::vector<script_info> &scripts,
+                         const unsigned int jobs,
+                         HashFunc hash_of)
+{
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    
+    auto worker = [&]()
+    {
+        for (auto i = next++; i < scripts.size(); i = next++) {
+            try {
+                scripts[i].hash = hash_of(scripts[i]);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock{error_mutex};
+                if (!error)
+                    error = std::current_exception();
+                next = scripts.size();
+            }
+        }
+    };
+    
+    auto num_threads = std::min<std::size_t>(jobs, scripts.size());
+    if (num_threads <= 1) {
+        worker();
+    }
+    else {
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < num_threads; ++t)
+            threads.emplace_back(worker);
+        for (auto &thread : threads)
+            thread.join();
+    }
+    
+    if (error)
+        std::rethrow_exception(error);
+}
+
 ///
 /// Check the compatibility of a repository with a given database
 ///
@@ -74,9 +137,31 @@ perform_check(
     const std::string &conn_str,
     const std::string &changeset,
     const std::string &repository_path)
+{
+    return perform_check(conn_str, changeset, repository_path,
+                         check_options{});
+}
+const check_report
+perform_check(
+    const std::string &conn_str,
+    const std::string &changeset,
+    const std::string &repository_path,
+    const check_options &options)
 {
     changelog cl{conn_str, changeset};
-    repository repo{repository_path};
+    repository repo{repository_path, options.use_script_index
+        ? script_loading::indexed : script_loading::full_scan};
+    
+    std::unique_ptr<hash_cache> cache;
+    if (options.use_hash_cache && !repo.script_bundle())
+        cache.reset(new hash_cache{repository_path + "/" +
+                                   hash_cache_filename});
+    auto script_hash_of = [&repo,&cache](const script_info &script)
+    {
+        return cache
+            ? calculate_script_hash(repo, script.action, script.path, *cache)
+            : calculate_script_hash(repo, script.action, script.path);
+    };
     
     // Start by getting a contiguous history of events in the changelog back
     // to when the database was last non-incrementally changed.
@@ -97,7 +182,7 @@ perform_check(
         // We have an install script.
         scripts.push_back({script_action::install,
                            install_script_range.first->first,
-                           install_script_range.first->second});
+                           install_script_range.first->second, ""});
     }
     // Look for upgrade scripts.
     auto upgrade_script_search_from = scripts.empty()
@@ -106,9 +191,15 @@ perform_check(
     auto upgrade_script_range = repo.upgrade_scripts(
         upgrade_script_search_from, cl_latest);
     for (auto &us : upgrade_script_range) {
-        scripts.push_back({script_action::upgrade, us.first, us.second});
+        scripts.push_back({script_action::upgrade, us.first, us.second, ""});
     }
     
+    // Hash the scripts up-front and concurrently; the diff then reports on
+    // them in order, so the report does not depend on which finished first.
+    hash_scripts(scripts, options.jobs, script_hash_of);
+    if (cache)
+        cache->save();
+    
     check_report report;
     
     // The changelog events and repository scripts are in ascending order of
@@ -128,26 +219,22 @@ perform_check(
                               cle.script_path,
                               cle.sha256_hash});
         },
-        [&report,&repo](script_info &script)
+        [&report](script_info &script)
         {
             // The repository has something not in the changelog.
-            std::string script_hash = calculate_script_hash(
-                repo, script.action, script.path);
             report.push_back({script.version,
                               check_report_issue_type::missing_from_changelog,
                               script.action,
                               script.path,
-                              script_hash,
+                              script.hash,
                               script_action::install /* fake */, "", ""});
         },
-        [&report,&repo](changelog_entry &cle, script_info &script)
+        [&report](changelog_entry &cle, script_info &script)
         {
             // The changelog and repository have something at the same version.
             // Check the hashes, actions, and paths.
             // TODO - is comparing script paths a sensible check?
-            std::string script_hash = calculate_script_hash(
-                repo, script.action, script.path);
-            if (script_hash != cle.sha256_hash ||
+            if (script.hash != cle.sha256_hash ||
                 script.action != cle.action ||
                 script.path != cle.script_path) {
                 // Mismatch.
@@ -155,7 +242,7 @@ perform_check(
                                   check_report_issue_type::hash_mismatch,
                                   script.action,
                                   script.path,
-                                  script_hash,
+                                  script.hash,
                                   cle.action,
                                   cle.script_path,
                                   cle.sha256_hash});
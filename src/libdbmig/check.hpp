@@ -68,6 +68,42 @@ namespace dbmig
     const char *
     check_report_issue_type_to_str(const check_report_issue_type type);
 
+    ///
+    /// Options controlling how a check is performed
+    ///
+    struct check_options
+    {
+        check_options() :
+            use_hash_cache(true),
+            use_script_index(true),
+            jobs(default_jobs())
+        {}
+        
+        ///
+        /// Whether to consult (and update) the hash cache kept in the
+        /// repository, rather than hashing every script afresh
+        ///
+        /// Bundles already hold every hash, so have no cache.
+        ///
+        bool use_hash_cache;
+        
+        ///
+        /// Whether to consult (and update) the index kept alongside each
+        /// script directory, rather than scanning every directory afresh
+        ///
+        bool use_script_index;
+        
+        ///
+        /// Maximum number of scripts to hash concurrently
+        ///
+        unsigned int jobs;
+        
+        ///
+        /// The default number of jobs: one per core
+        ///
+        static unsigned int default_jobs();
+    };
+    
     ///
     /// Check the compatibility of a repository with a given database
     ///
@@ -76,6 +112,12 @@ namespace dbmig
             const std::string &conn_str,
             const std::string &changeset,
             const std::string &repository_path);
+    const check_report
+    perform_check(
+            const std::string &conn_str,
+            const std::string &changeset,
+            const std::string &repository_path,
+            const check_options &options);
 
 }
 
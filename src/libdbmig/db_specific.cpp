@@ -150,7 +150,31 @@ INSERT INTO dbmig_changelog (
 VALUES (
     :changeset, :applied, :script_path, :action, :from_version, :to_version,
     :sha256_hash, current_user, :time_taken)
-)SQL"
+)SQL",
+                // non_transactional_prefixes
+                {
+                    // Scripts that manage their own transactions.
+                    "BEGIN", "START TRANSACTION", "COMMIT", "ROLLBACK",
+                    "ABORT",
+                    // Statements refused within a transaction block, or
+                    // (ALTER TYPE ... ADD VALUE) whose results may not be
+                    // used until it commits.
+                    "VACUUM", "REINDEX DATABASE", "REINDEX SYSTEM",
+                    "REINDEX * CONCURRENTLY", "ALTER SYSTEM",
+                    "ALTER TYPE * ADD VALUE",
+                    "CREATE DATABASE", "DROP DATABASE",
+                    "CREATE TABLESPACE", "DROP TABLESPACE",
+                    "CREATE INDEX CONCURRENTLY",
+                    "CREATE UNIQUE INDEX CONCURRENTLY",
+                    "DROP INDEX CONCURRENTLY",
+                    "CREATE SUBSCRIPTION", "DROP SUBSCRIPTION"
+                },
+                // non_transactional_statements
+                {
+                    // Synonyms for COMMIT; otherwise, END begins many a
+                    // clause (END IF, END LOOP and so on).
+                    "END", "END WORK", "END TRANSACTION"
+                }
             }
         }
     };
@@ -20,6 +20,7 @@
 #define DBMIG_CHANGELOG_SQL_INCLUDED
 
 #include <string>
+#include <vector>
 
 namespace dbmig {
 
@@ -34,6 +35,13 @@ namespace dbmig {
         std::string rollback_steps_sql;
         std::string contiguous_history_sql;
         std::string insert_sql;
+        // Leading keywords (upper case, separated by single spaces) of the
+        // statements that cannot run inside a transaction block shared with
+        // other scripts, where "*" stands for any one name.  A statement
+        // matches one of the prefixes if its keywords begin with it, but
+        // matches one of the statements only if its keywords are just that.
+        std::vector<std::string> non_transactional_prefixes;
+        std::vector<std::string> non_transactional_statements;
     };
 
     const db_specific &get_db_specific(const std::string &backend);
@@ -0,0 +1,395 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dir_scan.hpp"
+
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "fs_encoding.hpp"
+
+using std::string;
+
+namespace dbmig {
+
+static boost::filesystem::filesystem_error dir_error(const char *what,
+                                                     const string &path,
+                                                     int error)
+{
+    return boost::filesystem::filesystem_error{what, path,
+        boost::system::error_code{error, boost::system::system_category()}};
+}
+
+dir_entry_list list_directory(const string &path)
+{
+    return open_dir{path}.list();
+}
+
+#ifdef _WIN32
+
+// Private impl class
+struct open_dir::impl
+{
+    string path_;
+    boost::filesystem::path native_path_;
+    std::int64_t mtime_ns_;
+};
+
+///
+/// Check that a directory exists, and find its modification time
+///
+static std::int64_t check_directory(const boost::filesystem::path &p,
+                                    const string &path)
+{
+    namespace fs = boost::filesystem;
+    
+    boost::system::error_code ec;
+    if (!fs::is_directory(p, ec)) {
+        throw fs::filesystem_error{"Cannot open directory", path,
+            ec ? ec : boost::system::errc::make_error_code(
+                boost::system::errc::not_a_directory)};
+    }
+    // No sub-second times.
+    return static_cast<std::int64_t>(fs::last_write_time(p)) * 1000000000;
+}
+
+open_dir::open_dir(const string &path)
+{
+    boost::filesystem::path p{utf8_to_fs<boost::filesystem::path::value_type>(
+        path)};
+    auto mtime_ns = check_directory(p, path);
+    pimpl_.reset(new impl{path, p, mtime_ns});
+}
+
+open_dir::open_dir(const open_dir &parent, const string &relative_path)
+{
+    auto path = parent.pimpl_->path_ + "/" + relative_path;
+    auto p = parent.pimpl_->native_path_ /
+        utf8_to_fs<boost::filesystem::path::value_type>(relative_path);
+    auto mtime_ns = check_directory(p, path);
+    pimpl_.reset(new impl{path, p, mtime_ns});
+}
+
+open_dir::~open_dir() = default;
+
+dir_entry_list open_dir::list() const
+{
+    namespace fs = boost::filesystem;
+    
+    // No file types come with the listing, so ask for each one.
+    dir_entry_list entries;
+    for (auto it = fs::directory_iterator(pimpl_->native_path_);
+        it != fs::directory_iterator(); ++it)
+    {
+        auto status = fs::status(it->path());
+        auto type = fs::is_regular_file(status) ? dir_entry_type::file
+            : fs::is_directory(status) ? dir_entry_type::directory
+            : dir_entry_type::other;
+        entries.push_back({fs_to_utf8(it->path().filename().native()), type});
+    }
+    return entries;
+}
+
+bool open_dir::same_directory_as(const open_dir &other) const
+{
+    boost::system::error_code ec;
+    return boost::filesystem::equivalent(pimpl_->native_path_,
+                                         other.pimpl_->native_path_, ec);
+}
+
+#else
+
+// Private impl class
+struct open_dir::impl
+{
+    ~impl() { ::close(fd_); }
+    
+    string path_;
+    int fd_;
+    struct stat stat_;
+};
+
+///
+/// Open a directory relative to another (or to the working directory, given
+/// AT_FDCWD), and stat it
+///
+static int open_directory(int parent_fd, const string &name,
+                          const string &path, struct stat &buf)
+{
+    int fd = ::openat(parent_fd, utf8_to_fs<char>(name).c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        throw dir_error("Cannot open directory", path, errno);
+    if (::fstat(fd, &buf) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw dir_error("Cannot open directory", path, error);
+    }
+    return fd;
+}
+
+open_dir::open_dir(const string &path)
+{
+    struct stat buf;
+    int fd = open_directory(AT_FDCWD, path, path, buf);
+    pimpl_.reset(new impl{path, fd, buf});
+}
+
+open_dir::open_dir(const open_dir &parent, const string &relative_path)
+{
+    auto path = parent.pimpl_->path_ + "/" + relative_path;
+    struct stat buf;
+    int fd = open_directory(parent.pimpl_->fd_, relative_path, path, buf);
+    pimpl_.reset(new impl{path, fd, buf});
+}
+
+open_dir::~open_dir() = default;
+
+///
+/// Find the type of an entry by stat'ing it, following any symbolic link
+///
+static dir_entry_type stat_entry_type(int dir_fd, const char *name)
+{
+    struct stat buf;
+    if (::fstatat(dir_fd, name, &buf, 0) != 0)
+        return dir_entry_type::other;
+    return S_ISREG(buf.st_mode) ? dir_entry_type::file
+        : S_ISDIR(buf.st_mode) ? dir_entry_type::directory
+        : dir_entry_type::other;
+}
+
+///
+/// Add an entry, as listed along with its type (if known), to a list
+///
+static void add_entry(dir_entry_list &entries, int dir_fd, const char *name,
+                      unsigned char d_type)
+{
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        return;
+    
+    dir_entry_type type;
+    switch (d_type) {
+        case DT_REG:
+            type = dir_entry_type::file;
+            break;
+        case DT_DIR:
+            type = dir_entry_type::directory;
+            break;
+        case DT_LNK:
+        case DT_UNKNOWN:
+            // Links must be followed, and some file systems never say.
+            type = stat_entry_type(dir_fd, name);
+            break;
+        default:
+            type = dir_entry_type::other;
+            break;
+    }
+    entries.push_back({fs_to_utf8(string{name}), type});
+}
+
+#ifdef __linux__
+
+///
+/// A directory entry as the kernel returns it from getdents64
+///
+struct kernel_dirent64
+{
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+dir_entry_list open_dir::list() const
+{
+    // Read entries straight from the kernel, many to a call, rather than
+    // through a directory stream of our own.
+    int fd = pimpl_->fd_;
+    if (::lseek(fd, 0, SEEK_SET) != 0)
+        throw dir_error("Cannot read directory", pimpl_->path_, errno);
+    
+    dir_entry_list entries;
+    alignas(kernel_dirent64) char buf[32768];
+    for (;;) {
+        auto len = ::syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+            throw dir_error("Cannot read directory", pimpl_->path_, errno);
+        if (len == 0)
+            break;
+        
+        for (char *p = buf; p < buf + len; ) {
+            auto ent = reinterpret_cast<const kernel_dirent64 *>(p);
+            p += ent->d_reclen;
+            add_entry(entries, fd, ent->d_name, ent->d_type);
+        }
+    }
+    return entries;
+}
+
+#else
+
+///
+/// Closes a directory stream on scope exit
+///
+struct dir_closer
+{
+    DIR *dir;
+    ~dir_closer() { ::closedir(dir); }
+};
+
+dir_entry_list open_dir::list() const
+{
+    // The stream takes ownership of its descriptor, so give it a copy.
+    int fd = ::dup(pimpl_->fd_);
+    DIR *dir = fd < 0 ? nullptr : ::fdopendir(fd);
+    if (!dir) {
+        int error = errno;
+        if (fd >= 0)
+            ::close(fd);
+        throw dir_error("Cannot read directory", pimpl_->path_, error);
+    }
+    dir_closer closer{dir};
+    ::rewinddir(dir);
+    
+    dir_entry_list entries;
+    for (;;) {
+        errno = 0;
+        struct dirent *ent = ::readdir(dir);
+        if (!ent)
+            break;
+        add_entry(entries, fd, ent->d_name, ent->d_type);
+    }
+    if (errno != 0)
+        throw dir_error("Cannot read directory", pimpl_->path_, errno);
+    return entries;
+}
+
+#endif
+
+bool open_dir::same_directory_as(const open_dir &other) const
+{
+    return pimpl_->stat_.st_dev == other.pimpl_->stat_.st_dev &&
+        pimpl_->stat_.st_ino == other.pimpl_->stat_.st_ino;
+}
+
+#endif
+
+const string &open_dir::path() const noexcept
+{
+    return pimpl_->path_;
+}
+
+std::int64_t open_dir::mtime_ns() const noexcept
+{
+#ifdef _WIN32
+    return pimpl_->mtime_ns_;
+#else
+    return static_cast<std::int64_t>(pimpl_->stat_.st_mtim.tv_sec) *
+        1000000000 + pimpl_->stat_.st_mtim.tv_nsec;
+#endif
+}
+
+///
+/// Obtain the identity of the file at the given (UTF-8) path.
+///
+script_file_stat stat_script_file(const string &path)
+{
+    script_file_stat st;
+#ifdef _WIN32
+    struct _stat64 buf;
+    if (_wstat64(utf8_to_fs<wchar_t>(path).c_str(), &buf) != 0)
+#else
+    struct stat buf;
+    if (::stat(utf8_to_fs<char>(path).c_str(), &buf) != 0)
+#endif
+    {
+        throw boost::filesystem::filesystem_error{
+            "Cannot stat script", path,
+            boost::system::error_code{errno, boost::system::system_category()}};
+    }
+    st.size = static_cast<std::uint64_t>(buf.st_size);
+#ifdef _WIN32
+    // No sub-second times or inodes.
+    st.mtime_ns = static_cast<std::int64_t>(buf.st_mtime) * 1000000000;
+    st.inode = 0;
+#else
+    st.mtime_ns = static_cast<std::int64_t>(buf.st_mtim.tv_sec) * 1000000000 +
+        buf.st_mtim.tv_nsec;
+    st.inode = static_cast<std::uint64_t>(buf.st_ino);
+#endif
+    return st;
+}
+
+///
+/// Visit a directory, and then walk whatever sub-directories are left among
+/// its entries.
+///
+/// The directories currently being walked, the root first, are kept so that
+/// a symbolic link back to any of them is caught, rather than followed
+/// forever.
+///
+static void walk_directory(const open_dir &dir, const string &relative_path,
+                           const dir_visitor &visit,
+                           std::vector<const open_dir *> &ancestors)
+{
+    auto entries = dir.list();
+    visit(relative_path, dir, entries);
+    
+    ancestors.push_back(&dir);
+    for (auto &entry : entries) {
+        if (entry.type != dir_entry_type::directory)
+            continue;
+        
+        open_dir sub_dir{dir, entry.name};
+        for (auto ancestor : ancestors) {
+            if (sub_dir.same_directory_as(*ancestor)) {
+                throw boost::filesystem::filesystem_error{
+                    "Directory leads back to one that contains it",
+                    sub_dir.path(),
+                    boost::system::errc::make_error_code(
+                        boost::system::errc::too_many_symbolic_link_levels)};
+            }
+        }
+        walk_directory(sub_dir, relative_path.empty() ? entry.name
+                           : relative_path + "/" + entry.name,
+                       visit, ancestors);
+    }
+    ancestors.pop_back();
+}
+
+void walk_directory_tree(const open_dir &root, const dir_visitor &visit)
+{
+    std::vector<const open_dir *> ancestors;
+    walk_directory(root, "", visit, ancestors);
+}
+
+} // dbmig namespace
@@ -0,0 +1,174 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_DIR_SCAN_INCLUDED
+#define DBMIG_DIR_SCAN_INCLUDED
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbmig
+{
+    ///
+    /// Kinds of directory entry, after following any symbolic link
+    ///
+    enum class dir_entry_type
+    {
+        file,
+        directory,
+        other
+    };
+    
+    ///
+    /// An entry within a directory
+    ///
+    struct dir_entry
+    {
+        std::string name; // UTF-8
+        dir_entry_type type;
+    };
+    
+    typedef std::vector<dir_entry> dir_entry_list;
+    
+    ///
+    /// List the entries of the directory at the given (UTF-8) path
+    ///
+    /// The "." and ".." entries are omitted, and entries are in no particular
+    /// order.  Where the file system reports the type of each entry alongside
+    /// its name, no entry is stat'ed; otherwise (and for symbolic links, which
+    /// are followed) each such entry costs one stat.  A dangling symbolic link
+    /// is listed as dir_entry_type::other.
+    ///
+    /// Throws boost::filesystem::filesystem_error if the directory cannot be
+    /// read.
+    ///
+    dir_entry_list list_directory(const std::string &path);
+    
+    ///
+    /// Identity of a script file on disk, to tell whether it has changed
+    ///
+    struct script_file_stat
+    {
+        std::uint64_t size;
+        std::int64_t mtime_ns;
+        std::uint64_t inode;
+    };
+    
+    inline bool operator==(const script_file_stat &a, const script_file_stat &b)
+    {
+        return a.size == b.size && a.mtime_ns == b.mtime_ns &&
+            a.inode == b.inode;
+    }
+    inline bool operator!=(const script_file_stat &a, const script_file_stat &b)
+    {
+        return !(a == b);
+    }
+    
+    ///
+    /// Obtain the identity of the file at the given (UTF-8) path.
+    ///
+    /// Throws boost::filesystem::filesystem_error if the file cannot be found.
+    ///
+    script_file_stat stat_script_file(const std::string &path);
+    
+    ///
+    /// A directory held open, so that its entries and sub-directories can be
+    /// reached without resolving its path again
+    ///
+    class open_dir
+    {
+    public:
+    
+        ///
+        /// Open the directory at the given (UTF-8) path
+        ///
+        /// Throws boost::filesystem::filesystem_error if it cannot be opened.
+        ///
+        explicit open_dir(const std::string &path);
+        
+        ///
+        /// Open a directory (or a symbolic link to one) by its path relative
+        /// to another open directory
+        ///
+        /// Only the relative path is resolved, so it costs the same however
+        /// deeply the parent is nested.  Throws as above.
+        ///
+        open_dir(const open_dir &parent, const std::string &relative_path);
+        
+        ~open_dir();
+        
+        open_dir(const open_dir &) = delete;
+        open_dir &operator=(const open_dir &) = delete;
+        
+        ///
+        /// The (UTF-8) path of the directory, as reached
+        ///
+        const std::string &path() const noexcept;
+        
+        ///
+        /// The modification time of the directory when it was opened, in
+        /// nanoseconds since the epoch
+        ///
+        std::int64_t mtime_ns() const noexcept;
+        
+        ///
+        /// List the entries of the directory, as list_directory() does
+        ///
+        dir_entry_list list() const;
+        
+        ///
+        /// Is this the same directory as another, however each was reached?
+        ///
+        bool same_directory_as(const open_dir &other) const;
+    
+    private:
+    
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+    
+    ///
+    /// Called for each directory in a walk, with its path relative to the
+    /// root, the directory itself, and its entries
+    ///
+    typedef std::function<void (const std::string &relative_path,
+                                const open_dir &dir,
+                                dir_entry_list &entries)> dir_visitor;
+    
+    ///
+    /// Walk the tree of directories beneath an open directory
+    ///
+    /// The root is visited first, with a relative path of "", and then each
+    /// sub-directory left among its entries once visit() returns, depth
+    /// first, with relative paths such as "1/1.2/1.2.3".  So visit() may
+    /// remove any sub-directories it does not want descended into.  Each
+    /// directory is opened relative to its parent, so that the walk costs
+    /// the same per entry however deep the tree goes.
+    ///
+    /// Symbolic links to directories are followed, wherever they lead.  If
+    /// one leads back to a directory being walked, boost::filesystem::
+    /// filesystem_error is thrown (with errc::too_many_symbolic_link_levels),
+    /// as it is if any directory cannot be read.
+    ///
+    void walk_directory_tree(const open_dir &root, const dir_visitor &visit);
+}
+
+#endif // DBMIG_DIR_SCAN_INCLUDED
@@ -162,6 +162,77 @@ namespace dbmig
         const std::string script_path_;
         const std::string msg_;
     };
+    
+    ///
+    /// This type of class is thrown when a file cannot be read as a bundle,
+    /// either because it is not one at all, or because it is truncated or
+    /// otherwise malformed.
+    ///
+    class bad_bundle : public std::exception
+    {
+    public:
+        bad_bundle(const std::string &path, const std::string &reason) :
+            path_(path),
+            reason_(reason),
+            msg_("File " + path_ + " is not a valid bundle: " + reason_) {}
+        const std::string &path() const noexcept { return path_; }
+        const std::string &reason() const noexcept { return reason_; }
+        virtual const char *what() const noexcept { return msg_.c_str(); }
+    private:
+        const std::string path_;
+        const std::string reason_;
+        const std::string msg_;
+    };
+    
+    ///
+    /// This type of class is thrown when a script that cannot run inside a
+    /// transaction block shared with other scripts is to be run in a batch
+    /// that must never be committed part of the way through.
+    ///
+    class script_not_joinable : public std::exception
+    {
+    public:
+        script_not_joinable(const std::string &script_path) :
+            script_path_(script_path),
+            msg_("Script " + script_path_ + " has a statement that cannot "
+                 "run inside a transaction block, so cannot be run in a "
+                 "single transaction with other scripts") {}
+        const std::string &script_path() const noexcept { return script_path_; }
+        virtual const char *what() const noexcept { return msg_.c_str(); }
+    private:
+        const std::string script_path_;
+        const std::string msg_;
+    };
+    
+    ///
+    /// This type of class is thrown when a script changes on disk while it
+    /// is being run, so that the statements run are not those whose digest
+    /// was checked or is about to be recorded.
+    ///
+    class script_hash_mismatch : public std::exception
+    {
+    public:
+        script_hash_mismatch(const std::string &script_path,
+                             const std::string &expected_sum,
+                             const std::string &actual_sum) :
+            script_path_(script_path),
+            expected_sum_(expected_sum),
+            actual_sum_(actual_sum),
+            msg_("Script " + script_path_ + " changed while being run, " +
+                 "hash when read = " + expected_sum_ +
+                 ", hash of statements run = " + actual_sum_) {}
+        const std::string &script_path() const noexcept { return script_path_; }
+        const std::string &expected_sum() const noexcept {
+            return expected_sum_;
+        }
+        const std::string &actual_sum() const noexcept { return actual_sum_; }
+        virtual const char *what() const noexcept { return msg_.c_str(); }
+    private:
+        const std::string script_path_;
+        const std::string expected_sum_;
+        const std::string actual_sum_;
+        const std::string msg_;
+    };
 }
 
 #endif // DBMIG_EXCEPTION_INCLUDED
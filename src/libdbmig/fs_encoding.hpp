@@ -0,0 +1,49 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_FS_ENCODING_INCLUDED
+#define DBMIG_FS_ENCODING_INCLUDED
+
+#include <string>
+
+namespace dbmig
+{
+    ///
+    /// Take a UTF-8 path and return that path in an encoding suitable for the
+    /// native filesystem.
+    ///
+    template<typename ValueType>
+    std::basic_string<ValueType> utf8_to_fs(const std::string &path);
+    template<>
+    std::basic_string<char> utf8_to_fs(const std::string &path);
+    template<>
+    std::basic_string<wchar_t> utf8_to_fs(const std::string &path);
+
+    ///
+    /// Take a path in the encoding of the native filesystem and return that
+    /// path in UTF-8.
+    ///
+    template<typename ValueType>
+    std::string fs_to_utf8(const std::basic_string<ValueType> &path);
+    template<>
+    std::string fs_to_utf8(const std::basic_string<char> &path);
+    template<>
+    std::string fs_to_utf8(const std::basic_string<wchar_t> &path);
+}
+
+#endif // DBMIG_FS_ENCODING_INCLUDED
@@ -19,9 +19,12 @@
 #ifndef DBMIG_GETLINE_INCLUDED
 #define DBMIG_GETLINE_INCLUDED
 
+#include <cstddef>
 #include <string>
+#include <vector>
 #include <ios>
 #include <streambuf>
+#include "char_scan.hpp"
 
 namespace dbmig
 {
@@ -75,6 +78,93 @@ namespace dbmig
             }
         }
     }
+    
+    ///
+    /// Reads lines from a stream, coping with the same variety of line endings
+    /// as multiplatform_getline().
+    ///
+    /// Rather than examining the stream one character at a time, this reads
+    /// it in blocks and scans each block for line endings with find_first_of().
+    /// Nothing else should read from the stream while it is being used.
+    ///
+    template <typename InputStream>
+    class line_reader
+    {
+    public:
+        explicit line_reader(InputStream &is,
+                             const std::size_t block_size = 65536) :
+            is_(is),
+            buf_(block_size),
+            pos_(0),
+            end_(0),
+            eof_(false)
+        {}
+        
+        ///
+        /// Read the next line and its ending, returning false at the end of
+        /// the stream.
+        ///
+        bool getline(std::string &line, std::string &line_ending)
+        {
+            static const char_set newline_chars{'\n', '\r'};
+            
+            line.clear();
+            for (;;) {
+                if (pos_ == end_ && !fill()) {
+                    // Also handle the case when the last line has no ending.
+                    line_ending.clear();
+                    return !line.empty();
+                }
+                
+                const char *b = buf_.data() + pos_;
+                const char *e = buf_.data() + end_;
+                const char *p = find_first_of(b, e, newline_chars);
+                line.append(b, p);
+                pos_ = p - buf_.data();
+                if (p == e)
+                    continue;
+                
+                ++pos_;
+                if (*p == '\n') {
+                    line_ending = "\n";
+                    return true;
+                }
+                // A CR may be followed by an LF in the next block.
+                if (pos_ == end_)
+                    fill();
+                if (pos_ != end_ && buf_[pos_] == '\n') {
+                    ++pos_;
+                    line_ending = "\r\n";
+                }
+                else {
+                    line_ending = "\r";
+                }
+                return true;
+            }
+        }
+        
+    private:
+        
+        ///
+        /// Replace the (fully consumed) buffer with the next block.
+        ///
+        bool fill()
+        {
+            if (eof_)
+                return false;
+            is_.read(buf_.data(), buf_.size());
+            pos_ = 0;
+            end_ = static_cast<std::size_t>(is_.gcount());
+            if (!is_)
+                eof_ = true;
+            return end_ != 0;
+        }
+        
+        InputStream &is_;
+        std::vector<char> buf_;
+        std::size_t pos_, end_;
+        bool eof_;
+    };
 }
 
 #endif // DBMIG_GETLINE_INCLUDED
@@ -19,30 +19,56 @@
 #ifndef DBMIG_HASH_INCLUDED
 #define DBMIG_HASH_INCLUDED
 
+#include <cstddef>
+#include <cstring>
 #include <string>
 #include <cryptopp/sha.h>
 #include <cryptopp/hex.h>
+#include "sha256_backend.hpp"
 
 namespace dbmig {
 
 ///
-/// The hash class wraps a Crypto++ hash.
+/// The hash class wraps a hash backend: either a Crypto++ hash, or anything
+/// else with the same Update() and Final() interface.
 ///
-template <typename T>
+/// Small updates (such as one per line of a script) are gathered into larger
+/// blocks before being passed on to the backend, which some backends can
+/// process much more efficiently.
+///
+template <typename Backend>
 class hash
 {
 public:
     
+    hash() : buffered_(0) {}
+    
     void update(const std::string &str)
     {
-        cryptopp_hash_.Update(
-            reinterpret_cast<const byte *>(str.c_str()),
-            str.length());
+        update(str.data(), str.length());
+    }
+    
+    void update(const char *data, std::size_t length)
+    {
+        if (buffered_ + length <= buffer_size) {
+            std::memcpy(buffer_ + buffered_, data, length);
+            buffered_ += length;
+            return;
+        }
+        flush();
+        if (length < buffer_size) {
+            std::memcpy(buffer_, data, length);
+            buffered_ = length;
+        }
+        else {
+            backend_.Update(reinterpret_cast<const byte *>(data), length);
+        }
     }
     
     void finalise()
     {
-        cryptopp_hash_.Final(digest_);
+        flush();
+        backend_.Final(digest_);
     }
     
     void hex_encode(std::string &output) const
@@ -55,11 +81,21 @@ public:
     
 private:
 
-    T cryptopp_hash_;
-    byte digest_[T::DIGESTSIZE];
+    static const std::size_t buffer_size = 16384;
+    
+    void flush()
+    {
+        backend_.Update(reinterpret_cast<const byte *>(buffer_), buffered_);
+        buffered_ = 0;
+    }
+    
+    Backend backend_;
+    byte digest_[Backend::DIGESTSIZE];
+    char buffer_[buffer_size];
+    std::size_t buffered_;
 };
 
-typedef hash<CryptoPP::SHA256> sha256_hash;
+typedef hash<accelerated_sha256> sha256_hash;
 
 
 } // dbmig
@@ -0,0 +1,216 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hash_cache.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+
+#include "fs_encoding.hpp"
+
+using std::string;
+
+namespace dbmig {
+
+// First line of a cache file, identifying its format.
+static const string cache_header = "dbmig-hash-cache 1";
+
+// How recently a script must have been modified for it to be considered
+// unsafe to cache.  Generous enough for filesystems with coarse timestamps.
+static const std::int64_t racy_window_ns = 2000000000;
+
+struct cache_entry
+{
+    script_file_stat st;
+    string sha256_sum;
+};
+
+// Private impl class
+struct hash_cache::impl
+{
+    explicit impl(const string &path);
+    
+    void load();
+    
+    const string path_;
+    // Entries keyed by "action:path", where action is install or upgrade.
+    std::unordered_map<string, cache_entry> entries_;
+    bool dirty_;
+    // When the cache was loaded, in nanoseconds since the epoch.
+    std::int64_t load_time_ns_;
+    // Guards the entries, so that scripts may be hashed concurrently.
+    mutable std::mutex mutex_;
+};
+
+///
+/// Obtain the key for a given script.
+///
+static string make_key(const script_action action, const string &script_path)
+{
+    // Rollback statements are in the same file as upgrade statements.
+    auto file_action = action == script_action::rollback
+        ? script_action::upgrade
+        : action;
+    return to_string(file_action) + ":" + script_path;
+}
+
+hash_cache::hash_cache(const string &path)
+    : pimpl_(new impl(path))
+{}
+
+hash_cache::~hash_cache() = default;
+
+hash_cache::impl::impl(const string &path) :
+    path_(path),
+    dirty_(false)
+{
+    using namespace std::chrono;
+    load_time_ns_ = duration_cast<nanoseconds>(
+        system_clock::now().time_since_epoch()).count();
+    load();
+}
+
+///
+/// Read entries from the cache file, ignoring any that are malformed.
+///
+void hash_cache::impl::load()
+{
+    nowide::ifstream ifs{path_.c_str()};
+    string line;
+    if (!std::getline(ifs, line) || line != cache_header)
+        return;
+    
+    // Each line is: action, size, mtime, inode, digest, path; separated by
+    // tabs, with the path last so that it may contain anything but newlines.
+    while (std::getline(ifs, line)) {
+        std::istringstream iss{line};
+        string action, sha256_sum, script_path;
+        cache_entry entry;
+        if (!(std::getline(iss, action, '\t') &&
+              iss >> entry.st.size >> entry.st.mtime_ns >> entry.st.inode
+                  >> sha256_sum &&
+              iss.get() == '\t' &&
+              std::getline(iss, script_path)) ||
+            sha256_sum.size() != 64) {
+            continue;
+        }
+        try {
+            entry.sha256_sum = sha256_sum;
+            entries_[make_key(script_action_parse(action), script_path)] =
+                entry;
+        }
+        catch (const std::out_of_range &) {
+            // Unknown action; skip the entry.
+        }
+    }
+}
+
+///
+/// The path of the cache file.
+///
+const string &hash_cache::path() const
+{
+    auto &path_ = pimpl_->path_;
+    return path_;
+}
+
+///
+/// Look up the digest of a script, given its current identity.
+///
+bool hash_cache::lookup(const script_action action,
+                        const string &script_path,
+                        const script_file_stat &st,
+                        string &sha256_sum) const
+{
+    auto &entries_ = pimpl_->entries_;
+    auto key = make_key(action, script_path);
+    std::lock_guard<std::mutex> lock{pimpl_->mutex_};
+    auto i = entries_.find(key);
+    if (i == entries_.end() || i->second.st != st)
+        return false;
+    sha256_sum = i->second.sha256_sum;
+    return true;
+}
+
+///
+/// Record the digest of a script, given its identity when hashed.
+///
+void hash_cache::store(const script_action action,
+                       const string &script_path,
+                       const script_file_stat &st,
+                       const string &sha256_sum)
+{
+    if (st.mtime_ns >= pimpl_->load_time_ns_ - racy_window_ns)
+        return;
+    if (script_path.find_first_of("\r\n") != string::npos)
+        return;
+    auto key = make_key(action, script_path);
+    std::lock_guard<std::mutex> lock{pimpl_->mutex_};
+    pimpl_->entries_[key] = {st, sha256_sum};
+    pimpl_->dirty_ = true;
+}
+
+///
+/// Write the cache back to disk, if anything has been stored.
+///
+bool hash_cache::save()
+{
+    namespace fs = boost::filesystem;
+    
+    std::lock_guard<std::mutex> lock{pimpl_->mutex_};
+    if (!pimpl_->dirty_)
+        return true;
+    
+    // Write to a temporary file in the same directory, so that it can then be
+    // renamed over the top of the cache atomically.
+    fs::path p{utf8_to_fs<fs::path::value_type>(pimpl_->path_)};
+    fs::path tmp = p;
+    tmp += fs::unique_path(".tmp-%%%%-%%%%-%%%%");
+    try {
+        {
+            nowide::ofstream ofs{fs_to_utf8(tmp.native()).c_str()};
+            ofs << cache_header << '\n';
+            for (auto &kv : pimpl_->entries_) {
+                auto colon = kv.first.find(':');
+                auto &entry = kv.second;
+                ofs << kv.first.substr(0, colon) << '\t'
+                    << entry.st.size << ' ' << entry.st.mtime_ns << ' '
+                    << entry.st.inode << ' ' << entry.sha256_sum << '\t'
+                    << kv.first.substr(colon + 1) << '\n';
+            }
+            ofs.close();
+            if (!ofs)
+                throw std::runtime_error{"Cannot write hash cache"};
+        }
+        fs::rename(tmp, p);
+    }
+    catch (const std::exception &) {
+        boost::system::error_code ec;
+        fs::remove(tmp, ec);
+        return false;
+    }
+    
+    pimpl_->dirty_ = false;
+    return true;
+}
+
+} // dbmig namespace
@@ -0,0 +1,103 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_HASH_CACHE_INCLUDED
+#define DBMIG_HASH_CACHE_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "dir_scan.hpp"
+#include "script_action.hpp"
+
+namespace dbmig
+{
+    ///
+    /// Persistent cache of script hashes, stored in a single file
+    ///
+    /// Each entry maps a script (by action and path relative to its script
+    /// directory) to its SHA256 digest, along with the size, modification time
+    /// and inode of the file when it was hashed.  An entry is only used while
+    /// all three still match the file on disk, so a changed script invalidates
+    /// its own entry and no other.  Since rollback statements live in the same
+    /// file as upgrade statements, rollback lookups share the upgrade entry.
+    ///
+    /// The cache file is only ever replaced as a whole, by writing a temporary
+    /// file alongside it and renaming that over the top, so that concurrent
+    /// readers always see either the old or new cache in full.  A cache file
+    /// that is missing or unreadable is simply treated as empty.
+    ///
+    /// Lookups and stores may be made concurrently from multiple threads.
+    ///
+    class hash_cache
+    {
+    public:
+        ///
+        /// Load the cache from the given (UTF-8) path, if it exists.
+        ///
+        explicit hash_cache(const std::string &path);
+        ~hash_cache();
+        
+        ///
+        /// The path of the cache file.
+        ///
+        const std::string &path() const;
+        
+        ///
+        /// Look up the digest of a script, given its current identity.
+        ///
+        /// Returns false if there is no entry for the script, or the entry is
+        /// out of date.
+        ///
+        bool lookup(const script_action action,
+                    const std::string &script_path,
+                    const script_file_stat &st,
+                    std::string &sha256_sum) const;
+        
+        ///
+        /// Record the digest of a script, given its identity when hashed.
+        ///
+        /// Scripts modified very recently are not recorded, since they may
+        /// yet be modified again without their modification time changing.
+        ///
+        void store(const script_action action,
+                   const std::string &script_path,
+                   const script_file_stat &st,
+                   const std::string &sha256_sum);
+        
+        ///
+        /// Write the cache back to disk, if anything has been stored.
+        ///
+        /// Returns false if the cache could not be written; the cache is only
+        /// an optimisation, so this is not considered an error.
+        ///
+        bool save();
+        
+    private:
+        
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+    
+    ///
+    /// The name of the hash cache file within a repository.
+    ///
+    const std::string hash_cache_filename = ".dbmig-cache";
+}
+
+#endif // DBMIG_HASH_CACHE_INCLUDED
@@ -0,0 +1,260 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mapped_script.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "char_scan.hpp"
+#include "fs_encoding.hpp"
+#include "hash.hpp"
+#include "sql_lexer.hpp"
+#include "script_stream.hpp"
+
+namespace dbmig {
+
+// Private impl class
+struct mapped_script::impl
+{
+    explicit impl(const std::string &path);
+    
+    void partition();
+    list_type statements(const script_action action, line_list *lines);
+    void split(const char *b, const char *e, list_type &statements,
+               line_list *lines);
+    void add(const char *b, const char *e, list_type &statements,
+             line_list *lines);
+    std::size_t line_of(const char *p);
+    
+    boost::iostreams::mapped_file_source file_;
+    const char *data_;
+    std::size_t size_;
+    std::string sha256_sum_;
+    
+    // End of the upgrade partition, and start of the rollback partition.
+    const char *upgrade_end_;
+    const char *rollback_begin_;
+    
+    // Storage for statements that had their line endings rewritten, each
+    // sized to its statement.
+    std::vector<std::unique_ptr<char[]>> arenas_;
+    
+    // How far line_of() has counted, and the line number reached.
+    const char *line_pos_;
+    std::size_t line_no_;
+};
+
+static bool is_newline(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+static bool is_space(char c)
+{
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+
+mapped_script::mapped_script(const std::string &path)
+    : pimpl_(new impl(path))
+{}
+
+mapped_script::~mapped_script() = default;
+
+mapped_script::impl::impl(const std::string &path) :
+    data_(""), size_(0), upgrade_end_(nullptr), rollback_begin_(nullptr),
+    line_pos_(nullptr), line_no_(0)
+{
+    namespace fs = boost::filesystem;
+    
+    // Empty files cannot be mapped, so check the size first.  This also
+    // throws a filesystem_error if the script does not exist.
+    fs::path p(utf8_to_fs<fs::path::value_type>(path));
+    if (fs::file_size(p) > 0) {
+        file_.open(p);
+        data_ = file_.data();
+        size_ = file_.size();
+    }
+    
+    // The digest covers every byte, including the original line endings.
+    sha256_hash sum;
+    sum.update(data_, size_);
+    sum.finalise();
+    sum.hex_encode(sha256_sum_);
+    
+    partition();
+}
+
+///
+/// Locate the line containing the magic text, if any.
+///
+void mapped_script::impl::partition()
+{
+    const char *b = data_;
+    const char *e = b + size_;
+    auto &marker = script_partition_marker;
+    const char *m = find_string(b, e, marker.data(),
+                                marker.data() + marker.size());
+    if (m == e) {
+        // Without the magic text, the whole script is the upgrade.
+        upgrade_end_ = rollback_begin_ = e;
+        return;
+    }
+    
+    const char *line_b = m;
+    while (line_b != b && !is_newline(line_b[-1]))
+        --line_b;
+    const char *line_e = std::find_if(m, e, is_newline);
+    if (line_e != e) {
+        if (*line_e == '\r' && line_e + 1 != e && line_e[1] == '\n')
+            ++line_e;
+        ++line_e;
+    }
+    upgrade_end_ = line_b;
+    rollback_begin_ = line_e;
+}
+
+///
+/// Split out the statements relevant to a given action.
+///
+mapped_script::list_type mapped_script::statements(const script_action action)
+{
+    return pimpl_->statements(action, nullptr);
+}
+
+///
+/// Split out the statements relevant to a given action, along with the
+/// range of lines of the script that each came from.
+///
+mapped_script::list_type mapped_script::statements(const script_action action,
+                                                   line_list &lines)
+{
+    lines.clear();
+    return pimpl_->statements(action, &lines);
+}
+
+///
+/// The SHA256 digest of the whole script.
+///
+const std::string &mapped_script::sha256_sum() const
+{
+    auto &sha256_sum_ = pimpl_->sha256_sum_;
+    return sha256_sum_;
+}
+
+///
+/// Split out the statements relevant to a given action, and their lines too
+/// if wanted.
+///
+mapped_script::list_type mapped_script::impl::statements(
+    const script_action action, line_list *lines)
+{
+    const char *b = data_;
+    const char *e = b + size_;
+    
+    if (action == script_action::upgrade)
+        e = upgrade_end_;
+    else if (action == script_action::rollback)
+        b = rollback_begin_;
+    
+    list_type statements;
+    split(b, e, statements, lines);
+    return statements;
+}
+
+///
+/// Split a region of the mapping into statements.
+///
+void mapped_script::impl::split(const char *b, const char *e,
+                                list_type &statements, line_list *lines)
+{
+    std::size_t size = e - b, consumed = 0, delim_begin, delim_end;
+    sql_lexer lexer;
+    line_pos_ = data_;
+    line_no_ = 1;
+    while (lexer.next_delimiter(b, size, true, delim_begin, delim_end)) {
+        add(b + consumed, b + delim_begin, statements, lines);
+        consumed = delim_end;
+    }
+    add(b + consumed, e, statements, lines);
+}
+
+///
+/// The line of the mapping that a position is on, counting LF, CRLF and CR
+/// as line endings.  Positions must be asked for in order, from the start
+/// of each split().
+///
+std::size_t mapped_script::impl::line_of(const char *p)
+{
+    const char *end = data_ + size_;
+    for (; line_pos_ != p; ++line_pos_) {
+        if (*line_pos_ == '\n' ||
+            (*line_pos_ == '\r' && (line_pos_ + 1 == end ||
+                                    line_pos_[1] != '\n')))
+            ++line_no_;
+    }
+    return line_no_;
+}
+
+///
+/// Trim a statement and add it to the list, rewriting it if need be.
+///
+void mapped_script::impl::add(const char *b, const char *e,
+                              list_type &statements, line_list *lines)
+{
+    while (b != e && is_space(*b))
+        ++b;
+    while (e != b && is_space(e[-1]))
+        --e;
+    if (b == e)
+        return;
+    
+    if (lines) {
+        auto first = line_of(b);
+        lines->emplace_back(first, line_of(e - 1));
+    }
+    
+    if (std::memchr(b, '\r', e - b) == nullptr) {
+        // Nothing to rewrite, so refer directly to the mapping.
+        statements.emplace_back(b, e - b);
+        return;
+    }
+    
+    // Rewrite CR and CRLF endings as LF, which can only shorten the
+    // statement, into an arena of the statement's own size.
+    arenas_.emplace_back(new char[e - b]);
+    char *out_b = arenas_.back().get();
+    char *out = out_b;
+    for (; b != e; ++b) {
+        if (*b == '\r') {
+            *out++ = '\n';
+            if (b + 1 != e && b[1] == '\n')
+                ++b;
+        }
+        else {
+            *out++ = *b;
+        }
+    }
+    statements.emplace_back(out_b, out - out_b);
+}
+
+} // dbmig namespace
@@ -0,0 +1,85 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_MAPPED_SCRIPT_INCLUDED
+#define DBMIG_MAPPED_SCRIPT_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "script_action.hpp"
+
+namespace dbmig
+{
+    ///
+    /// A script file that is memory-mapped rather than read through a stream
+    ///
+    /// The digest is calculated directly over the mapped bytes, and statements
+    /// are split out of the mapping in place.  Each statement is a view into
+    /// the mapping, unless it contains CR or CRLF line endings, in which case
+    /// it is rewritten with LF endings into storage owned by this object,
+    /// sized to the statement.  Either way, the views remain valid for the
+    /// lifetime of the object.
+    ///
+    /// The script is partitioned (see script_partitions) when it is mapped,
+    /// so that asking for both upgrade and rollback statements does not
+    /// search it twice.  The statements and digest are identical to those
+    /// produced by read_script() in script_stream.hpp.
+    ///
+    class mapped_script
+    {
+    public:
+        typedef boost::string_ref statement_type;
+        typedef std::vector<statement_type> list_type;
+        // First and last source lines (counting from one) of a statement.
+        typedef std::pair<std::size_t, std::size_t> line_range;
+        typedef std::vector<line_range> line_list;
+        
+        ///
+        /// Map the script at the given (UTF-8) path.
+        ///
+        explicit mapped_script(const std::string &path);
+        ~mapped_script();
+        
+        ///
+        /// Split out the statements relevant to a given action.
+        ///
+        list_type statements(const script_action action);
+        
+        ///
+        /// Split out the statements relevant to a given action, along with
+        /// the range of lines of the script that each came from.
+        ///
+        list_type statements(const script_action action, line_list &lines);
+        
+        ///
+        /// The SHA256 digest of the whole script.
+        ///
+        const std::string &sha256_sum() const;
+        
+    private:
+    
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+}
+
+#endif // DBMIG_MAPPED_SCRIPT_INCLUDED
@@ -18,19 +18,559 @@
 
 #include "migrate.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <boost/filesystem.hpp>
 #include <nowide/fstream.hpp>
 #include <soci/soci.h>
 #include "script_stream.hpp"
+#include "mapped_script.hpp"
+#include "bundle.hpp"
+#include "script_prefetch.hpp"
 #include "script_action.hpp"
 #include "changelog_table.hpp"
-#include "time.hpp"
+#include "db_specific.hpp"
 #include "exception.hpp"
 
 using std::string;
 using nowide::ifstream;
+using std::chrono::steady_clock;
+using std::chrono::system_clock;
 
 namespace dbmig {
 
+// Private impl class
+struct transaction_batch::impl
+{
+    impl(soci::session &session, std::size_t batch_size) :
+        session_(session), batch_size_(batch_size), scripts_(0)
+    {}
+    
+    soci::session &session_;
+    const std::size_t batch_size_;
+    // Open while any scripts are yet to be committed.
+    std::unique_ptr<soci::transaction> txn_;
+    std::size_t scripts_;
+    
+    void begin()
+    {
+        if (!txn_) {
+            txn_.reset(new soci::transaction{session_});
+            scripts_ = 0;
+        }
+    }
+    
+    void script_done()
+    {
+        if (++scripts_ == batch_size_)
+            commit();
+    }
+    
+    void commit()
+    {
+        if (txn_) {
+            txn_->commit();
+            txn_.reset();
+        }
+    }
+    
+    void rollback()
+    {
+        if (txn_) {
+            txn_->rollback();
+            txn_.reset();
+        }
+    }
+};
+
+transaction_batch::transaction_batch(soci::session &session,
+                                     std::size_t batch_size)
+    : pimpl_(new impl(session, batch_size))
+{}
+
+transaction_batch::~transaction_batch()
+{
+    try {
+        pimpl_->rollback();
+    }
+    catch (...) {
+        // Nothing more can be done; the connection is probably lost, and
+        // the transaction with it.
+    }
+}
+
+///
+/// The session that the batch's scripts run within
+///
+soci::session &transaction_batch::session() const
+{
+    return pimpl_->session_;
+}
+
+///
+/// Commit every script run since the batch was last committed
+///
+void transaction_batch::commit()
+{
+    pimpl_->commit();
+}
+
+///
+/// The first few words of a statement, in upper case and separated by
+/// single spaces, ignoring any comments before or between them
+///
+/// A name counts as one word even if qualified by others, or quoted.
+/// Since a quoted name can never be a keyword, only its quotes are kept.
+///
+template<typename Statement>
+static string leading_keywords(const Statement &statement)
+{
+    static const int max_keywords = 6;
+    string keywords;
+    int count = 0;
+    auto i = statement.begin(), e = statement.end();
+    while (i != e && count < max_keywords) {
+        char c = *i;
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        }
+        else if (c == '-' && i + 1 != e && i[1] == '-') {
+            while (i != e && *i != '\n')
+                ++i;
+        }
+        else if (c == '/' && i + 1 != e && i[1] == '*') {
+            // Block comments nest, as they do in the lexer.
+            int depth = 0;
+            do {
+                if (*i == '/' && i + 1 != e && i[1] == '*') {
+                    ++depth;
+                    ++i;
+                }
+                else if (*i == '*' && i + 1 != e && i[1] == '/') {
+                    --depth;
+                    ++i;
+                }
+                ++i;
+            } while (i != e && depth > 0);
+        }
+        else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_' ||
+                 c == '"') {
+            if (count++ > 0)
+                keywords += ' ';
+            while (i != e) {
+                auto d = static_cast<unsigned char>(*i);
+                if (d == '"') {
+                    i = std::find(i + 1, e, '"');
+                    if (i != e)
+                        ++i;
+                    keywords += "\"\"";
+                }
+                else if (std::isalnum(d) || d == '_' || d == '$' ||
+                         d == '.') {
+                    keywords += std::toupper(d);
+                    ++i;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+        else {
+            break;
+        }
+    }
+    return keywords;
+}
+
+///
+/// Do the leading keywords of a statement match the given pattern, word
+/// for word?  A "*" in the pattern matches any one word.  The keywords may
+/// carry on beyond the end of the pattern only if it is a prefix.
+///
+static bool keywords_match(const string &keywords, const string &pattern,
+                           const bool prefix)
+{
+    std::size_t k = 0, p = 0;
+    while (p < pattern.size()) {
+        if (k >= keywords.size())
+            return false;
+        auto k_end = std::min(keywords.find(' ', k), keywords.size());
+        auto p_end = std::min(pattern.find(' ', p), pattern.size());
+        bool any = p_end - p == 1 && pattern[p] == '*';
+        if (!any && keywords.compare(k, k_end - k,
+                                     pattern, p, p_end - p) != 0)
+            return false;
+        k = k_end + 1;
+        p = p_end + 1;
+    }
+    return prefix || k >= keywords.size();
+}
+
+///
+/// May each of the statements run inside a transaction block shared with
+/// other scripts?
+///
+template<typename Statements>
+static bool joinable(soci::session &s, Statements &statements)
+{
+    auto &db = get_db_specific(s.get_backend_name());
+    for (auto &statement : statements) {
+        auto keywords = leading_keywords(statement);
+        for (auto &prefix : db.non_transactional_prefixes) {
+            if (keywords_match(keywords, prefix, true))
+                return false;
+        }
+        for (auto &whole : db.non_transactional_statements) {
+            if (keywords_match(keywords, whole, false))
+                return false;
+        }
+    }
+    return true;
+}
+
+///
+/// The transaction that a single script runs in: either one of its own, or
+/// that of a batch, or (for a script that cannot run inside a transaction
+/// block) none at all until its changelog entry is written
+///
+/// If the script fails (that is, if this is destroyed without commit()
+/// having been called), its own transaction is rolled back, or else the
+/// whole of the batch so far.  A script run outside any transaction block
+/// cannot be rolled back, and is simply not recorded in the changelog.
+///
+class script_transaction
+{
+public:
+    explicit script_transaction(soci::session &session) :
+        session_(session), own_txn_{new soci::transaction{session}},
+        batch_(nullptr), done_(false)
+    {}
+    
+    ///
+    /// Join the batch if the script can, or else commit the batch so far,
+    /// and leave the script to run outside any transaction block
+    ///
+    /// A batch of size zero must never be committed part of the way
+    /// through, so throws script_not_joinable instead.
+    ///
+    script_transaction(transaction_batch &batch, const bool joinable,
+                       const string &script_path) :
+        session_(batch.session()), batch_(nullptr), done_(false)
+    {
+        auto &b = *batch.pimpl_;
+        if (joinable) {
+            b.begin();
+            batch_ = &b;
+        }
+        else if (b.batch_size_ == 0) {
+            throw script_not_joinable{script_path};
+        }
+        else {
+            b.commit();
+        }
+    }
+    
+    ~script_transaction()
+    {
+        if (batch_ && !done_) {
+            try {
+                batch_->rollback();
+            }
+            catch (...) {
+                // As for transaction_batch.
+            }
+        }
+    }
+    
+    ///
+    /// Called once the script's statements have run, before its changelog
+    /// entry is written: a script run outside any transaction block writes
+    /// the entry in a short transaction of its own.
+    ///
+    void begin_changelog()
+    {
+        if (!batch_ && !own_txn_)
+            own_txn_.reset(new soci::transaction{session_});
+    }
+    
+    void commit()
+    {
+        if (own_txn_)
+            own_txn_->commit();
+        else if (batch_)
+            batch_->script_done();
+        done_ = true;
+    }
+    
+private:
+    soci::session &session_;
+    std::unique_ptr<soci::transaction> own_txn_;
+    transaction_batch::impl *batch_;
+    bool done_;
+};
+
+///
+/// A script too big to have been prepared, read a statement at a time
+///
+/// The script is opened once and read twice: first to learn whether it can
+/// join a batch and what its digest is (which, for a rollback, must be
+/// checked before anything is run), and then, rewound, as its statements
+/// are run.  Since the file could change in between, the digest of what was
+/// run must be checked against the first with check_digest() before the
+/// script is recorded as run.
+///
+class streamed_script
+{
+public:
+    streamed_script(soci::session &s, const prepared_script &script) :
+        ifs_{script.file_path().c_str()}
+    {
+        check_open(ifs_, script.file_path());
+        {
+            script_statement_stream<ifstream> first_pass{ifs_,
+                                                         script.action()};
+            can_join_ = joinable(s, first_pass);
+            sha256_sum_ = first_pass.sha256_sum();
+        }
+        ifs_.clear();
+        ifs_.seekg(0);
+        statements_.reset(
+            new script_statement_stream<ifstream>{ifs_, script.action()});
+    }
+    
+    bool can_join() const { return can_join_; }
+    const string &sha256_sum() const { return sha256_sum_; }
+    script_statement_stream<ifstream> &statements() { return *statements_; }
+    
+private:
+    static void check_open(const ifstream &ifs, const string &path)
+    {
+        namespace fs = boost::filesystem;
+        if (!ifs) {
+            throw fs::filesystem_error{"Cannot open script", path,
+                boost::system::errc::make_error_code(
+                    boost::system::errc::no_such_file_or_directory)};
+        }
+    }
+    
+    ifstream ifs_;
+    std::unique_ptr<script_statement_stream<ifstream>> statements_;
+    bool can_join_;
+    string sha256_sum_;
+};
+
+///
+/// Check that the statements just run are those whose digest is to be
+/// recorded
+///
+/// Statements held in memory were hashed as they were read, so only a
+/// streamed script (see streamed_script) has anything to check.
+///
+template<typename Statements>
+static void check_digest(const Statements &, const string &, const string &)
+{
+}
+
+template<typename InputStream>
+static void check_digest(script_statement_stream<InputStream> &statements,
+                         const string &sha256_sum, const string &script_path)
+{
+    if (statements.sha256_sum() != sha256_sum) {
+        throw script_hash_mismatch{script_path, sha256_sum,
+                                   statements.sha256_sum()};
+    }
+}
+
+///
+/// Check that a script can share the one transaction of a batch of size
+/// zero, before running anything
+///
+void check_joinable(soci::session &session, const prepared_script &script)
+{
+    bool ok = script.streamed()
+        ? streamed_script{session, script}.can_join()
+        : joinable(session, script.statements());
+    if (!ok)
+        throw script_not_joinable{script.path()};
+}
+
+///
+/// Seconds elapsed since the given time, to the precision of the clock
+///
+static double seconds_since(const steady_clock::time_point &start)
+{
+    return std::chrono::duration<double>(steady_clock::now() - start).count();
+}
+
+///
+/// Run each of a range of statements in turn
+///
+/// If timings are wanted, each statement is timed as it runs, and labelled
+/// with its source lines if they are known.
+///
+template<typename Statements>
+static void run_statements(soci::session &s, Statements &statements,
+                           statement_timing_list *timings = nullptr,
+                           const prepared_script::line_list *lines = nullptr)
+{
+    if (!timings) {
+        for (auto &statement : statements) {
+            s << statement;
+        }
+        return;
+    }
+    
+    timings->clear();
+    std::size_t ordinal = 0;
+    for (auto &statement : statements) {
+        statement_timing timing{};
+        timing.ordinal = ++ordinal;
+        if (lines && ordinal <= lines->size()) {
+            timing.first_line = (*lines)[ordinal - 1].first;
+            timing.last_line = (*lines)[ordinal - 1].second;
+        }
+        
+        auto start_time = steady_clock::now();
+        try {
+            s << statement;
+        }
+        catch (...) {
+            // Record how long the failed statement took, too.
+            timing.seconds = seconds_since(start_time);
+            timings->push_back(timing);
+            throw;
+        }
+        timing.seconds = seconds_since(start_time);
+        timings->push_back(timing);
+    }
+}
+
+///
+/// Run the statements of an install script, and record it in the
+/// changelog, within the given transaction
+///
+template<typename Statements>
+static semver apply_install_script(
+        soci::session &s,
+        script_transaction &txn,
+        const string &changeset,
+        const semver &script_version,
+        const string &script_path,
+        Statements &&statements,
+        const string &sha256_sum,
+        statement_timing_list *timings = nullptr,
+        const prepared_script::line_list *lines = nullptr)
+{
+    auto start_time = steady_clock::now();
+    run_statements(s, statements, timings, lines);
+    check_digest(statements, sha256_sum, script_path);
+    
+    // Update the changelog.
+    txn.begin_changelog();
+    auto seconds = seconds_since(start_time);
+    auto end_time = system_clock::now();
+    changelog_table cl{s, changeset};
+    cl.write(end_time,
+            script_path,
+            script_version,
+            sha256_sum,
+            seconds);
+    
+    // Commit transaction
+    txn.commit();
+    return script_version;
+}
+
+///
+/// Run the statements of an upgrade script, and record it in the
+/// changelog, within the given transaction
+///
+template<typename Statements>
+static semver apply_upgrade_script(
+        soci::session &s,
+        script_transaction &txn,
+        const string &changeset,
+        const semver &script_version,
+        const string &script_path,
+        Statements &&statements,
+        const string &sha256_sum,
+        statement_timing_list *timings = nullptr,
+        const prepared_script::line_list *lines = nullptr)
+{
+    // Get the existing version from the changelog.
+    changelog_table cl{s, changeset};
+    auto existing_ver = cl.version();
+    
+    auto start_time = steady_clock::now();
+    run_statements(s, statements, timings, lines);
+    check_digest(statements, sha256_sum, script_path);
+    
+    // Update the changelog.
+    txn.begin_changelog();
+    auto seconds = seconds_since(start_time);
+    auto end_time = system_clock::now();
+    cl.write(end_time,
+            script_path,
+            script_action::upgrade,
+            existing_ver,
+            script_version,
+            sha256_sum,
+            seconds);
+    
+    // Commit transaction
+    txn.commit();
+    return script_version;
+}
+
+///
+/// Check the hash of a rollback script, run its statements, and record it
+/// in the changelog, within the given transaction
+///
+template<typename Statements>
+static semver apply_rollback_script(
+        soci::session &s,
+        script_transaction &txn,
+        const string &changeset,
+        const semver &rollback_to_version,
+        const string &script_path,
+        Statements &&statements,
+        const string &sha256_sum,
+        const string &alleged_sha256_sum,
+        statement_timing_list *timings = nullptr,
+        const prepared_script::line_list *lines = nullptr)
+{
+    // Get the existing version from the changelog.
+    changelog_table cl{s, changeset};
+    auto existing_ver = cl.version();
+    
+    // Note: blank hash passed in means skip the checksum check.
+    if (alleged_sha256_sum != "" && alleged_sha256_sum != sha256_sum) {
+        // Hashes don't match!
+        throw script_changed_since_deployment{
+            alleged_sha256_sum, sha256_sum, script_path};
+    }
+    
+    auto start_time = steady_clock::now();
+    run_statements(s, statements, timings, lines);
+    check_digest(statements, sha256_sum, script_path);
+    
+    // Update the changelog.
+    txn.begin_changelog();
+    auto seconds = seconds_since(start_time);
+    auto end_time = system_clock::now();
+    cl.write(end_time,
+            script_path,
+            script_action::rollback,
+            existing_ver,
+            rollback_to_version,
+            sha256_sum,
+            seconds);
+    
+    txn.commit();
+    return rollback_to_version;
+}
+
 ///
 /// Run a single install script against a target database
 ///
@@ -43,24 +583,23 @@ semver run_install_script(
         const string &changeset,
         const semver &script_version,
         const string &repo_install_path,
-        const string &script_path)
+        const string &script_path,
+        statement_timing_list *timings)
 {
-//    auto start_time = time::now();
-    soci::session s{conn_str};
     // Start transaction
+    soci::session s{conn_str};
     soci::transaction txn{s};
     
     // Run the script.
+    auto start_time = steady_clock::now();
     string full_path = repo_install_path + "/" + script_path;
     ifstream ifs{full_path.c_str()};
-    auto statements = read_install_statements(ifs);
-    for (auto statement : statements) {
-        s << statement;
-    }
+    script_statement_stream<ifstream> statements{ifs, script_action::install};
+    run_statements(s, statements, timings);
     
     // Update the changelog.
-    auto end_time = time::now();
-    double seconds = 0.0; // TODO
+    auto seconds = seconds_since(start_time);
+    auto end_time = system_clock::now();
     changelog_table cl{s, changeset};
     cl.write(end_time,
             script_path,
@@ -85,11 +624,11 @@ semver run_upgrade_script(
         const string &changeset,
         const semver &script_version,
         const string &repo_upgrade_path,
-        const string &script_path)
+        const string &script_path,
+        statement_timing_list *timings)
 {
-//    auto start_time = time::now();
-    soci::session s{conn_str};
     // Start transaction
+    soci::session s{conn_str};
     soci::transaction txn{s};
     
     // Get the existing version from the changelog.
@@ -97,16 +636,15 @@ semver run_upgrade_script(
     auto existing_ver = cl.version();
     
     // Run the script.
+    auto start_time = steady_clock::now();
     string full_path = repo_upgrade_path + "/" + script_path;
     ifstream ifs{full_path.c_str()};
-    auto statements = read_upgrade_statements(ifs);
-    for (auto statement : statements) {
-        s << statement;
-    }
+    script_statement_stream<ifstream> statements{ifs, script_action::upgrade};
+    run_statements(s, statements, timings);
     
     // Update the changelog.
-    auto end_time = time::now();
-    double seconds = 0.0; // TODO
+    auto seconds = seconds_since(start_time);
+    auto end_time = system_clock::now();
     cl.write(end_time,
             script_path,
             script_action::upgrade,
@@ -121,54 +659,27 @@ semver run_upgrade_script(
 }
 
 static semver internal_run_rollback_script(
-        const string &conn_str,
+        soci::session &s,
         const string &changeset,
         const semver &rollback_to_version,
         const string &repo_upgrade_path,
         const string &script_path,
-        const string &alleged_sha256_sum)
+        const string &alleged_sha256_sum,
+        statement_timing_list *timings)
 {
-//    auto start_time = time::now();
-    soci::session s{conn_str};
-    // Start transaction
-    soci::transaction txn{s};
-    
-    // Get the existing version from the changelog.
-    changelog_table cl{s, changeset};
-    auto existing_ver = cl.version();
-    
-    // Read statements (and hash) from the file.
+    // Map the file and hash it.  Unlike install and upgrade, the whole
+    // script is read up-front, since the hash must be checked before any
+    // statement is run.
     string full_path = repo_upgrade_path + "/" + script_path;
-    ifstream ifs{full_path.c_str()};
-    auto statements = read_rollback_statements(ifs);
+    mapped_script script{full_path};
+    mapped_script::line_list lines;
+    auto statements = script.statements(script_action::rollback, lines);
     
-    // Note: blank hash passed in means skip the checksum check.
-    if (alleged_sha256_sum != "" &&
-        alleged_sha256_sum != statements.sha256_sum()) {
-        // Hashes don't match!
-        throw script_changed_since_deployment{
-            alleged_sha256_sum, statements.sha256_sum(), script_path};
-    }
-    
-    // Run the script.
-    for (auto statement : statements) {
-        s << statement;
-    }
-    
-    // Update the changelog.
-    auto end_time = time::now();
-    double seconds = 0.0; // TODO
-    cl.write(end_time,
-            script_path,
-            script_action::rollback,
-            existing_ver,
-            rollback_to_version,
-            statements.sha256_sum(),
-            seconds);
-    
-    
-    txn.commit();
-    return rollback_to_version;
+    // Start transaction
+    script_transaction txn{s};
+    return apply_rollback_script(
+        s, txn, changeset, rollback_to_version, script_path, statements,
+        script.sha256_sum(), alleged_sha256_sum, timings, &lines);
 }
 
 ///
@@ -189,11 +700,13 @@ semver run_rollback_script(
         const string &changeset,
         const semver &rollback_to_version,
         const string &repo_upgrade_path,
-        const string &script_path)
+        const string &script_path,
+        statement_timing_list *timings)
 {
-    return internal_run_rollback_script(conn_str, changeset,
-                                        rollback_to_version, repo_upgrade_path,
-                                        script_path, "");
+    soci::session s{conn_str};
+    return internal_run_rollback_script(s, changeset, rollback_to_version,
+                                        repo_upgrade_path, script_path, "",
+                                        timings);
 }
 semver run_rollback_script(
         const string &conn_str,
@@ -201,13 +714,125 @@ semver run_rollback_script(
         const semver &rollback_to_version,
         const string &repo_upgrade_path,
         const string &script_path,
-        const string &alleged_sha256_sum)
+        const string &alleged_sha256_sum,
+        statement_timing_list *timings)
 {
-    return internal_run_rollback_script(conn_str, changeset,
-                                        rollback_to_version, repo_upgrade_path,
-                                        script_path, alleged_sha256_sum);
+    soci::session s{conn_str};
+    return internal_run_rollback_script(s, changeset, rollback_to_version,
+                                        repo_upgrade_path, script_path,
+                                        alleged_sha256_sum, timings);
 }
 
+///
+/// Run a single script of a repository within a transaction batch
+///
+/// Since whether the script may join the batch depends on its statements,
+/// a script read from a directory is prepared (that is, mapped and split)
+/// in full before anything is run, just as for a rollback, unless it is
+/// too big, in which case it is read through once first (see
+/// streamed_script).
+///
+semver run_install_script(
+        transaction_batch &batch,
+        const string &changeset,
+        const semver &script_version,
+        const repository &repo,
+        const string &script_path,
+        statement_timing_list *timings)
+{
+    return run_install_script(batch, changeset, script_version,
+        prepared_script{repo, script_action::install, script_path}, timings);
+}
+semver run_install_script(
+        transaction_batch &batch,
+        const string &changeset,
+        const semver &script_version,
+        const prepared_script &script,
+        statement_timing_list *timings)
+{
+    auto &s = batch.session();
+    if (script.streamed()) {
+        streamed_script streamed{s, script};
+        script_transaction txn{batch, streamed.can_join(), script.path()};
+        return apply_install_script(s, txn, changeset, script_version,
+                                    script.path(), streamed.statements(),
+                                    streamed.sha256_sum(), timings);
+    }
+    script_transaction txn{batch, joinable(s, script.statements()),
+                           script.path()};
+    return apply_install_script(s, txn, changeset, script_version,
+                                script.path(), script.statements(),
+                                script.sha256_sum(), timings, &script.lines());
+}
+semver run_upgrade_script(
+        transaction_batch &batch,
+        const string &changeset,
+        const semver &script_version,
+        const repository &repo,
+        const string &script_path,
+        statement_timing_list *timings)
+{
+    return run_upgrade_script(batch, changeset, script_version,
+        prepared_script{repo, script_action::upgrade, script_path}, timings);
+}
+semver run_upgrade_script(
+        transaction_batch &batch,
+        const string &changeset,
+        const semver &script_version,
+        const prepared_script &script,
+        statement_timing_list *timings)
+{
+    auto &s = batch.session();
+    if (script.streamed()) {
+        streamed_script streamed{s, script};
+        script_transaction txn{batch, streamed.can_join(), script.path()};
+        return apply_upgrade_script(s, txn, changeset, script_version,
+                                    script.path(), streamed.statements(),
+                                    streamed.sha256_sum(), timings);
+    }
+    script_transaction txn{batch, joinable(s, script.statements()),
+                           script.path()};
+    return apply_upgrade_script(s, txn, changeset, script_version,
+                                script.path(), script.statements(),
+                                script.sha256_sum(), timings, &script.lines());
+}
+semver run_rollback_script(
+        transaction_batch &batch,
+        const string &changeset,
+        const semver &rollback_to_version,
+        const repository &repo,
+        const string &script_path,
+        const string &alleged_sha256_sum,
+        statement_timing_list *timings)
+{
+    return run_rollback_script(batch, changeset, rollback_to_version,
+        prepared_script{repo, script_action::rollback, script_path},
+        alleged_sha256_sum, timings);
+}
+semver run_rollback_script(
+        transaction_batch &batch,
+        const string &changeset,
+        const semver &rollback_to_version,
+        const prepared_script &script,
+        const string &alleged_sha256_sum,
+        statement_timing_list *timings)
+{
+    auto &s = batch.session();
+    if (script.streamed()) {
+        streamed_script streamed{s, script};
+        script_transaction txn{batch, streamed.can_join(), script.path()};
+        return apply_rollback_script(s, txn, changeset, rollback_to_version,
+                                     script.path(), streamed.statements(),
+                                     streamed.sha256_sum(),
+                                     alleged_sha256_sum, timings);
+    }
+    script_transaction txn{batch, joinable(s, script.statements()),
+                           script.path()};
+    return apply_rollback_script(s, txn, changeset, rollback_to_version,
+                                 script.path(), script.statements(),
+                                 script.sha256_sum(), alleged_sha256_sum,
+                                 timings, &script.lines());
+}
 
 } // dbmig namespace
 
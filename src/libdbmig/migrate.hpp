@@ -19,65 +19,227 @@
 #ifndef DBMIG_MIGRATE_INCLUDED
 #define DBMIG_MIGRATE_INCLUDED
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 #include "semantic_version.hpp"
+#include "repository.hpp"
+
+namespace soci
+{
+    class session;
+}
 
 namespace dbmig
 {
+    class script_transaction;
+    class prepared_script;
+    
+    ///
+    /// Runs consecutive scripts within a session in shared transactions
+    ///
+    /// Scripts run with a batch join the transaction that the batch holds
+    /// open, along with their changelog entries.  Once batch_size scripts
+    /// have joined, the transaction is committed, and the next script
+    /// begins another.  A batch size of zero puts every script in the one
+    /// transaction, and a batch size of one commits each script on its own:
+    /// that is the default, and is how to run a single script within an
+    /// existing session.
+    ///
+    /// A script that fails rolls back every script run since the batch was
+    /// last committed, so the database is never left part of the way
+    /// through a batch.  Anything left uncommitted when the batch is
+    /// destroyed is rolled back too, so commit() must be called once the
+    /// last script has been run.
+    ///
+    /// A script with a statement that cannot run inside a transaction block
+    /// (see db_specific) never joins a batch.  Instead, the scripts run so
+    /// far are committed, and the script's statements run outside any
+    /// transaction block; only its changelog entry is then written in a
+    /// short transaction of its own.  Should such a script fail part of the
+    /// way through, whatever it has run stays run, and it is not recorded
+    /// in the changelog.  A batch of size zero must never be committed part
+    /// of the way through, so instead throws script_not_joinable, before
+    /// running any of the script (see also check_joinable()).
+    ///
+    class transaction_batch
+    {
+    public:
+        explicit transaction_batch(soci::session &session,
+                                   std::size_t batch_size = 1);
+        ~transaction_batch();
+        
+        ///
+        /// The session that the batch's scripts run within
+        ///
+        soci::session &session() const;
+        
+        ///
+        /// Commit every script run since the batch was last committed
+        ///
+        void commit();
+    
+    private:
+    
+        friend class script_transaction;
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+    
+    ///
+    /// How long one statement of a script took to run
+    ///
+    struct statement_timing
+    {
+        /// Position of the statement in the script, counting from one
+        std::size_t ordinal;
+        /// First and last lines of the script that the statement came from,
+        /// or zero if not known (as for scripts from a bundle, or any that
+        /// are streamed rather than prepared)
+        std::size_t first_line;
+        std::size_t last_line;
+        double seconds;
+    };
+    typedef std::vector<statement_timing> statement_timing_list;
+    
+    ///
+    /// Check that a script can run inside a transaction block shared with
+    /// other scripts, as every script in a batch of size zero must
+    ///
+    /// Throws script_not_joinable if it cannot.  Checking each script of a
+    /// migration beforehand saves running any of them in vain.
+    ///
+    void check_joinable(soci::session &session, const prepared_script &script);
+    
+    // Each of the functions below runs a script within a transaction_batch,
+    // and so within the batch's session, which may have been borrowed from
+    // a soci::connection_pool; a run of many scripts thus pays for
+    // connecting only once.  A batch of one runs the script in a
+    // transaction of its own, so its session must not be within a
+    // transaction already.  The script is named by its path within a
+    // repository, or else given already prepared (for instance, by a
+    // script_prefetcher).  Each of its statements is timed, and if a
+    // statement_timing_list is passed, it is filled with the timings of the
+    // statements that ran, in order, even if one of them failed.
+    //
+    // The forms taking a connection string and a script directory open a
+    // session of their own, for just the one script.  They stream install
+    // and upgrade scripts, so the timings of those carry no line numbers.
+    
     ///
     /// Run a single install script against a target database
     ///
     /// Returns the new resultant version of the target database.
-    /// The act of running the install script and modifying the changelog will
-    /// take place within a single transaction.
+    /// The install script runs in the same transaction as its changelog entry,
+    /// unless it has a statement that cannot run inside a transaction block,
+    /// in which case it runs outside any transaction block and only its
+    /// changelog entry is written in a transaction (see transaction_batch).
+    ///
+    /// A script named within a repository opened from a bundle runs the
+    /// pre-split statements from the bundle.
     ///
     semver run_install_script(
             const std::string &conn_str,
             const std::string &changeset,
             const semver &script_version,
             const std::string &repo_install_path,
-            const std::string &script_path);
+            const std::string &script_path,
+            statement_timing_list *timings = nullptr);
+    semver run_install_script(
+            transaction_batch &batch,
+            const std::string &changeset,
+            const semver &script_version,
+            const repository &repo,
+            const std::string &script_path,
+            statement_timing_list *timings = nullptr);
+    semver run_install_script(
+            transaction_batch &batch,
+            const std::string &changeset,
+            const semver &script_version,
+            const prepared_script &script,
+            statement_timing_list *timings = nullptr);
 
     ///
     /// Run a single upgrade script against a target database
     ///
     /// Returns the new resultant version of the target database.
-    /// The act of running the upgrade script and modifying the changelog will
-    /// take place within a single transaction.
+    /// The upgrade script runs in the same transaction as its changelog entry,
+    /// unless it has a statement that cannot run inside a transaction block,
+    /// in which case it runs outside any transaction block and only its
+    /// changelog entry is written in a transaction (see transaction_batch).
+    ///
+    /// A script named within a repository opened from a bundle runs the
+    /// pre-split statements from the bundle.
     ///
     semver run_upgrade_script(
             const std::string &conn_str,
             const std::string &changeset,
             const semver &script_version,
             const std::string &repo_upgrade_path,
-            const std::string &script_path);
+            const std::string &script_path,
+            statement_timing_list *timings = nullptr);
+    semver run_upgrade_script(
+            transaction_batch &batch,
+            const std::string &changeset,
+            const semver &script_version,
+            const repository &repo,
+            const std::string &script_path,
+            statement_timing_list *timings = nullptr);
+    semver run_upgrade_script(
+            transaction_batch &batch,
+            const std::string &changeset,
+            const semver &script_version,
+            const prepared_script &script,
+            statement_timing_list *timings = nullptr);
 
     ///
     /// Run a single rollback script against the target database
     ///
     /// Returns the new resultant version of the target database.
-    /// The act of running the rollback script and modifying the changelog will
-    /// take place within a single transaction.
+    /// The rollback script runs in the same transaction as its changelog entry,
+    /// unless it has a statement that cannot run inside a transaction block,
+    /// in which case it runs outside any transaction block and only its
+    /// changelog entry is written in a transaction (see transaction_batch).
     ///
     /// The overloaded versions of this function allow an alleged SHA256 hash
     /// of the script to be passed, intended to represent the hash when the
     /// script was first deployed to the database.  The idea is that it would be
     /// possibly dangerous to rollback a script that has actually changed since
-    /// it was first run into a target database.
+    /// it was first run into a target database.  When run from a bundle, the
+    /// hash checked is the one recorded in the bundle when it was packed.  An
+    /// empty alleged hash skips the check.
     ///
     semver run_rollback_script(
             const std::string &conn_str,
             const std::string &changeset,
             const semver &rollback_to_version,
             const std::string &repo_upgrade_path,
-            const std::string &script_path);
+            const std::string &script_path,
+            statement_timing_list *timings = nullptr);
     semver run_rollback_script(
             const std::string &conn_str,
             const std::string &changeset,
             const semver &rollback_to_version,
             const std::string &repo_upgrade_path,
             const std::string &script_path,
-            const std::string &alleged_sha256_sum);
+            const std::string &alleged_sha256_sum,
+            statement_timing_list *timings = nullptr);
+    semver run_rollback_script(
+            transaction_batch &batch,
+            const std::string &changeset,
+            const semver &rollback_to_version,
+            const repository &repo,
+            const std::string &script_path,
+            const std::string &alleged_sha256_sum,
+            statement_timing_list *timings = nullptr);
+    semver run_rollback_script(
+            transaction_batch &batch,
+            const std::string &changeset,
+            const semver &rollback_to_version,
+            const prepared_script &script,
+            const std::string &alleged_sha256_sum,
+            statement_timing_list *timings = nullptr);
 }
 
 #endif // DBMIG_MIGRATE_INCLUDED
@@ -19,26 +19,108 @@
 #include "repository.hpp"
 
 #include <algorithm>
-#include <numeric>
+#include <atomic>
+#include <mutex>
 #include <boost/filesystem.hpp>
-#include <nowide/fstream.hpp>
 #include <stdexcept>
 
 #include "script_dir.hpp"
-#include "script_stream.hpp"
+#include "bundle.hpp"
+#include "mapped_script.hpp"
+#include "hash_cache.hpp"
 #include "exception.hpp"
 
 using std::string;
-using nowide::ifstream;
 
 namespace dbmig {
 
+///
+/// Open a script directory of a repository in the given way.
+///
+static script_dir open_script_dir(const string &path,
+                                  const script_loading loading)
+{
+    switch (loading) {
+        case script_loading::full_scan:
+            break;
+        case script_loading::indexed:
+            return script_dir(path, ".sql", path + script_dir_index_suffix);
+        case script_loading::lazy:
+            return script_dir(path, ".sql", lazy_loading);
+    }
+    return script_dir(path);
+}
+
+///
+/// A script directory of a repository, opened on first use
+///
+/// Commands seldom need both the install and upgrade scripts, so neither is
+/// read from disk until something asks for it.  Opening is thread-safe: if
+/// several threads ask at once, one opens the directory while the others
+/// wait for it.  If opening fails, the error is thrown to whoever asked,
+/// and the next to ask tries again.
+///
+class deferred_script_dir
+{
+public:
+    
+    deferred_script_dir(const string &path, const script_loading loading,
+                        const bundle *bndl, const script_action action) :
+        path_(path), loading_(loading), bundle_(bndl), action_(action),
+        dir_(nullptr)
+    {}
+    
+    explicit deferred_script_dir(script_dir &&opened) :
+        path_(opened.path()), loading_(script_loading::full_scan),
+        bundle_(nullptr), action_(script_action::upgrade),
+        opened_(new script_dir(std::move(opened))), dir_(opened_.get())
+    {}
+    
+    ///
+    /// The path the script directory has, or will have once opened.
+    ///
+    const string &path() const { return path_; }
+    
+    ///
+    /// The script directory, opening it if need be.
+    ///
+    const script_dir &get() const
+    {
+        auto dir = dir_.load(std::memory_order_acquire);
+        if (dir)
+            return *dir;
+        
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!opened_) {
+            opened_.reset(new script_dir(bundle_
+                ? script_dir(path_, bundle_->scripts(action_))
+                : open_script_dir(path_, loading_)));
+            dir_.store(opened_.get(), std::memory_order_release);
+        }
+        return *opened_;
+    }
+    
+private:
+    
+    const string path_;
+    const script_loading loading_;
+    const bundle *const bundle_;
+    const script_action action_;
+    
+    mutable std::mutex mutex_;
+    mutable std::unique_ptr<const script_dir> opened_;
+    mutable std::atomic<const script_dir *> dir_;
+};
+
 struct repository::impl
 {
-    explicit impl(const string &path) :
-        latest_schema_path_(path + "/latest"),
-        upgrade_script_dir_(path + "/upgrade"),
-        install_script_dir_(path + "/install")
+    impl(const string &path, const script_loading loading) :
+        bundle_(is_bundle(path) ? new bundle(path) : nullptr),
+        latest_schema_path_(bundle_ ? "" : path + "/latest"),
+        upgrade_script_dir_(bundle_ ? path : path + "/upgrade", loading,
+                            bundle_.get(), script_action::upgrade),
+        install_script_dir_(bundle_ ? path : path + "/install", loading,
+                            bundle_.get(), script_action::install)
     {}
     impl(
         const string &latest_schema_path,
@@ -46,21 +128,39 @@ struct repository::impl
         const string &install_script_path)
         :
         latest_schema_path_(latest_schema_path),
-        upgrade_script_dir_(upgrade_script_path),
-        install_script_dir_(install_script_path)
+        upgrade_script_dir_(upgrade_script_path, script_loading::full_scan,
+                            nullptr, script_action::upgrade),
+        install_script_dir_(install_script_path, script_loading::full_scan,
+                            nullptr, script_action::install)
+    {}
+    impl(
+        const string &latest_schema_path,
+        script_dir &&upgrade_scripts,
+        script_dir &&install_scripts)
+        :
+        latest_schema_path_(latest_schema_path),
+        upgrade_script_dir_(std::move(upgrade_scripts)),
+        install_script_dir_(std::move(install_scripts))
     {}
 
+    // Only set if the repository is a bundle.
+    const std::unique_ptr<bundle> bundle_;
+    
     const string latest_schema_path_;
     
-    script_dir upgrade_script_dir_;
-    script_dir install_script_dir_;
+    deferred_script_dir upgrade_script_dir_;
+    deferred_script_dir install_script_dir_;
 };
 
 
 
 repository::repository(const string &path)
     // DRY, grrr
-    : pimpl_(new impl(path))
+    : pimpl_(new impl(path, script_loading::full_scan))
+{}
+repository::repository(const string &path, const script_loading loading)
+    // DRY, grrr
+    : pimpl_(new impl(path, loading))
 {}
 repository::repository(
     const string &latest_schema_path,
@@ -70,6 +170,14 @@ repository::repository(
     : pimpl_(new impl(
         latest_schema_path, upgrade_script_path, install_script_path))
 {}
+repository::repository(
+    const string &latest_schema_path,
+    script_dir &&upgrade_scripts,
+    script_dir &&install_scripts)
+    // DRY, grrr
+    : pimpl_(new impl(latest_schema_path, std::move(upgrade_scripts),
+                      std::move(install_scripts)))
+{}
 
 repository::~repository() = default;
 
@@ -82,14 +190,12 @@ const string &repository::latest_schema_path() const
 
 const string &repository::upgrade_script_path() const
 {
-    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_;
-    return upgrade_script_dir_.path();
+    return pimpl_->upgrade_script_dir_.path();
 }
 
 const string &repository::install_script_path() const
 {
-    auto &install_script_dir_ = pimpl_->install_script_dir_;
-    return install_script_dir_.path();
+    return pimpl_->install_script_dir_.path();
 }
 
 ///
@@ -101,20 +207,38 @@ const string &repository::install_script_path() const
 ///
 semver repository::latest_version() const
 {
-    auto &install_script_dir_ = pimpl_->install_script_dir_;
-    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_;
+    auto &install_script_dir_ = pimpl_->install_script_dir_.get();
+    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_.get();
 
-    auto ins_iter = install_script_dir_.crbegin();
-    auto upg_iter = upgrade_script_dir_.crbegin();
+    auto ins_latest = install_script_dir_.latest();
+    auto upg_latest = upgrade_script_dir_.latest();
     
-    auto ins_ver = ins_iter == install_script_dir_.crend()
-        ? semver::zero() : ins_iter->first;
-    auto upg_ver = upg_iter == upgrade_script_dir_.crend()
-        ? semver::zero() : upg_iter->first;
+    auto ins_ver = ins_latest.first == ins_latest.second
+        ? semver::zero() : ins_latest.first->first;
+    auto upg_ver = upg_latest.first == upg_latest.second
+        ? semver::zero() : upg_latest.first->first;
     
     return std::max(upg_ver, ins_ver);
 }
 
+///
+/// All scripts in the repository for a given action
+///
+const script_dir &repository::scripts(const script_action action) const
+{
+    return action == script_action::install
+        ? pimpl_->install_script_dir_.get()
+        : pimpl_->upgrade_script_dir_.get();
+}
+
+///
+/// The bundle that this repository was opened from, if any.
+///
+const bundle *repository::script_bundle() const
+{
+    return pimpl_->bundle_.get();
+}
+
 ///
 /// Return iterator range over the (single) nearest install script
 ///
@@ -124,18 +248,37 @@ semver repository::latest_version() const
 script_dir::const_iterator_range repository::nearest_install_script(
     const semver &target) const
 {
-    auto &install_script_dir_ = pimpl_->install_script_dir_;
+    auto &install_script_dir_ = pimpl_->install_script_dir_.get();
     
     // The nearest install script will be the last one that has a version less
     // than or equal to the requested target version.
-    auto e = install_script_dir_.last_less_equal(target);
-    auto b = e;
-    if (b != install_script_dir_.cbegin()) {
-        // last_less_equal() points beyond the element we want, so wind back.
-        --b;
-    }
+    return install_script_dir_.latest_not_after(target);
+}
+
+///
+/// Is the next version a valid upgrade step from the previous one?
+///
+/// Equivalent to comparing the next version strictly against the previous
+/// version after each of next_patch(), next_minor() and next_major() in turn,
+/// but without modifying (and hence copying) the previous version.
+///
+static bool is_contiguous_step(const semver &prev, const semver &next)
+{
+    // Is the next version within the same X.Y.Z version of the prev?
+    semver::strict_compare cmp;
+    if (cmp.compare_to(prev, next) == 0)
+        return true;
     
-    return std::make_pair(b, e);
+    // Any increment clears the pre-release part.
+    if (!next.pr_ids().empty())
+        return false;
+    
+    // Is the next version a patch, minor or major increment of the prev?
+    if (next.mj() == prev.mj() && next.mn() == prev.mn())
+        return next.pt() == prev.pt() + 1;
+    if (next.mj() == prev.mj())
+        return next.mn() == prev.mn() + 1 && next.pt() == 0;
+    return next.mj() == prev.mj() + 1 && next.mn() == 0 && next.pt() == 0;
 }
 
 ///
@@ -149,7 +292,7 @@ script_dir::const_iterator_range repository::nearest_install_script(
 script_dir::const_iterator_range repository::upgrade_scripts(
     const semver &start, const semver &target) const
 {
-    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_;
+    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_.get();
     
     // Check that each script is a valid step from the previous version.
     // i.e  from starting version X.Y.Z+script.N, the valid next steps are:
@@ -162,38 +305,14 @@ script_dir::const_iterator_range repository::upgrade_scripts(
     // amount, to cater for removed/retired scripts from in-dev versions.
     auto range = upgrade_script_dir_.range(start, target);
     
-    semver::strict_compare cmp;
-    semver last_version = std::accumulate(range.first, range.second, start,
-        [&](semver prev, script_dir::value_type script_entry)
-        {
-            auto &next = script_entry.first;
-            
-            // Is the next version within the same X.Y.Z version of the prev?
-            if (cmp.compare_to(prev, next) == 0) {
-                return next;
-            }
-                
-            // Is the next version a patch increment of the first?
-            prev.next_patch();
-            if (cmp.compare_to(prev, next) == 0) {
-                return next;
-            }
-            
-            // Is the next version a minor increment of the first?
-            prev.next_minor();
-            if (cmp.compare_to(prev, next) == 0) {
-                return next;
-            }
-            
-            // Is the next version a major increment of the first?
-            prev.next_major();
-            if (cmp.compare_to(prev, next) == 0) {
-                return next;
-            }
-            
-            // The next version is not contiguous with the first.
-            throw script_noncontiguous{prev, next, script_entry.second};
-        });
+    // Walk the chain by reference, so that no version is copied per step.
+    const semver *prev = &start;
+    for (auto it = range.first; it != range.second; ++it) {
+        auto &next = it->first;
+        if (!is_contiguous_step(*prev, next))
+            throw script_noncontiguous{*prev, next, it->second};
+        prev = &next;
+    }
     
     return range;
 }
@@ -204,51 +323,74 @@ script_dir::const_iterator_range repository::upgrade_scripts(
 script_dir::const_iterator_range
 repository::upgrade_script_at(const semver &ver) const
 {
-    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_;
+    auto &upgrade_script_dir_ = pimpl_->upgrade_script_dir_.get();
     
-    auto e = upgrade_script_dir_.last_less_equal(ver);
-    auto b = e;
-    if (b != upgrade_script_dir_.cbegin()) {
-        // last_less_equal() points beyond the element we want, so wind back.
-        --b;
-    }
+    auto range = upgrade_script_dir_.latest_not_after(ver);
     // Check we got the version we wanted.
-    if (b != upgrade_script_dir_.cend() && b->first != ver)
-        return std::make_pair(b, b);
+    if (range.first != range.second && range.first->first != ver)
+        return std::make_pair(range.first, range.first);
     
-    return std::make_pair(b, e);
+    return range;
 }
 
 ///
-/// Convenience method to obtain the SHA256 hash of a given script
+/// Obtain the full path to a script for a given action
 ///
-std::string
-calculate_script_hash(const repository &repo,
-                      const script_action &action,
-                      const std::string &script_path)
+static std::string full_script_path(const repository &repo,
+                                    const script_action &action,
+                                    const std::string &script_path)
 {
     switch (action) {
         case script_action::install:
-        {
-            string path = repo.install_script_path() + "/" + script_path;
-            ifstream ifs{path.c_str()};
-            return read_install_statements(ifs).sha256_sum();
-        }
+            return repo.install_script_path() + "/" + script_path;
         case script_action::upgrade:
-        {
-            string path = repo.upgrade_script_path() + "/" + script_path;
-            ifstream ifs{path.c_str()};
-            return read_upgrade_statements(ifs).sha256_sum();
-        }
         case script_action::rollback:
-        {
-            string path = repo.upgrade_script_path() + "/" + script_path;
-            ifstream ifs{path.c_str()};
-            return read_rollback_statements(ifs).sha256_sum();
-        }
+            return repo.upgrade_script_path() + "/" + script_path;
     }
     throw std::out_of_range{to_string(action)};
 }
 
+///
+/// Convenience method to obtain the SHA256 hash of a given script
+///
+std::string
+calculate_script_hash(const repository &repo,
+                      const script_action &action,
+                      const std::string &script_path)
+{
+    // Bundles already hold the hash of every script.
+    if (auto bundled = repo.script_bundle())
+        return bundled->sha256_sum(action, script_path);
+    
+    // Every action hashes the whole script, so there is no need to split
+    // out any statements; just hash the mapped file.
+    return mapped_script{
+        full_script_path(repo, action, script_path)}.sha256_sum();
+}
+
+///
+/// Calculate the SHA256 hash of a given script, consulting (and updating)
+/// a cache of previously-calculated hashes
+///
+std::string
+calculate_script_hash(const repository &repo,
+                      const script_action &action,
+                      const std::string &script_path,
+                      hash_cache &cache)
+{
+    // Nothing to cache for a bundle.
+    if (repo.script_bundle())
+        return calculate_script_hash(repo, action, script_path);
+    
+    auto full_path = full_script_path(repo, action, script_path);
+    auto st = stat_script_file(full_path);
+    std::string sum;
+    if (!cache.lookup(action, script_path, st, sum)) {
+        sum = mapped_script{full_path}.sha256_sum();
+        cache.store(action, script_path, st, sum);
+    }
+    return sum;
+}
+
 } // dbmig namespace
 
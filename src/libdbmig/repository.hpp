@@ -29,18 +29,82 @@
 
 namespace dbmig
 {
+    class hash_cache;
+    class bundle;
+    
+    ///
+    /// How the script directories of a repository are read from disk
+    ///
+    enum class script_loading
+    {
+        ///
+        /// Scan every script directory in full when the repository is opened
+        ///
+        full_scan,
+        
+        ///
+        /// As full_scan, but reuse whatever the index kept alongside each
+        /// script directory shows to be unchanged, and refresh the index
+        ///
+        indexed,
+        
+        ///
+        /// List only the root of each script directory when the repository
+        /// is opened, and each version sub-directory once a query first
+        /// touches its version
+        ///
+        lazy
+    };
+    
     ///
     /// Represents a repository of database change scripts on disk
     ///
+    /// A repository is usually a directory, but may instead be a bundle (see
+    /// bundle.hpp) produced from one.  In that case, the upgrade and install
+    /// script paths are both the path of the bundle itself, and there is no
+    /// latest schema path.
+    ///
+    /// The install and upgrade script directories are each read from disk
+    /// the first time a query needs them, rather than when the repository is
+    /// opened, so any error in reading one is thrown by that query.  Doing
+    /// so is thread-safe.
+    ///
     class repository
     {
     public:
     
+        ///
+        /// Open the repository directory, or bundle, at the given path.
+        ///
         explicit repository(const std::string &path);
+        
+        ///
+        /// Open the repository directory, or bundle, at the given path,
+        /// reading its script directories in the given way
+        ///
+        /// See script_dir for how indexes and lazy listing work.  A bundle is
+        /// read in full whichever way is given.
+        ///
+        /// A lazily-loaded repository must not be shared between threads,
+        /// since even its const queries may list further sub-directories.
+        ///
+        repository(const std::string &path, const script_loading loading);
         repository(
             const std::string &latest_schema_path,
             const std::string &upgrade_script_path,
             const std::string &install_script_path);
+        
+        ///
+        /// Make a repository of script directories that have already been
+        /// read
+        ///
+        /// The upgrade and install script paths are those of the given
+        /// script directories.
+        ///
+        repository(
+            const std::string &latest_schema_path,
+            script_dir &&upgrade_scripts,
+            script_dir &&install_scripts);
         ~repository();
 
         ///
@@ -67,6 +131,21 @@ namespace dbmig
         ///
         semver latest_version() const;
         
+        ///
+        /// All scripts in the repository for a given action
+        ///
+        /// Since rollback statements live in upgrade scripts, the scripts for
+        /// rollback are the upgrade scripts.
+        ///
+        const script_dir &scripts(const script_action action) const;
+        
+        ///
+        /// The bundle that this repository was opened from, if any.
+        ///
+        /// Returns a null pointer if the repository is a directory on disk.
+        ///
+        const bundle *script_bundle() const;
+        
         ///
         /// Return iterator range over the (single) nearest install script
         ///
@@ -105,6 +184,15 @@ namespace dbmig
     std::string calculate_script_hash(const repository &repo,
                                       const script_action &action,
                                       const std::string &script_path);
+    
+    ///
+    /// Calculate the SHA256 hash of a given script, consulting (and updating)
+    /// a cache of previously-calculated hashes
+    ///
+    std::string calculate_script_hash(const repository &repo,
+                                      const script_action &action,
+                                      const std::string &script_path,
+                                      hash_cache &cache);
 }
 
 #endif // DBMIG_REPOSITORY_INCLUDED
@@ -19,17 +19,49 @@
 #include "script_dir.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
 #include <boost/system/error_code.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/regex.hpp>
-#include <nowide/convert.hpp>
 
+#include "dir_scan.hpp"
+#include "fs_encoding.hpp"
+#include "script_filename.hpp"
+#include "script_index.hpp"
 #include "semver_compare.hpp"
 #include "exception.hpp"
 
 
 namespace dbmig {
 
+///
+/// The X.Y.Z version shared by every script in a version sub-directory
+///
+typedef std::tuple<unsigned int, unsigned int, unsigned int> dir_version;
+
+static dir_version dir_version_of(const semver &version)
+{
+    return dir_version{version.mj(), version.mn(), version.pt()};
+}
+
+///
+/// A version sub-directory that a lazy script_dir has yet to list
+///
+struct pending_sub_dir
+{
+    dir_version version;
+    std::string name;
+};
+
+static void sort_scripts(script_dir::list_type &scripts,
+                         std::vector<script_key> &keys_out);
+
 // Private impl class
 struct script_dir::impl
 {
@@ -39,67 +71,103 @@ struct script_dir::impl
     
     impl(const std::string &script_dir_path,
          const std::string &file_extension) :
-        path_(script_dir_path), file_extension_(file_extension), version_map_{}
+        path_(script_dir_path), file_extension_(file_extension),
+        version_list_{}
     {
         preload();
     }
+    
+    impl(const std::string &script_dir_path,
+         const std::string &file_extension,
+         const std::string &index_path) :
+        path_(script_dir_path), file_extension_(file_extension),
+        version_list_{}
+    {
+        preload(index_path);
+    }
+    
+    impl(const std::string &script_dir_path,
+         const std::string &file_extension,
+         lazy_loading_t) :
+        path_(script_dir_path), file_extension_(file_extension),
+        version_list_{}
+    {
+        preload(lazy_loading);
+    }
+    
+    impl(impl &previous, const std::vector<std::string> &changed_sub_dirs) :
+        path_(previous.path_), file_extension_(previous.file_extension_),
+        version_list_{}
+    {
+        rescan(previous, changed_sub_dirs);
+    }
+    
+    impl(const std::string &script_dir_path, list_type &&scripts) :
+        path_(script_dir_path), file_extension_(".sql"),
+        version_list_(std::move(scripts))
+    {
+        sort_scripts(version_list_, keys_);
+    }
 
     const std::string path_;
     const std::string file_extension_;
     
-    map_type version_map_;
+    // Sorted by version.
+    list_type version_list_;
+    // Packed ordering key of each script, in the same order.
+    std::vector<script_key> keys_;
+    // Sub-directories not yet listed, if lazy, sorted by version.
+    typedef std::vector<pending_sub_dir> pending_list;
+    pending_list pending_;
+    
+    ///
+    /// The version that a key (within keys_) was made from.
+    ///
+    const semver &version_of(const script_key &key) const
+    {
+        return version_list_[&key - keys_.data()].first;
+    }
+    
+    ///
+    /// The script that a key (within keys_) was made from.
+    ///
+    const_iterator script_at(std::vector<script_key>::const_iterator k) const
+    {
+        return version_list_.cbegin() + (k - keys_.cbegin());
+    }
+    
+    const_iterator find_first_greater(const semver &version) const;
+    const_iterator find_last_less_equal(const semver &version) const;
+    
+    // Each of these lists just enough pending sub-directories for the
+    // corresponding query to be answered from those already listed.
+    void list_all();
+    void list_between(const semver &from_version, const semver &to_version);
+    void list_after(const semver &version);
+    void list_up_to(const semver &version);
+    void list_latest();
     
 private:
     
     void preload();
+    void preload(const std::string &index_path);
+    void preload(lazy_loading_t);
+    void rescan(impl &previous,
+                const std::vector<std::string> &changed_sub_dirs);
+    void check_root() const;
+    void scan_root(const open_dir &root, list_type &scripts,
+                   std::vector<std::string> &sub_dirs,
+                   mtime_map *group_dir_mtimes = nullptr) const;
+    void scan_sub_dir(const std::string &sub_dir, list_type &scripts,
+                      const open_dir *root = nullptr) const;
+    void list_sub_dirs(pending_list::iterator first,
+                       pending_list::iterator last);
 };
 
 // Non-member functions
 static bool matches_extension(const std::string &filename,
                               const std::string &file_extension);
-static semver parse_filename(const std::string &parent_dir_name,
-                             const std::string &filename);
-static semver parse_filename(const std::string &filename);
-static semver parse_semver_candidate(const std::string &candidate,
-                                     const std::string &path);
-
-///
-/// Take a UTF-8 path and return that path in an encoding suitable for the
-/// native filesystem.
-///
-template<typename ValueType>
-std::basic_string<ValueType> utf8_to_fs(const std::string &path);
-template<>
-std::basic_string<char> utf8_to_fs(const std::string &path)
-{
-    // Already UTF-8 natively, no conversion.
-    return path;
-}
-template<>
-std::basic_string<wchar_t> utf8_to_fs(const std::string &path)
-{
-    // Widening conversion required.
-    return nowide::widen(path);
-}
-
-///
-/// Take a path in the encoding of the native filesystem and return that path
-/// in UTF-8.
-///
-template<typename ValueType>
-std::string fs_to_utf8(const std::basic_string<ValueType> &path);
-template<>
-std::string fs_to_utf8(const std::basic_string<char> &path)
-{
-    // Already UTF-8 natively, no conversion.
-    return path;
-}
-template<>
-std::string fs_to_utf8(const std::basic_string<wchar_t> &path)
-{
-    // Narrowing conversion required.
-    return nowide::narrow(path);
-}
+static bool is_version_sub_dir(const std::string &sub_dir);
 
 ///
 /// Object generator method for script_dir::iterator_range
@@ -120,17 +188,324 @@ script_dir::script_dir(const std::string &path, const std::string &file_extensio
     // DRY, grrr
     : pimpl_(new impl(path, file_extension))
 {}
+script_dir::script_dir(const std::string &path,
+                       const std::string &file_extension,
+                       const std::string &index_path)
+    : pimpl_(new impl(path, file_extension, index_path))
+{}
+script_dir::script_dir(const std::string &path,
+                       const std::string &file_extension,
+                       lazy_loading_t)
+    : pimpl_(new impl(path, file_extension, lazy_loading))
+{}
+script_dir::script_dir(const std::string &path, list_type &&scripts)
+    : pimpl_(new impl(path, std::move(scripts)))
+{}
+script_dir::script_dir(const script_dir &previous,
+                       const std::vector<std::string> &changed_sub_dirs)
+    : pimpl_(new impl(*previous.pimpl_, changed_sub_dirs))
+{}
+
+script_dir::script_dir(script_dir &&other) = default;
 
 script_dir::~script_dir() = default;
 
 
+///
+/// The number of threads to scan sub-directories with: one per core
+///
+static std::size_t scan_jobs()
+{
+    // Zero means the number of cores could not be determined.
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+///
+/// Call func(i, scripts) for each i in [0, count), concurrently
+///
+/// Each thread repeatedly claims the next unclaimed i, and collects scripts
+/// into its own list; the lists are merged at the end.  If func throws, the
+/// exception for the lowest such i is rethrown once all threads have
+/// finished.
+///
+template<typename Func>
+static script_dir::list_type for_each_concurrently(const std::size_t count,
+                                                   Func func)
+{
+    auto num_threads = std::min(scan_jobs(), count);
+    std::vector<script_dir::list_type> partial_lists(num_threads);
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<std::size_t> next{0};
+    
+    auto worker = [&](script_dir::list_type &scripts)
+    {
+        for (auto i = next++; i < count; i = next++) {
+            try {
+                func(i, scripts);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+                next = count;
+            }
+        }
+    };
+    
+    if (num_threads == 1) {
+        worker(partial_lists[0]);
+    }
+    else if (num_threads > 1) {
+        std::vector<std::thread> threads;
+        for (auto &scripts : partial_lists)
+            threads.emplace_back(worker, std::ref(scripts));
+        for (auto &thread : threads)
+            thread.join();
+    }
+    
+    for (auto &error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+    
+    script_dir::list_type merged;
+    for (auto &scripts : partial_lists) {
+        std::move(scripts.begin(), scripts.end(), std::back_inserter(merged));
+    }
+    return merged;
+}
+
 void script_dir::impl::preload()
 {
-    namespace sys = boost::system;
-    namespace fs = boost::filesystem;
+    check_root();
     
     // Clear any existing cached version map.
-    version_map_.clear();
+    version_list_.clear();
+    
+    // Examine directory contents.  Scripts directly within the root are
+    // parsed straight away, but version sub-directories are scanned
+    // afterwards, concurrently, since each costs at least one round trip to
+    // the file system.
+    open_dir root{path_};
+    std::vector<std::string> sub_dirs;
+    scan_root(root, version_list_, sub_dirs);
+    auto sub_dir_scripts = for_each_concurrently(sub_dirs.size(),
+        [&](std::size_t i, list_type &scripts)
+        {
+            scan_sub_dir(sub_dirs[i], scripts, &root);
+        });
+    
+    // Sorting also finds any duplicate versions, wherever they came from.
+    std::move(sub_dir_scripts.begin(), sub_dir_scripts.end(),
+              std::back_inserter(version_list_));
+    sort_scripts(version_list_, keys_);
+}
+
+///
+/// Load the scripts, reusing those recorded in the given index file for any
+/// directories that have not changed since, and then refresh the index.
+///
+void script_dir::impl::preload(const std::string &index_path)
+{
+    check_root();
+    
+    // Clear any existing cached version map.
+    version_list_.clear();
+    
+    script_index index;
+    if (!load_script_index(index_path, file_extension_, index)) {
+        index.root_mtime_ns = -1;
+        index.sub_dir_mtimes.clear();
+        index.scripts.clear();
+    }
+    
+    // Stat each directory before listing it, so that if it changes while
+    // being listed, the time recorded is already out of date.
+    open_dir root{path_};
+    auto root_mtime = root.mtime_ns();
+    bool root_unchanged = root_mtime == index.root_mtime_ns;
+    
+    // The index also records the times of any directories that merely group
+    // version sub-directories together.  If neither the root nor any of
+    // these has changed, nor have the scripts directly within the root, or
+    // the set of version sub-directories.
+    std::vector<std::string> sub_dirs;
+    mtime_map group_dir_mtimes;
+    if (root_unchanged) {
+        for (auto &kv : index.sub_dir_mtimes) {
+            if (is_version_sub_dir(kv.first))
+                sub_dirs.push_back(kv.first);
+            else
+                group_dir_mtimes.insert(kv);
+        }
+        for (auto &kv : group_dir_mtimes) {
+            try {
+                if (stat_script_file(path_ + "/" + kv.first).mtime_ns !=
+                    kv.second)
+                    root_unchanged = false;
+            }
+            catch (const boost::filesystem::filesystem_error &) {
+                root_unchanged = false;
+            }
+        }
+    }
+    
+    list_type root_scripts;
+    if (root_unchanged) {
+        for (auto &script : index.scripts) {
+            if (script.second.find('/') == std::string::npos)
+                root_scripts.push_back(script);
+        }
+    }
+    else {
+        sub_dirs.clear();
+        group_dir_mtimes.clear();
+        scan_root(root, root_scripts, sub_dirs, &group_dir_mtimes);
+    }
+    
+    // Only rescan those sub-directories that have changed.
+    std::vector<std::int64_t> sub_dir_mtimes(sub_dirs.size());
+    std::vector<char> reused(sub_dirs.size());
+    auto sub_dir_scripts = for_each_concurrently(sub_dirs.size(),
+        [&](std::size_t i, list_type &scripts)
+        {
+            auto &sub_dir = sub_dirs[i];
+            sub_dir_mtimes[i] =
+                stat_script_file(path_ + "/" + sub_dir).mtime_ns;
+            auto it = index.sub_dir_mtimes.find(sub_dir);
+            if (it != index.sub_dir_mtimes.end() &&
+                it->second == sub_dir_mtimes[i])
+                reused[i] = true;
+            else
+                scan_sub_dir(sub_dir, scripts, &root);
+        });
+    
+    if (root_unchanged &&
+        std::find(reused.begin(), reused.end(), false) == reused.end()) {
+        // Nothing has changed; the index is already sorted.
+        version_list_ = std::move(index.scripts);
+        sort_scripts(version_list_, keys_);
+        return;
+    }
+    
+    // Gather scripts from the root, then from each sub-directory, whether
+    // reused from the index or scanned afresh.
+    mtime_map new_mtimes = std::move(group_dir_mtimes);
+    std::unordered_set<std::string> reused_sub_dirs;
+    for (std::size_t i = 0; i < sub_dirs.size(); ++i) {
+        new_mtimes[sub_dirs[i]] = sub_dir_mtimes[i];
+        if (reused[i])
+            reused_sub_dirs.insert(sub_dirs[i]);
+    }
+    version_list_ = std::move(root_scripts);
+    for (auto &script : index.scripts) {
+        auto slash = script.second.rfind('/');
+        if (slash != std::string::npos &&
+            reused_sub_dirs.count(script.second.substr(0, slash)))
+            version_list_.push_back(std::move(script));
+    }
+    std::move(sub_dir_scripts.begin(), sub_dir_scripts.end(),
+              std::back_inserter(version_list_));
+    sort_scripts(version_list_, keys_);
+    
+    // A failure to save the index merely means a full scan next time.
+    save_script_index(index_path, file_extension_, root_mtime, new_mtimes,
+                      version_list_);
+}
+
+///
+/// List the root of the script directory, leaving version sub-directories
+/// to be listed by queries as they need them.
+///
+void script_dir::impl::preload(lazy_loading_t)
+{
+    check_root();
+    
+    // Clear any existing cached version map.
+    version_list_.clear();
+    pending_.clear();
+    
+    // Directories not named for a version are walked straight away, since
+    // they may hold version sub-directories, or a bad filename.
+    std::vector<std::string> sub_dirs;
+    scan_root(open_dir{path_}, version_list_, sub_dirs);
+    for (auto &sub_dir : sub_dirs) {
+        unsigned int mj, mn, pt;
+        parse_script_dir_name(sub_dir.substr(sub_dir.rfind('/') + 1),
+                              mj, mn, pt);
+        pending_.push_back({dir_version{mj, mn, pt}, std::move(sub_dir)});
+    }
+    std::sort(pending_.begin(), pending_.end(),
+        [](const pending_sub_dir &a, const pending_sub_dir &b)
+        {
+            return a.version < b.version;
+        });
+    sort_scripts(version_list_, keys_);
+}
+
+///
+/// Load the scripts, rescanning only the given changed parts of the
+/// directory, and reusing the scripts of an earlier scan for the rest.
+///
+void script_dir::impl::rescan(impl &previous,
+                              const std::vector<std::string> &changed_sub_dirs)
+{
+    previous.list_all();
+    version_list_.clear();
+    
+    std::unordered_set<std::string> changed(changed_sub_dirs.begin(),
+                                            changed_sub_dirs.end());
+    bool root_changed = changed.erase("") != 0;
+    
+    // Work out which sub-directories to scan, and which to reuse.
+    std::vector<std::string> sub_dirs;
+    std::unordered_set<std::string> reused_sub_dirs;
+    if (root_changed) {
+        std::unordered_set<std::string> known_sub_dirs;
+        for (auto &script : previous.version_list_) {
+            auto slash = script.second.rfind('/');
+            if (slash != std::string::npos)
+                known_sub_dirs.insert(script.second.substr(0, slash));
+        }
+        std::vector<std::string> listed;
+        scan_root(open_dir{path_}, version_list_, listed);
+        for (auto &sub_dir : listed) {
+            // An empty sub-directory has no scripts to show it was known.
+            if (changed.count(sub_dir) || !known_sub_dirs.count(sub_dir))
+                sub_dirs.push_back(std::move(sub_dir));
+            else
+                reused_sub_dirs.insert(std::move(sub_dir));
+        }
+    }
+    else {
+        sub_dirs.assign(changed.begin(), changed.end());
+    }
+    
+    for (auto &script : previous.version_list_) {
+        auto slash = script.second.rfind('/');
+        bool reuse = slash == std::string::npos ? !root_changed
+            : root_changed
+                ? reused_sub_dirs.count(script.second.substr(0, slash)) != 0
+                : !changed.count(script.second.substr(0, slash));
+        if (reuse)
+            version_list_.push_back(script);
+    }
+    
+    auto sub_dir_scripts = for_each_concurrently(sub_dirs.size(),
+        [&](std::size_t i, list_type &scripts)
+        {
+            scan_sub_dir(sub_dirs[i], scripts);
+        });
+    std::move(sub_dir_scripts.begin(), sub_dir_scripts.end(),
+              std::back_inserter(version_list_));
+    sort_scripts(version_list_, keys_);
+}
+
+///
+/// Check that the script directory exists.
+///
+void script_dir::impl::check_root() const
+{
+    namespace sys = boost::system;
+    namespace fs = boost::filesystem;
     
     fs::path root(utf8_to_fs<fs::path::value_type>(path_));
     if (!exists(root) || !is_directory(root))
@@ -139,66 +514,316 @@ void script_dir::impl::preload()
         throw fs::filesystem_error("Script directory path does not exist", root,
             sys::errc::make_error_code(sys::errc::no_such_file_or_directory));
     }
-    
-    // Examine directory contents.
-    for (auto it = fs::directory_iterator(root); it != fs::directory_iterator();
-        ++it)
-    {
-        auto &p = it->path();
-        bool is_dir = fs::is_directory(p);
-        bool is_file = fs::is_regular_file(p);
-        if (fs::is_symlink(p))
-        {
-            // Is it a symlink to a file or directory?
-            // TODO
-        }
-        
-        if (is_dir)
+}
+
+///
+/// Add the scripts directly within the script directory to the given list,
+/// and collect the paths of its version sub-directories.
+///
+/// Any other sub-directory is walked in search of more version
+/// sub-directories, so that they may be grouped (by major and minor version,
+/// say), and may be reached through symbolic links.  No scripts may sit
+/// within a grouping directory itself.  If asked, the modification time of
+/// each grouping directory is collected too.
+///
+void script_dir::impl::scan_root(const open_dir &root, list_type &scripts,
+                                 std::vector<std::string> &sub_dirs,
+                                 mtime_map *group_dir_mtimes) const
+{
+    walk_directory_tree(root,
+        [&](const std::string &relative_path, const open_dir &dir,
+            dir_entry_list &entries)
         {
-            // Iterate over sub-dir contents.
-            for (auto sd_it = fs::directory_iterator(p); sd_it !=
-                fs::directory_iterator(); ++sd_it)
+            if (!relative_path.empty() && group_dir_mtimes)
+                (*group_dir_mtimes)[relative_path] = dir.mtime_ns();
+            
+            for (auto &entry : entries)
             {
-                // Only concerned with regular files now.
-                // TODO - and symlinks to regular files?
-                auto sd_file = sd_it->path();
-                if (!fs::is_regular_file(sd_file))
-                    continue;
-                
-                // Only suitable file extensions.
-                std::string sub_filename =
-                    fs_to_utf8(sd_file.filename().native());
-                if (!matches_extension(sub_filename, file_extension_))
-                    continue;
-                
-                // Try to parse a version from this file, taking into account
-                // the name of its parent directory, which may contribute.
-                std::string parent_dir = fs_to_utf8(p.filename().native());
-                semver sub_ver = parse_filename(parent_dir, sub_filename);
-                std::string sub_path = parent_dir + "/" + sub_filename;
-                if (version_map_.count(sub_ver)) {
-                    throw script_dir_uniqueness_violation(
-                        sub_ver, sub_path, version_map_[sub_ver]);
+                if (entry.type == dir_entry_type::directory)
+                {
+                    auto sub_dir = relative_path.empty() ? entry.name
+                        : relative_path + "/" + entry.name;
+                    if (is_version_sub_dir(entry.name))
+                        sub_dirs.push_back(std::move(sub_dir));
+                }
+                else if (entry.type == dir_entry_type::file)
+                {
+                    // Only suitable file extensions.
+                    if (!matches_extension(entry.name, file_extension_))
+                        continue;
+                    
+                    if (!relative_path.empty())
+                        throw bad_subdir_filename(
+                            relative_path + "/" + entry.name);
+                    
+                    // Try to parse a version from this file and add to the
+                    // map.
+                    semver ver = parse_script_filename(entry.name);
+                    scripts.emplace_back(std::move(ver),
+                                         std::move(entry.name));
                 }
-                version_map_.insert(value_type{sub_ver, sub_path});
             }
+            
+            // Only grouping directories are walked any further.
+            entries.erase(std::remove_if(entries.begin(), entries.end(),
+                [](const dir_entry &entry)
+                {
+                    return entry.type != dir_entry_type::directory ||
+                        is_version_sub_dir(entry.name);
+                }),
+                entries.end());
+        });
+}
+
+///
+/// Add the scripts in a version sub-directory to the given list.
+///
+/// If the root is given open, the sub-directory is opened relative to it.
+///
+void script_dir::impl::scan_sub_dir(const std::string &sub_dir,
+                                    list_type &scripts,
+                                    const open_dir *root) const
+{
+    auto dir_name = sub_dir.substr(sub_dir.rfind('/') + 1);
+    auto entries = root ? open_dir{*root, sub_dir}.list()
+        : list_directory(path_ + "/" + sub_dir);
+    for (auto &entry : entries)
+    {
+        // Only concerned with regular files (or links to them).
+        if (entry.type != dir_entry_type::file)
+            continue;
+        
+        // Only suitable file extensions.
+        if (!matches_extension(entry.name, file_extension_))
+            continue;
+        
+        // Try to parse a version from this file, taking into account the
+        // name of its parent directory, which may contribute.
+        auto path = sub_dir + "/" + entry.name;
+        try {
+            semver ver = parse_script_filename(dir_name, entry.name);
+            scripts.emplace_back(std::move(ver), std::move(path));
         }
-        else if (is_file)
+        catch (const bad_subdir_filename &) {
+            // Report the whole path within the script directory.
+            throw bad_subdir_filename(path);
+        }
+    }
+}
+
+///
+/// List some of the pending sub-directories, and merge their scripts into
+/// those already listed.
+///
+/// Only the new scripts are sorted; they are then merged in from the back,
+/// so that scripts already listed move only if a new one comes before them.
+///
+/// If a sub-directory cannot be listed, or one of its scripts shares the
+/// version of another, the scripts already listed are left as they were.
+///
+void script_dir::impl::list_sub_dirs(pending_list::iterator first,
+                                     pending_list::iterator last)
+{
+    open_dir root{path_};
+    auto scripts = for_each_concurrently(last - first,
+        [&](std::size_t i, list_type &scripts)
         {
-            // Only suitable file extensions.
-            std::string filename = fs_to_utf8(p.filename().native());
-            if (!matches_extension(filename, file_extension_))
-                continue;
-            
-            // Try to parse a version from this file and add to the map.
-            semver ver = parse_filename(filename);
-            if (version_map_.count(ver)) {
-                throw script_dir_uniqueness_violation(
-                    ver, filename, version_map_[ver]);
-            }
-            version_map_.insert(value_type{ver, filename});
+            scan_sub_dir(first[i].name, scripts, &root);
+        });
+    std::vector<script_key> keys;
+    sort_scripts(scripts, keys);
+    
+    // A new script can only share its version with the listed script it
+    // would be merged in beside, so check there before changing anything.
+    script_key_metadata_compare cmp;
+    auto n = version_list_.size(), m = scripts.size();
+    for (std::size_t j = 0; j < m; ++j) {
+        auto &version = scripts[j].first;
+        auto k = std::lower_bound(keys_.cbegin(), keys_.cend(), keys[j],
+            [&](const script_key &a, const script_key &b)
+            {
+                return cmp(a, version_of(a), b, version);
+            });
+        if (k != keys_.cend() && !cmp(keys[j], version, *k, version_of(*k)))
+            throw script_dir_uniqueness_violation(
+                version, scripts[j].second, script_at(k)->second);
+    }
+    
+    // Make room, which is all that can fail, then merge from the back.  The
+    // room is filled with the new scripts' versions, which are overwritten.
+    version_list_.reserve(n + m);
+    keys_.reserve(n + m);
+    try {
+        for (auto &script : scripts)
+            version_list_.emplace_back(script.first, std::string{});
+    }
+    catch (...) {
+        version_list_.erase(version_list_.begin() + n, version_list_.end());
+        throw;
+    }
+    keys_.insert(keys_.end(), keys.begin(), keys.end());
+    for (auto i = n, j = m, out = n + m; j > 0; ) {
+        --out;
+        if (i > 0 && cmp(keys[j - 1], scripts[j - 1].first,
+                         keys_[i - 1], version_list_[i - 1].first)) {
+            --i;
+            version_list_[out] = std::move(version_list_[i]);
+            keys_[out] = keys_[i];
+        }
+        else {
+            --j;
+            version_list_[out] = std::move(scripts[j]);
+            keys_[out] = keys[j];
         }
     }
+    pending_.erase(first, last);
+}
+
+static bool pending_before(const pending_sub_dir &sub_dir,
+                           const dir_version &version)
+{
+    return sub_dir.version < version;
+}
+
+static bool pending_after(const dir_version &version,
+                          const pending_sub_dir &sub_dir)
+{
+    return version < sub_dir.version;
+}
+
+///
+/// List every pending sub-directory.
+///
+void script_dir::impl::list_all()
+{
+    if (!pending_.empty())
+        list_sub_dirs(pending_.begin(), pending_.end());
+}
+
+///
+/// List the pending sub-directories that may hold scripts within a range.
+///
+void script_dir::impl::list_between(const semver &from_version,
+                                    const semver &to_version)
+{
+    auto first = std::lower_bound(pending_.begin(), pending_.end(),
+                                  dir_version_of(from_version),
+                                  pending_before);
+    auto last = std::upper_bound(first, pending_.end(),
+                                 dir_version_of(to_version), pending_after);
+    if (first < last)
+        list_sub_dirs(first, last);
+}
+
+///
+/// List pending sub-directories, earliest first, until the first script
+/// greater than the given version is known.
+///
+void script_dir::impl::list_after(const semver &version)
+{
+    auto ver = dir_version_of(version);
+    for (;;) {
+        auto next = std::lower_bound(pending_.begin(), pending_.end(), ver,
+                                     pending_before);
+        if (next == pending_.end())
+            return;
+        // Done if a script already listed comes before any in the next
+        // sub-directory.
+        auto it = find_first_greater(version);
+        if (it != version_list_.cend() &&
+            dir_version_of(it->first) < next->version)
+            return;
+        list_sub_dirs(next, next + 1);
+    }
+}
+
+///
+/// List pending sub-directories, latest first, until the last script less
+/// than or equal to the given version is known.
+///
+void script_dir::impl::list_up_to(const semver &version)
+{
+    auto ver = dir_version_of(version);
+    for (;;) {
+        auto next = std::upper_bound(pending_.begin(), pending_.end(), ver,
+                                     pending_after);
+        if (next == pending_.begin())
+            return;
+        --next;
+        // Done if a script already listed comes after any in the next
+        // sub-directory.
+        auto it = find_last_less_equal(version);
+        if (it != version_list_.cbegin() &&
+            next->version < dir_version_of(std::prev(it)->first))
+            return;
+        list_sub_dirs(next, next + 1);
+    }
+}
+
+///
+/// List pending sub-directories, latest first, until the greatest script
+/// is known.
+///
+void script_dir::impl::list_latest()
+{
+    while (!pending_.empty()) {
+        auto next = pending_.end() - 1;
+        if (!version_list_.empty() &&
+            next->version < dir_version_of(version_list_.back().first))
+            return;
+        list_sub_dirs(next, pending_.end());
+    }
+}
+
+///
+/// Sort the scripts by version, and check that no two share a version.
+///
+/// The packed key of each script is output in the same order.
+///
+static void sort_scripts(script_dir::list_type &scripts,
+                         std::vector<script_key> &keys_out)
+{
+    // Compare on packed keys, falling back to full versions only for any
+    // with unusual build metadata.
+    std::vector<script_key> keys;
+    keys.reserve(scripts.size());
+    for (auto &script : scripts)
+        keys.emplace_back(script.first);
+    script_key_metadata_compare cmp;
+    auto less = [&](std::size_t a, std::size_t b)
+    {
+        return cmp(keys[a], scripts[a].first,
+                   keys[b], scripts[b].first);
+    };
+    
+    // Directory entries arrive in no particular order, but scripts from
+    // elsewhere usually arrive sorted already.
+    auto n = scripts.size();
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    if (!std::is_sorted(order.begin(), order.end(), less)) {
+        std::sort(order.begin(), order.end(), less);
+        script_dir::list_type sorted_list;
+        std::vector<script_key> sorted_keys;
+        sorted_list.reserve(n);
+        sorted_keys.reserve(n);
+        for (auto i : order) {
+            sorted_list.push_back(std::move(scripts[i]));
+            sorted_keys.push_back(keys[i]);
+        }
+        scripts.swap(sorted_list);
+        keys.swap(sorted_keys);
+    }
+    
+    // Once sorted, any scripts sharing a version are adjacent.
+    for (std::size_t i = 1; i < n; ++i) {
+        if (!less(i - 1, i)) {
+            throw script_dir_uniqueness_violation(
+                scripts[i - 1].first, scripts[i].second,
+                scripts[i - 1].second);
+        }
+    }
+    keys_out.swap(keys);
 }
 
 
@@ -225,8 +850,9 @@ const std::string &script_dir::file_extension() const
 ///
 script_dir::const_iterator script_dir::begin() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.begin();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.begin();
 }
 
 ///
@@ -234,8 +860,9 @@ script_dir::const_iterator script_dir::begin() const
 ///
 script_dir::const_reverse_iterator script_dir::rbegin() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.rbegin();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.rbegin();
 }
 
 ///
@@ -243,8 +870,9 @@ script_dir::const_reverse_iterator script_dir::rbegin() const
 ///
 script_dir::const_reverse_iterator script_dir::rend() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.rend();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.rend();
 }
 
 ///
@@ -252,26 +880,29 @@ script_dir::const_reverse_iterator script_dir::rend() const
 ///
 script_dir::const_iterator script_dir::end() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.end();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.end();
 }
 
 ///
 /// Return const_iterator to the beginning of the script directory.
 ///
-script_dir::const_iterator script_dir::cbegin() const noexcept
+script_dir::const_iterator script_dir::cbegin() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.cbegin();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.cbegin();
 }
 
 ///
 /// Return const_iterator to the end of the script directory.
 ///
-script_dir::const_iterator script_dir::cend() const noexcept
+script_dir::const_iterator script_dir::cend() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.cend();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.cend();
 }
 
 ///
@@ -279,8 +910,9 @@ script_dir::const_iterator script_dir::cend() const noexcept
 ///
 script_dir::const_reverse_iterator script_dir::crbegin() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.crbegin();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.crbegin();
 }
 
 ///
@@ -288,8 +920,9 @@ script_dir::const_reverse_iterator script_dir::crbegin() const
 ///
 script_dir::const_reverse_iterator script_dir::crend() const
 {
-    auto &version_map_ = pimpl_->version_map_;
-    return version_map_.crend();
+    pimpl_->list_all();
+    auto &version_list_ = pimpl_->version_list_;
+    return version_list_.crend();
 }
 
 ///
@@ -302,20 +935,26 @@ script_dir::const_reverse_iterator script_dir::crend() const
 script_dir::const_iterator
 script_dir::first_greater (const semver &version) const
 {
-    auto &version_map_ = pimpl_->version_map_;
+    pimpl_->list_after(version);
+    return pimpl_->find_first_greater(version);
+}
 
-    // TODO - make this more efficient perhaps?
+script_dir::const_iterator
+script_dir::impl::find_first_greater (const semver &version) const
+{
     // TODO - replace with upper_bound()?
     // Note that lower_bound() will return the first script >= rather than >.
     semver_script_compare<non_script_alignment::low> cmp;
-    auto iter = std::lower_bound(version_map_.begin(), version_map_.end(),
-        version,
-        [&cmp](const value_type &kvp, const semver &v)
+    script_key key{version};
+    auto k = std::lower_bound(keys_.cbegin(), keys_.cend(), key,
+        [&](const script_key &sk, const script_key &vk)
         {
-            return cmp(kvp.first, v);
+            return cmp(sk, version_of(sk), vk, version);
         });
+    auto iter = script_at(k);
     // If we got the one asked for, then increment to get the next.
-    if (iter != version_map_.end() && iter->first == version)
+    if (k != keys_.cend() &&
+        (k->packed() && key.packed() ? *k == key : iter->first == version))
         ++iter;
     return iter;
 }
@@ -339,11 +978,20 @@ script_dir::first_greater (const semver &version) const
 script_dir::const_iterator
 script_dir::last_less_equal (const semver &version) const
 {
-    auto &version_map_ = pimpl_->version_map_;
+    pimpl_->list_up_to(version);
+    return pimpl_->find_last_less_equal(version);
+}
 
+script_dir::const_iterator
+script_dir::impl::find_last_less_equal (const semver &version) const
+{
     semver_script_compare<non_script_alignment::high> cmp;
-    return std::upper_bound(version_map_.begin(), version_map_.end(), version,
-        [&cmp](const semver &v, const value_type &kvp) { return cmp(v, kvp.first); });
+    script_key key{version};
+    return script_at(std::upper_bound(keys_.cbegin(), keys_.cend(), key,
+        [&](const script_key &vk, const script_key &sk)
+        {
+            return cmp(vk, version, sk, version_of(sk));
+        }));
 }
 
 ///
@@ -363,110 +1011,83 @@ script_dir::last_less_equal (const semver &version) const
 script_dir::const_iterator_range
 script_dir::range (const semver &from_version, const semver &to_version) const
 {
-    auto l_it = first_greater(from_version);
+    auto &impl = *pimpl_;
+    impl.list_between(from_version, to_version);
+    auto l_it = impl.find_first_greater(from_version);
     // Note that the only reason this method doesn't delegate to
     // script_dir::upper_bound here is so that the call to std::upper_bound can
     // be passed in a more efficient first iterator.
-    auto &version_map_ = pimpl_->version_map_;
+    auto &keys_ = impl.keys_;
     semver_script_compare<non_script_alignment::high> hcmp;
-    script_dir::const_iterator end = version_map_.end(); // auto will break!
-    auto u_it = std::upper_bound(l_it, end, to_version,
-        [&](const semver &v, const value_type &kvp) { return hcmp(v, kvp.first); });
-    return make_iterator_range(l_it, u_it);
+    script_key key{to_version};
+    auto l_k = keys_.cbegin() + (l_it - impl.version_list_.cbegin());
+    auto u_k = std::upper_bound(l_k, keys_.cend(), key,
+        [&](const script_key &vk, const script_key &sk)
+        {
+            return hcmp(vk, to_version, sk, impl.version_of(sk));
+        });
+    return make_iterator_range(l_it, impl.script_at(u_k));
 }
 
 ///
-/// Find out if a filename matches a given extension.
+/// Get a range over the (single) script with the greatest version
 ///
-static bool matches_extension(const std::string &filename,
-                              const std::string &file_extension)
+/// The range will be empty if the script directory is.
+///
+script_dir::const_iterator_range script_dir::latest () const
 {
-    if (filename.length() >= file_extension.length()) {
-        return (0 == filename.compare (
-            filename.length() - file_extension.length(),
-            file_extension.length(), file_extension));
-    } else {
-        return false;
-    }
+    auto &impl = *pimpl_;
+    impl.list_latest();
+    auto e = impl.version_list_.cend();
+    auto b = e;
+    if (b != impl.version_list_.cbegin())
+        --b;
+    return make_iterator_range(b, e);
 }
 
 ///
-/// Try to extract a semantic version by parsing a directory name and filename
+/// Get a range over the (single) latest script no later than the given
+/// version
+///
+/// That is, the last script less than or equal to the version, in the same
+/// sense as last_less_equal().  The range will be empty if there is no such
+/// script.
 ///
-static semver parse_filename(const std::string &parent_dir_name,
-                             const std::string &filename)
+script_dir::const_iterator_range
+script_dir::latest_not_after (const semver &version) const
 {
-    // Several valid options:
-    // 1. Dir is X.Y.Z, and filename is X.Y.Z+script.N_foo.sql
-    // 2. Dir is X.Y.Z, and filename is X.Y.Z+script.N.sql
-    // 3. Dir is X.Y.Z, and filename is script.N_foo.sql
-    // 4. Dir is X.Y.Z, and filename is script.N.sql
-    // 5. Dir is X.Y.Z, and filename is N_foo.sql
-    // 6. Dir is X.Y.Z, and filename is N.sql
-    // The above should result in a semantic version of X.Y.Z+script.N
-    static const boost::regex pat{
-        R"((\d+\.\d+\.\d+)/(?:\1\+)?(?:script\.)?(\d+)(?:_.*)?(?:\..*)?)"};
-    
-    boost::smatch results;
-    auto str = parent_dir_name + "/" + filename;
-    auto matched = boost::regex_match(str, results, pat,
-        boost::match_default | boost::match_partial);
-    if (!matched) {
-        throw bad_subdir_filename(str);
-    }
-
-    auto candidate = results[1].str() + "+script." + results[2].str();
-    return parse_semver_candidate(candidate, str);
+    auto &impl = *pimpl_;
+    impl.list_up_to(version);
+    auto e = impl.find_last_less_equal(version);
+    auto b = e;
+    if (b != impl.version_list_.cbegin())
+        --b;
+    return make_iterator_range(b, e);
 }
 
 ///
-/// Try to extract a semantic version by parsing a filename
+/// Find out if a filename matches a given extension.
 ///
-static semver parse_filename(const std::string &filename)
+static bool matches_extension(const std::string &filename,
+                              const std::string &file_extension)
 {
-    // Several valid options:
-    // 1. Filename is X.Y.Z+script.N_foo.sql
-    // 2. Filename is X.Y.Z+script.N.sql
-    // The above should result in a semantic version of X.Y.Z+script.N
-    static const boost::regex pat{
-        R"((\d+\.\d+\.\d+)\+script\.(\d+)(?:_.*)?(?:\..*)?)"};
-    
-    boost::smatch results;
-    auto matched = boost::regex_match(filename, results, pat,
-        boost::match_default | boost::match_partial);
-    if (!matched) {
-        throw bad_toplevel_filename(filename);
+    if (filename.length() >= file_extension.length()) {
+        return (0 == filename.compare (
+            filename.length() - file_extension.length(),
+            file_extension.length(), file_extension));
+    } else {
+        return false;
     }
-
-    auto candidate = results[1].str() + "+script." + results[2].str();
-    return parse_semver_candidate(candidate, filename);
 }
 
 ///
-/// Try to parse a candidate string (either a filename, or a concatenated
-/// dir/filename with path separator replaced by '+') to see if it's a valid
-/// semantic version for a script.
+/// Is the last part of the given path named for a version (X.Y.Z)?
 ///
-static semver parse_semver_candidate(const std::string &candidate,
-                                     const std::string &path)
+static bool is_version_sub_dir(const std::string &sub_dir)
 {
-    auto ver = semver::parse(candidate);
-    auto &bm_ids = ver.bm_ids();
-
-    if (bm_ids.size() >= 2 &&
-        !bm_ids[0].is_numeric && bm_ids[0].str_value == "script" &&
-        bm_ids[1].is_numeric)
-    {
-        // Reconstruct the semver, to ensure that a numerical representation
-        // of the script number is used.  This has the effect of removing any
-        // leading zeroes in the database changelog that may have been used in
-        // the filename for convenience of ordering.
-        std::string bms = "script." + std::to_string(bm_ids[1].numeric_value);
-        return semver{ver.mj(), ver.mn(), ver.pt(), "", bms};
-    }
-
-    // Doesn't pass the tests.
-    throw incomplete_filename(path);
+    unsigned int mj, mn, pt;
+    return parse_script_dir_name(sub_dir.substr(sub_dir.rfind('/') + 1),
+                                 mj, mn, pt);
 }
 
 } // dbmig namespace
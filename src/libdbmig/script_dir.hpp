@@ -22,11 +22,26 @@
 #include <string>
 #include <memory>
 #include <utility>
-#include <map>
+#include <vector>
 #include "semantic_version.hpp"
 
 namespace dbmig
 {
+    ///
+    /// The suffix of the index file kept alongside a script directory
+    ///
+    /// The index lives beside, rather than within, the directory, since
+    /// writing it would otherwise change the modification time it records.
+    ///
+    const std::string script_dir_index_suffix = ".dbmig-index";
+    
+    ///
+    /// Tag type to construct a script_dir whose sub-directories are listed
+    /// lazily
+    ///
+    struct lazy_loading_t {};
+    constexpr lazy_loading_t lazy_loading{};
+    
     ///
     /// Represents a directory on disk containing versioned scripts
     ///
@@ -35,10 +50,23 @@ namespace dbmig
     /// filename (and possibly sub-directory) of the script within the base
     /// script directory.
     ///
+    /// Scripts sit either directly within the base directory, or within a
+    /// version sub-directory named X.Y.Z.  Version sub-directories may
+    /// themselves be grouped within any other directories (such as
+    /// major/minor/X.Y.Z), and any of these may be symbolic links, to shared
+    /// script libraries say; the path of each script is then relative to
+    /// the base directory, through any grouping directories.
+    ///
     /// This class behaviours a "little bit" like an associative container, in
     /// that it can be thought of like a multimap keyed on semantic version,
     /// and mapped to file path on disk.
     ///
+    /// The scripts are held in a contiguous array, sorted by version, so that
+    /// iterators are random-access and every range query is a true binary
+    /// search rather than a walk over the scripts.  Those searches compare the
+    /// packed key of each script (see script_key), rather than its version,
+    /// so usually touch nothing but integers.
+    ///
     class script_dir
     {
     public:
@@ -47,9 +75,9 @@ namespace dbmig
         typedef std::string mapped_type;
         typedef std::pair<key_type, mapped_type> value_type;
         typedef semver::metadata_compare key_compare;
-        typedef std::map<key_type, mapped_type, key_compare> map_type;
-        typedef map_type::const_iterator const_iterator;
-        typedef map_type::const_reverse_iterator const_reverse_iterator;
+        typedef std::vector<value_type> list_type;
+        typedef list_type::const_iterator const_iterator;
+        typedef list_type::const_reverse_iterator const_reverse_iterator;
         
         ///
         /// Extend std::pair with begin/end to behave like real iterator range
@@ -72,6 +100,75 @@ namespace dbmig
     
         explicit script_dir(const std::string &path);
         script_dir(const std::string &path, const std::string &file_extension);
+        
+        ///
+        /// Scan a directory, with the help of an index file from a previous
+        /// scan
+        ///
+        /// Scripts recorded in the index are reused for each directory that
+        /// has not been modified since it was recorded, so that only new or
+        /// changed version sub-directories need to be listed.  The index is
+        /// then refreshed, if anything has changed.  An index that is
+        /// missing, unreadable or cannot be written merely costs a full scan.
+        ///
+        script_dir(const std::string &path, const std::string &file_extension,
+                   const std::string &index_path);
+        
+        ///
+        /// List only the root of a directory, leaving each version
+        /// sub-directory to be listed once a query first touches its version
+        ///
+        /// Sub-directories named X.Y.Z can hold nothing but X.Y.Z+script.N,
+        /// so range queries, latest() and latest_not_after() need list only
+        /// those few that could affect their result.  Anything else that
+        /// walks the whole directory (begin(), end() and so on) lists every
+        /// remaining sub-directory first.  Directories not named X.Y.Z are
+        /// walked straight away, so that a bad filename within one is still
+        /// reported by the constructor.  Of the iterators returned by
+        /// first_greater() and last_less_equal(), only the script pointed to
+        /// by the former, and the one before the latter, are sure to be
+        /// adjacent to their true neighbours.
+        ///
+        /// Listing further sub-directories invalidates any iterators that
+        /// were previously obtained, much as inserting into a vector does;
+        /// once every sub-directory has been listed, iterators are as stable
+        /// as those of any other script_dir.  Since even const queries may
+        /// modify it, a lazy script_dir must not be shared between threads.
+        ///
+        script_dir(const std::string &path, const std::string &file_extension,
+                   lazy_loading_t);
+        
+        ///
+        /// Construct from scripts whose versions are already known
+        ///
+        /// No directory is scanned; the given path is merely recorded, and
+        /// is what path() will subsequently return.  This allows scripts
+        /// read from somewhere other than the file system (such as a bundle)
+        /// to be presented in the same way as a directory on disk.
+        ///
+        /// The scripts are sorted by version, if they are not already.
+        /// Throws script_dir_uniqueness_violation if two share a version.
+        ///
+        script_dir(const std::string &path, list_type &&scripts);
+        
+        ///
+        /// Rescan only those parts of a directory that have changed since an
+        /// earlier scan of it
+        ///
+        /// Each changed part is named by the path of its version
+        /// sub-directory, or by an empty name for the root.  The scripts of
+        /// every other sub-directory are taken from the earlier scan, which
+        /// is first read in full if lazy.  A change to the root covers the
+        /// scripts directly within it and the set of sub-directories, at any
+        /// depth: any sub-directory that has appeared is scanned, and any
+        /// that has gone is dropped.
+        ///
+        /// Throws filesystem_error if a changed sub-directory no longer
+        /// exists, unless the root is also named as changed.
+        ///
+        script_dir(const script_dir &previous,
+                   const std::vector<std::string> &changed_sub_dirs);
+        script_dir(script_dir &&other);
         ~script_dir();
         
         ///
@@ -107,12 +204,12 @@ namespace dbmig
         ///
         /// Return const_iterator to the beginning of the script directory.
         ///
-        const_iterator cbegin() const noexcept;
+        const_iterator cbegin() const;
         
         ///
         /// Return const_iterator to the end of the script directory.
         ///
-        const_iterator cend() const noexcept;
+        const_iterator cend() const;
         
         ///
         /// Return a const_reverse_iterator to the reverse beginning of the dir.
@@ -167,6 +264,23 @@ namespace dbmig
         ///
         const_iterator_range range (const semver &from_version,
                                     const semver &to_version) const;
+        
+        ///
+        /// Get a range over the (single) script with the greatest version
+        ///
+        /// The range will be empty if the script directory is.
+        ///
+        const_iterator_range latest () const;
+        
+        ///
+        /// Get a range over the (single) latest script no later than the
+        /// given version
+        ///
+        /// That is, the last script less than or equal to the version, in the
+        /// same sense as last_less_equal().  The range will be empty if there
+        /// is no such script.
+        ///
+        const_iterator_range latest_not_after (const semver &version) const;
 
     private:
     
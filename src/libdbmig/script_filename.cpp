@@ -0,0 +1,188 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_filename.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include "exception.hpp"
+
+namespace dbmig {
+
+typedef semver::id_list id_list;
+typedef unsigned int number_type;
+
+///
+/// Parse a run of one or more decimal digits from the start of [b, e)
+///
+/// Returns the end of the run, or a null pointer if there are no digits at b
+/// or the number would overflow.  As in a filename, leading zeroes are fine.
+///
+static const char *parse_number(const char *b, const char *e,
+                                number_type &value)
+{
+    number_type v = 0;
+    const char *i = b;
+    for (; i != e && *i >= '0' && *i <= '9'; ++i)
+    {
+        number_type digit = static_cast<number_type>(*i - '0');
+        if (v > (std::numeric_limits<number_type>::max() - digit) / 10)
+            return nullptr;
+        v = v * 10 + digit;
+    }
+    if (i == b)
+        return nullptr;
+    value = v;
+    return i;
+}
+
+///
+/// Does [b, e) start with the given literal?
+///
+template<std::size_t N>
+static bool starts_with(const char *b, const char *e, const char (&lit)[N])
+{
+    return std::size_t(e - b) >= N - 1 &&
+        std::equal(lit, lit + N - 1, b);
+}
+
+///
+/// Parse X.Y.Z (without leading zeroes) from the start of [b, e)
+///
+/// Returns the end of the version, or a null pointer if there is none.
+///
+static const char *parse_xyz(const char *b, const char *e,
+                             number_type &mj, number_type &mn, number_type &pt)
+{
+    number_type *parts[] = {&mj, &mn, &pt};
+    for (std::size_t i = 0; i != 3; ++i)
+    {
+        if (i != 0) {
+            if (b == e || *b != '.')
+                return nullptr;
+            ++b;
+        }
+        const char *part_end = parse_number(b, e, *parts[i]);
+        // Semantic versions must not contain leading zeroes.
+        if (!part_end || (*b == '0' && part_end - b != 1))
+            return nullptr;
+        b = part_end;
+    }
+    return b;
+}
+
+///
+/// Parse a script number N from [b, e), after which only an underscore or a
+/// dot (and then anything) may follow
+///
+static bool parse_script_number(const char *b, const char *e,
+                                number_type &num)
+{
+    b = parse_number(b, e, num);
+    return b && (b == e || *b == '_' || *b == '.');
+}
+
+///
+/// Build the version X.Y.Z+script.N
+///
+static semver make_script_version(number_type mj, number_type mn,
+                                  number_type pt, number_type num)
+{
+    id_list bm_ids;
+    bm_ids.push_back({"script", false, 0});
+    bm_ids.push_back({std::to_string(num), true, num});
+    return semver{mj, mn, pt, id_list{}, std::move(bm_ids)};
+}
+
+semver parse_script_filename(const std::string &filename)
+{
+    // Several valid options:
+    // 1. Filename is X.Y.Z+script.N_foo.sql
+    // 2. Filename is X.Y.Z+script.N.sql
+    // The above should result in a semantic version of X.Y.Z+script.N
+    const char *b = filename.data();
+    const char *e = b + filename.size();
+    number_type mj, mn, pt, num;
+    
+    b = parse_xyz(b, e, mj, mn, pt);
+    if (!b || !starts_with(b, e, "+script.") ||
+        !parse_script_number(b + 8, e, num))
+        throw bad_toplevel_filename(filename);
+    
+    return make_script_version(mj, mn, pt, num);
+}
+
+semver parse_script_filename(const std::string &parent_dir_name,
+                             const std::string &filename)
+{
+    // Several valid options:
+    // 1. Dir is X.Y.Z, and filename is X.Y.Z+script.N_foo.sql
+    // 2. Dir is X.Y.Z, and filename is X.Y.Z+script.N.sql
+    // 3. Dir is X.Y.Z, and filename is script.N_foo.sql
+    // 4. Dir is X.Y.Z, and filename is script.N.sql
+    // 5. Dir is X.Y.Z, and filename is N_foo.sql
+    // 6. Dir is X.Y.Z, and filename is N.sql
+    // The above should result in a semantic version of X.Y.Z+script.N
+    const char *db = parent_dir_name.data();
+    const char *de = db + parent_dir_name.size();
+    number_type mj, mn, pt, num;
+    if (parse_xyz(db, de, mj, mn, pt) != de)
+        throw bad_subdir_filename(parent_dir_name + "/" + filename);
+    
+    const char *b = filename.data();
+    const char *e = b + filename.size();
+    
+    // The filename may repeat the directory's version.  If what follows that
+    // is no good, though, fall back to reading the filename as a whole, so
+    // that a filename such as "1.2.3+foo.sql" is still script 1.
+    const char *after_dir = b + parent_dir_name.size();
+    if (filename.size() > parent_dir_name.size() &&
+        std::equal(db, de, b) && *after_dir == '+')
+    {
+        const char *rest = after_dir + 1;
+        if (starts_with(rest, e, "script."))
+            rest += 7;
+        if (parse_script_number(rest, e, num))
+            return make_script_version(mj, mn, pt, num);
+    }
+    
+    if (starts_with(b, e, "script."))
+        b += 7;
+    if (!parse_script_number(b, e, num))
+        throw bad_subdir_filename(parent_dir_name + "/" + filename);
+    
+    return make_script_version(mj, mn, pt, num);
+}
+
+bool parse_script_dir_name(const std::string &dir_name, number_type &mj,
+                           number_type &mn, number_type &pt)
+{
+    const char *b = dir_name.data();
+    const char *e = b + dir_name.size();
+    number_type v[3];
+    if (parse_xyz(b, e, v[0], v[1], v[2]) != e)
+        return false;
+    mj = v[0];
+    mn = v[1];
+    pt = v[2];
+    return true;
+}
+
+} // dbmig namespace
@@ -0,0 +1,61 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_SCRIPT_FILENAME_INCLUDED
+#define DBMIG_SCRIPT_FILENAME_INCLUDED
+
+#include <string>
+#include "semantic_version.hpp"
+
+namespace dbmig
+{
+    ///
+    /// Extract the version of a script directly within a script directory
+    ///
+    /// The filename must be X.Y.Z+script.N, optionally followed by an
+    /// underscore and/or a dot and anything else (e.g. "_desc.sql").  The
+    /// result is X.Y.Z+script.N, with any leading zeroes removed from N.
+    ///
+    /// Throws bad_toplevel_filename if the filename is not of that form.
+    ///
+    semver parse_script_filename(const std::string &filename);
+    
+    ///
+    /// Extract the version of a script within a version sub-directory
+    ///
+    /// The directory name must be X.Y.Z, and the filename N, script.N or
+    /// X.Y.Z+script.N, optionally followed by an underscore and/or a dot
+    /// and anything else.  The result is X.Y.Z+script.N, with any leading
+    /// zeroes removed from N.
+    ///
+    /// Throws bad_subdir_filename if either name is not of that form.
+    ///
+    semver parse_script_filename(const std::string &parent_dir_name,
+                                 const std::string &filename);
+    
+    ///
+    /// Extract the version of a version sub-directory from its name
+    ///
+    /// The name must be X.Y.Z, which every script within the directory will
+    /// share.  Returns false, and leaves the parts untouched, if it is not.
+    ///
+    bool parse_script_dir_name(const std::string &dir_name, unsigned int &mj,
+                               unsigned int &mn, unsigned int &pt);
+}
+
+#endif // DBMIG_SCRIPT_FILENAME_INCLUDED
@@ -0,0 +1,207 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_index.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+
+#include "fs_encoding.hpp"
+
+using std::string;
+
+namespace dbmig {
+
+// First line of an index file, identifying its format.
+static const string index_header = "dbmig-script-index 1";
+
+// How recently a directory must have been modified for its time to be
+// considered unsafe to record.  As for the hash cache, this is generous
+// enough for filesystems with coarse timestamps.
+static const std::int64_t racy_window_ns = 2000000000;
+
+static const std::int64_t unknown_mtime = -1;
+
+///
+/// Parse [b, e) as a whole, as a signed decimal time.
+///
+static bool parse_mtime(const char *b, const char *e, std::int64_t &mtime_ns)
+{
+    bool negative = b != e && *b == '-';
+    if (negative)
+        ++b;
+    if (b == e)
+        return false;
+    std::int64_t v = 0;
+    for (; b != e; ++b) {
+        if (*b < '0' || *b > '9')
+            return false;
+        if (v > (std::numeric_limits<std::int64_t>::max() - (*b - '0')) / 10)
+            return false;
+        v = v * 10 + (*b - '0');
+    }
+    mtime_ns = negative ? -v : v;
+    return true;
+}
+
+///
+/// Split off the next line of [b, e), advancing b beyond it.
+///
+static bool next_line(const char *&b, const char *e,
+                      const char *&line_b, const char *&line_e)
+{
+    if (b == e)
+        return false;
+    line_b = b;
+    line_e = std::find(b, e, '\n');
+    b = line_e == e ? e : line_e + 1;
+    return true;
+}
+
+bool load_script_index(const string &path,
+                       const string &file_extension,
+                       script_index &index)
+{
+    // Read the whole index at once; it is read far more often than written,
+    // and is parsed in place.
+    nowide::ifstream ifs{path.c_str(), std::ios::binary};
+    if (!ifs)
+        return false;
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    string contents = oss.str();
+    
+    const char *b = contents.data();
+    const char *e = b + contents.size();
+    const char *lb, *le;
+    if (!next_line(b, e, lb, le) || string(lb, le) != index_header)
+        return false;
+    if (!next_line(b, e, lb, le) || string(lb, le) != file_extension)
+        return false;
+    if (!next_line(b, e, lb, le) || !parse_mtime(lb, le, index.root_mtime_ns))
+        return false;
+    
+    // Each remaining line is either a sub-directory ("D", mtime, name) or a
+    // script ("S", version, path), separated by tabs, with the name or path
+    // last so that it may contain anything but newlines.  Since a partial
+    // index would lose scripts, any malformed line spoils the whole index.
+    index.sub_dir_mtimes.clear();
+    index.scripts.clear();
+    index.scripts.reserve(std::count(b, e, '\n'));
+    string sub_dir;
+    while (next_line(b, e, lb, le)) {
+        if (le - lb < 2 || lb[1] != '\t')
+            return false;
+        const char *field = lb + 2;
+        const char *tab = std::find(field, le, '\t');
+        if (tab == le)
+            return false;
+        
+        if (lb[0] == 'D') {
+            std::int64_t mtime_ns;
+            if (!parse_mtime(field, tab, mtime_ns))
+                return false;
+            index.sub_dir_mtimes[string(tab + 1, le)] = mtime_ns;
+        }
+        else if (lb[0] == 'S') {
+            semver ver{0};
+            if (!semver::try_parse(field, tab, ver))
+                return false;
+            // A script within a sub-directory must belong to a recorded one.
+            typedef std::reverse_iterator<const char *> reverse;
+            const char *slash = std::find(reverse(le), reverse(tab + 1),
+                                          '/').base();
+            if (slash != tab + 1) {
+                sub_dir.assign(tab + 1, slash - 1);
+                if (!index.sub_dir_mtimes.count(sub_dir))
+                    return false;
+            }
+            index.scripts.emplace_back(std::move(ver), string(tab + 1, le));
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool save_script_index(const string &path,
+                       const string &file_extension,
+                       const std::int64_t root_mtime_ns,
+                       const mtime_map &sub_dir_mtimes,
+                       const script_dir::list_type &scripts)
+{
+    namespace fs = boost::filesystem;
+    using namespace std::chrono;
+    
+    auto now_ns = duration_cast<nanoseconds>(
+        system_clock::now().time_since_epoch()).count();
+    auto safe_mtime = [now_ns](std::int64_t mtime_ns)
+    {
+        return mtime_ns >= now_ns - racy_window_ns ? unknown_mtime : mtime_ns;
+    };
+    
+    // Names are stored one per line.
+    for (auto &kv : sub_dir_mtimes) {
+        if (kv.first.find('\n') != string::npos)
+            return false;
+    }
+    for (auto &script : scripts) {
+        if (script.second.find('\n') != string::npos)
+            return false;
+    }
+    
+    // Write to a temporary file in the same directory, so that it can then be
+    // renamed over the top of the index atomically.
+    fs::path p{utf8_to_fs<fs::path::value_type>(path)};
+    fs::path tmp = p;
+    tmp += fs::unique_path(".tmp-%%%%-%%%%-%%%%");
+    try {
+        {
+            nowide::ofstream ofs{fs_to_utf8(tmp.native()).c_str()};
+            ofs << index_header << '\n'
+                << file_extension << '\n'
+                << safe_mtime(root_mtime_ns) << '\n';
+            // Sub-directories first, so that they are known by the time
+            // their scripts are read back.
+            for (auto &kv : sub_dir_mtimes)
+                ofs << "D\t" << safe_mtime(kv.second) << '\t' << kv.first
+                    << '\n';
+            for (auto &script : scripts)
+                ofs << "S\t" << script.first << '\t' << script.second << '\n';
+            ofs.close();
+            if (!ofs)
+                throw std::runtime_error{"Cannot write script index"};
+        }
+        fs::rename(tmp, p);
+    }
+    catch (const std::exception &) {
+        boost::system::error_code ec;
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+} // dbmig namespace
@@ -0,0 +1,75 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_SCRIPT_INDEX_INCLUDED
+#define DBMIG_SCRIPT_INDEX_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "script_dir.hpp"
+
+namespace dbmig
+{
+    typedef std::unordered_map<std::string, std::int64_t> mtime_map;
+    
+    ///
+    /// The contents of a script directory, as recorded in its index file
+    ///
+    /// Alongside the scripts themselves (sorted by version), the index holds
+    /// the modification time of the root directory, and of each version
+    /// sub-directory and grouping directory (keyed by its path relative to
+    /// the root), when they were last listed.  Adding, removing or
+    /// renaming an entry within a directory changes its modification time,
+    /// so the scripts recorded for a directory whose time still matches are
+    /// still correct.  Unknown times are recorded as -1, which never matches.
+    ///
+    struct script_index
+    {
+        std::int64_t root_mtime_ns;
+        mtime_map sub_dir_mtimes;
+        script_dir::list_type scripts;
+    };
+    
+    ///
+    /// Load the index at the given (UTF-8) path
+    ///
+    /// Returns false if the index is missing, unreadable, malformed in any
+    /// way, or was recorded for a different file extension.
+    ///
+    bool load_script_index(const std::string &path,
+                           const std::string &file_extension,
+                           script_index &index);
+    
+    ///
+    /// Save an index to the given (UTF-8) path
+    ///
+    /// The index is written to a temporary file which is then renamed over
+    /// the top of any existing one.  Directories modified too recently for
+    /// their times to be trusted (on file systems with coarse timestamps,
+    /// they may change again without their times doing so) are recorded as
+    /// having unknown times.  Returns false if the index cannot be written.
+    ///
+    bool save_script_index(const std::string &path,
+                           const std::string &file_extension,
+                           const std::int64_t root_mtime_ns,
+                           const mtime_map &sub_dir_mtimes,
+                           const script_dir::list_type &scripts);
+}
+
+#endif // DBMIG_SCRIPT_INDEX_INCLUDED
@@ -0,0 +1,305 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_prefetch.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <boost/filesystem.hpp>
+
+#include "mapped_script.hpp"
+#include "bundle.hpp"
+#include "fs_encoding.hpp"
+
+using std::string;
+
+namespace dbmig {
+
+// Private impl class
+struct prepared_script::impl
+{
+    string path_;
+    string file_path_;
+    script_action action_;
+    bool streamed_;
+    // Only set for a script read from a directory.
+    std::unique_ptr<mapped_script> mapped_;
+    list_type statements_;
+    string sha256_sum_;
+    line_list lines_;
+};
+
+prepared_script::prepared_script(const repository &repo,
+                                 const script_action action,
+                                 const string &script_path,
+                                 const std::size_t max_bytes)
+    : pimpl_(new impl)
+{
+    auto &impl = *pimpl_;
+    impl.path_ = script_path;
+    impl.action_ = action;
+    impl.streamed_ = false;
+    
+    auto &dir = action == script_action::install
+        ? repo.install_script_path() : repo.upgrade_script_path();
+    auto bundled = repo.script_bundle();
+    if (bundled) {
+        impl.file_path_ = dir;
+        impl.statements_ = bundled->statements(action, script_path);
+        impl.sha256_sum_ = bundled->sha256_sum(action, script_path);
+        return;
+    }
+    
+    // This also throws a filesystem_error if the script does not exist.
+    namespace fs = boost::filesystem;
+    impl.file_path_ = dir + "/" + script_path;
+    fs::path p(utf8_to_fs<fs::path::value_type>(impl.file_path_));
+    if (fs::file_size(p) > max_bytes) {
+        impl.streamed_ = true;
+        return;
+    }
+    
+    impl.mapped_.reset(new mapped_script{impl.file_path_});
+    impl.statements_ = impl.mapped_->statements(action, impl.lines_);
+    impl.sha256_sum_ = impl.mapped_->sha256_sum();
+}
+
+prepared_script::prepared_script(prepared_script &&other) = default;
+
+prepared_script::~prepared_script() = default;
+
+const string &prepared_script::path() const
+{
+    return pimpl_->path_;
+}
+
+const string &prepared_script::file_path() const
+{
+    return pimpl_->file_path_;
+}
+
+script_action prepared_script::action() const
+{
+    return pimpl_->action_;
+}
+
+bool prepared_script::streamed() const
+{
+    return pimpl_->streamed_;
+}
+
+const prepared_script::list_type &prepared_script::statements() const
+{
+    return pimpl_->statements_;
+}
+
+const string &prepared_script::sha256_sum() const
+{
+    return pimpl_->sha256_sum_;
+}
+
+const prepared_script::line_list &prepared_script::lines() const
+{
+    return pimpl_->lines_;
+}
+
+
+// Private impl class
+struct script_prefetcher::impl
+{
+    impl(const repository &repo, const script_action action,
+         const std::vector<string> &script_paths,
+         const std::size_t depth, const std::size_t max_bytes);
+    ~impl();
+    
+    // A script prepared ahead, or else the error from preparing it.
+    struct slot
+    {
+        std::unique_ptr<prepared_script> script;
+        std::size_t bytes;
+        std::exception_ptr error;
+    };
+    
+    const repository &repo_;
+    const script_action action_;
+    const std::vector<string> script_paths_;
+    const std::size_t depth_;
+    const std::size_t max_bytes_;
+    // Only touched by the caller of next().
+    std::size_t taken_;
+    
+    // Guards everything below.
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<slot> prepared_;
+    std::size_t prepared_bytes_;
+    bool stopping_;
+    
+    std::thread preparer_;
+    
+    bool has_room() const;
+    void advise_will_need(const string &script_path) const;
+    void prepare_loop();
+};
+
+script_prefetcher::script_prefetcher(const repository &repo,
+                                     const script_action action,
+                                     const std::vector<string> &script_paths,
+                                     const std::size_t depth,
+                                     const std::size_t max_bytes)
+    : pimpl_(new impl(repo, action, script_paths, depth, max_bytes))
+{}
+
+script_prefetcher::~script_prefetcher() = default;
+
+///
+/// Take the next prepared script, waiting for it if necessary
+///
+prepared_script script_prefetcher::next()
+{
+    auto &impl = *pimpl_;
+    if (impl.taken_ == impl.script_paths_.size())
+        throw std::out_of_range{"every prepared script has been taken"};
+    
+    impl::slot s;
+    {
+        std::unique_lock<std::mutex> lock{impl.mutex_};
+        impl.changed_.wait(lock, [&]() { return !impl.prepared_.empty(); });
+        s = std::move(impl.prepared_.front());
+        impl.prepared_.pop_front();
+        impl.prepared_bytes_ -= s.bytes;
+    }
+    impl.changed_.notify_all();
+    ++impl.taken_;
+    
+    if (s.error) {
+        // Nothing after it was prepared.
+        impl.taken_ = impl.script_paths_.size();
+        std::rethrow_exception(s.error);
+    }
+    return std::move(*s.script);
+}
+
+script_prefetcher::impl::impl(const repository &repo,
+                              const script_action action,
+                              const std::vector<string> &script_paths,
+                              const std::size_t depth,
+                              const std::size_t max_bytes) :
+    repo_(repo), action_(action), script_paths_(script_paths),
+    depth_(depth > 0 ? depth : 1), max_bytes_(max_bytes), taken_(0),
+    prepared_bytes_(0), stopping_(false),
+    preparer_(&impl::prepare_loop, this)
+{}
+
+script_prefetcher::impl::~impl()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    preparer_.join();
+}
+
+///
+/// May another script be prepared?  The first is always allowed, since it
+/// can be no bigger than max_bytes; anything bigger is streamed instead.
+/// (Called with the mutex held.)
+///
+bool script_prefetcher::impl::has_room() const
+{
+    return prepared_.empty() ||
+        (prepared_.size() < depth_ && prepared_bytes_ < max_bytes_);
+}
+
+///
+/// Ask the kernel to start reading a script's file into the page cache, so
+/// that it is (more likely) there by the time the script is prepared.
+///
+void script_prefetcher::impl::advise_will_need(const string &script_path) const
+{
+#ifdef __linux__
+    if (repo_.script_bundle())
+        return;
+    auto &dir = action_ == script_action::install
+        ? repo_.install_script_path() : repo_.upgrade_script_path();
+    auto path = dir + "/" + script_path;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // Only a hint; any problem with the file is reported when it is
+        // mapped.
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+#else
+    (void)script_path;
+#endif
+}
+
+///
+/// Body of the background thread: prepare each script in turn, as room
+/// allows, until every script is prepared, one fails, or we are stopped.
+///
+void script_prefetcher::impl::prepare_loop()
+{
+    for (std::size_t i = 0; i < script_paths_.size(); ++i) {
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            changed_.wait(lock, [&]() { return stopping_ || has_room(); });
+            if (stopping_)
+                return;
+        }
+        
+        if (i + 1 < script_paths_.size())
+            advise_will_need(script_paths_[i + 1]);
+        
+        slot s;
+        s.bytes = 0;
+        try {
+            s.script.reset(new prepared_script{repo_, action_,
+                                               script_paths_[i], max_bytes_});
+            for (auto &statement : s.script->statements())
+                s.bytes += statement.size();
+        }
+        catch (...) {
+            s.error = std::current_exception();
+        }
+        
+        bool failed = static_cast<bool>(s.error);
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            prepared_bytes_ += s.bytes;
+            prepared_.push_back(std::move(s));
+        }
+        changed_.notify_all();
+        if (failed)
+            return;
+    }
+}
+
+
+} // dbmig namespace
@@ -0,0 +1,172 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_SCRIPT_PREFETCH_INCLUDED
+#define DBMIG_SCRIPT_PREFETCH_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/utility/string_ref.hpp>
+#include "script_action.hpp"
+#include "repository.hpp"
+
+namespace dbmig
+{
+    ///
+    /// A script of a repository, split into statements and hashed, ready to
+    /// be run
+    ///
+    /// A script read from a directory is memory-mapped (see mapped_script),
+    /// and its statements are views into the mapping, so they remain valid
+    /// for the lifetime of this object.  A script from a bundle takes its
+    /// pre-split statements from the bundle, so they remain valid for the
+    /// lifetime of the repository.
+    ///
+    /// A script read from a directory that is bigger than max_bytes is not
+    /// prepared at all, but left to be streamed from its file as it runs
+    /// (see streamed()), so that however big a script is, no more than its
+    /// largest statement need be held in memory.
+    ///
+    class prepared_script
+    {
+    public:
+        typedef boost::string_ref statement_type;
+        typedef std::vector<statement_type> list_type;
+        // First and last source lines (counting from one) of a statement.
+        typedef std::pair<std::size_t, std::size_t> line_range;
+        typedef std::vector<line_range> line_list;
+        
+        static const std::size_t default_max_bytes = 64 * 1024 * 1024;
+        
+        ///
+        /// Prepare the statements of the script at the given path (relative
+        /// to the repository's script directory for the action) that are
+        /// relevant to the action.
+        ///
+        prepared_script(const repository &repo,
+                        const script_action action,
+                        const std::string &script_path,
+                        const std::size_t max_bytes = default_max_bytes);
+        prepared_script(prepared_script &&other);
+        ~prepared_script();
+        
+        ///
+        /// The path of the script, relative to its script directory
+        ///
+        const std::string &path() const;
+        
+        ///
+        /// The full path of the script's file, or of the bundle it came from
+        ///
+        const std::string &file_path() const;
+        
+        ///
+        /// The action that the script was prepared for
+        ///
+        script_action action() const;
+        
+        ///
+        /// Was the script too big to prepare?  If so, it has no statements,
+        /// digest or lines here, and is instead to be read a statement at a
+        /// time from its file (see script_statement_stream).
+        ///
+        bool streamed() const;
+        
+        ///
+        /// The statements relevant to the action
+        ///
+        const list_type &statements() const;
+        
+        ///
+        /// The SHA256 digest of the whole script
+        ///
+        const std::string &sha256_sum() const;
+        
+        ///
+        /// The range of lines of the script that each statement came from,
+        /// or nothing if the script came from a bundle, which does not keep
+        /// the original layout of its scripts
+        ///
+        const line_list &lines() const;
+        
+    private:
+    
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+    
+    ///
+    /// Prepares a sequence of scripts on a background thread, ahead of their
+    /// being run
+    ///
+    /// Splitting and hashing a script is client CPU time only, so a migration
+    /// can prepare the next few scripts while the database is busy running
+    /// the current one.  At most depth scripts, and (beyond the first of
+    /// them) at most max_bytes of statements, are held prepared at once;
+    /// the thread waits for next() to take one before preparing any more.
+    /// A script bigger than max_bytes is never held prepared at all, but is
+    /// streamed as it runs (see prepared_script::streamed()).
+    /// On platforms that support it, the kernel is also asked to read ahead
+    /// the file of the script after the one being prepared.
+    ///
+    /// Scripts are taken from next() in the order given.  If preparing a
+    /// script fails, nothing after it is prepared, and the error is thrown
+    /// by the call to next() that would have returned that script, so that
+    /// everything before it can still be run first, just as if each script
+    /// were prepared only when it was needed.
+    ///
+    class script_prefetcher
+    {
+    public:
+        static const std::size_t default_depth = 4;
+        static const std::size_t default_max_bytes =
+            prepared_script::default_max_bytes;
+        
+        ///
+        /// Start preparing the scripts at the given paths, for the given
+        /// action, from the given repository (which must outlive this object)
+        ///
+        script_prefetcher(const repository &repo,
+                          const script_action action,
+                          const std::vector<std::string> &script_paths,
+                          const std::size_t depth = default_depth,
+                          const std::size_t max_bytes = default_max_bytes);
+        
+        ///
+        /// Stop preparing scripts, and wait for the background thread
+        ///
+        ~script_prefetcher();
+        
+        ///
+        /// Take the next prepared script, waiting for it if necessary
+        ///
+        /// Throws std::out_of_range once every script has been taken.
+        ///
+        prepared_script next();
+        
+    private:
+    
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+}
+
+#endif // DBMIG_SCRIPT_PREFETCH_INCLUDED
@@ -21,8 +21,12 @@
 
 #include <string>
 #include <istream>
+#include <iterator>
 #include <vector>
+#include <deque>
+#include <utility>
 #include "semantic_version.hpp"
+#include "script_action.hpp"
 #include "script_dir.hpp"
 #include "hash.hpp"
 #include "getline.hpp"
@@ -34,24 +38,41 @@ namespace dbmig
     const std::string script_partition_marker = "--//@UNDO";
     
     ///
-    /// Class representing a range of lines from a script
+    /// The statements in each partition of a script, along with its digest
     ///
-    class script_statements
+    /// An upgrade script is partitioned by the first line containing
+    /// script_partition_marker: the lines before it hold the upgrade
+    /// statements, and the lines after it hold the rollback statements.  An
+    /// install script is not partitioned, and all of its statements are
+    /// install statements.
+    ///
+    /// The digest always covers the whole script.  When rolling back, it is
+    /// therefore the hash of the script as a whole (rather than of just the
+    /// rollback part) that can be checked to ensure that the script has not
+    /// changed since it was applied to the database.
+    ///
+    class script_partitions
     {
     public:
         typedef std::vector<std::string> list_type;
-        typedef list_type::const_iterator iterator;
         
-        script_statements(const list_type &statements,
-                          const std::string sha256_sum) :
-            statements_(statements),
-            sha256_sum_(sha256_sum)
+        script_partitions(list_type &&forward_statements,
+                          list_type &&rollback_statements,
+                          std::string &&sha256_sum) :
+            forward_statements_(std::move(forward_statements)),
+            rollback_statements_(std::move(rollback_statements)),
+            sha256_sum_(std::move(sha256_sum))
         {}
-
-        /// Iterator pointing to the first statement
-        iterator begin() { return statements_.cbegin(); }
-        /// Iterator pointing beyond the last statement
-        iterator end()   { return statements_.cend();   }
+        
+        ///
+        /// The statements to run for a given action
+        ///
+        const list_type &statements(const script_action action) const
+        {
+            return action == script_action::rollback
+                ? rollback_statements_
+                : forward_statements_;
+        }
         
         const std::string &sha256_sum() const
         {
@@ -59,134 +80,311 @@ namespace dbmig
         }
         
     private:
-        // Store all lines pre-read.  Not efficient for large files!
-        const list_type statements_;
-        const std::string sha256_sum_;
+        // Store all statements pre-read.  Not efficient for large files!
+        // (see script_statement_stream for a lazily-evaluated alternative)
+        list_type forward_statements_;
+        list_type rollback_statements_;
+        std::string sha256_sum_;
     };
     
-    // TODO - split the "read_X_statements" functions into a separate header!
-    
     ///
-    /// Read statements from a stream in "install" mode
+    /// Lazily-evaluated, single-pass range of statements read from a stream
     ///
-    template<typename InputStream>
-    script_statements read_install_statements(InputStream &is)
+    /// Unlike read_script(), statements are parsed from the underlying stream
+    /// only as the range is iterated, so memory use is bounded by the largest
+    /// single statement rather than by the size of the whole script.  The
+    /// action determines which partition of the script is yielded.
+    ///
+    /// The SHA256 digest covers the whole stream, and so is only known once
+    /// the stream has been drained.  Calling sha256_sum() drains (and
+    /// discards) any statements that have not yet been iterated over.
+    ///
+    template <typename InputStream>
+    class script_statement_stream
     {
-        // Read all lines.
-        sha256_hash sum;
-        std::string line, line_ending;
-        script_statements::list_type statements;
-        auto stmt_buf = make_statement_buffer(std::back_inserter(statements));
+    public:
+        class iterator :
+            public std::iterator<std::input_iterator_tag, std::string>
+        {
+        public:
+            ///
+            /// Holds the value of an iterator prior to post-increment
+            ///
+            class postfix_proxy
+            {
+            public:
+                explicit postfix_proxy(const std::string &value) :
+                    value_(value)
+                {}
+                const std::string &operator*() const { return value_; }
+            private:
+                const std::string value_;
+            };
+            
+            iterator() : stream_(nullptr) {}
+            explicit iterator(script_statement_stream *stream) :
+                stream_(stream)
+            {
+                advance();
+            }
+            
+            const std::string &operator*() const { return stream_->current_; }
+            const std::string *operator->() const
+            {
+                return &stream_->current_;
+            }
+            iterator &operator++()
+            {
+                advance();
+                return *this;
+            }
+            postfix_proxy operator++(int)
+            {
+                postfix_proxy prev{stream_->current_};
+                advance();
+                return prev;
+            }
+            bool operator==(const iterator &other) const
+            {
+                return stream_ == other.stream_;
+            }
+            bool operator!=(const iterator &other) const
+            {
+                return stream_ != other.stream_;
+            }
+            
+        private:
+            void advance()
+            {
+                // Become the end iterator once the statements run out.
+                if (!stream_->fetch())
+                    stream_ = nullptr;
+            }
+            
+            script_statement_stream *stream_;
+        };
+        
+        script_statement_stream(InputStream &is, const script_action action) :
+            reader_(is),
+            action_(action),
+            after_marker_(false),
+            drained_(false),
+            stmt_buf_(std::back_inserter(pending_))
+        {}
+        
+        // The statement buffer refers back into this object.
+        script_statement_stream(const script_statement_stream &) = delete;
+        script_statement_stream &operator =(
+            const script_statement_stream &) = delete;
         
-        while (multiplatform_getline(is, line, line_ending))
+        /// Iterator pointing to the next unread statement
+        iterator begin() { return iterator{this}; }
+        /// Iterator pointing beyond the last statement
+        iterator end()   { return iterator{}; }
+        
+        ///
+        /// Get the digest of the whole stream, draining it if necessary.
+        ///
+        const std::string &sha256_sum()
         {
-            stmt_buf.append(line + "\n"); // Ok to sanitise line endings
+            while (!drained_)
+                read_line();
+            pending_.clear();
+            return sha256_sum_;
+        }
         
-            // Add lines (and ending) to hash.
-            sum.update(line);
-            sum.update(line_ending);
+    private:
+        
+        typedef std::deque<std::string> pending_list_type;
+        
+        ///
+        /// Move the next statement into current_, reading more as required.
+        ///
+        bool fetch()
+        {
+            while (pending_.empty() && !drained_)
+                read_line();
+            if (pending_.empty())
+                return false;
+            current_ = std::move(pending_.front());
+            pending_.pop_front();
+            return true;
         }
         
-        // Finalise anything left in the buffer.
-        stmt_buf.finalise();
+        ///
+        /// Read, hash and (if in the wanted partition) parse the next line.
+        ///
+        void read_line()
+        {
+            if (!reader_.getline(line_, line_ending_)) {
+                // Finalise anything left in the buffer, and the digest.
+                stmt_buf_.finalise();
+                sum_.finalise();
+                sum_.hex_encode(sha256_sum_);
+                drained_ = true;
+                return;
+            }
+            
+            // Add lines (and ending) to hash.
+            sum_.update(line_);
+            sum_.update(line_ending_);
+            
+            if (action_ != script_action::install && !after_marker_ &&
+                line_.find(script_partition_marker) != std::string::npos) {
+                // Upgrade statements stop, and rollback statements start,
+                // after the magic text.
+                after_marker_ = true;
+                return;
+            }
+            
+            bool wanted = action_ == script_action::install ||
+                after_marker_ == (action_ == script_action::rollback);
+            if (wanted)
+                stmt_buf_.append(line_ + "\n"); // Ok to sanitise line endings
+        }
         
-        // Calculate digest.
-        sum.finalise();
-        // Encode to hex.
-        std::string sum_hex;
-        sum.hex_encode(sum_hex);
-        return script_statements{statements, sum_hex};
-    }
-
+        line_reader<InputStream> reader_;
+        const script_action action_;
+        bool after_marker_;
+        bool drained_;
+        std::string line_, line_ending_;
+        std::string current_;
+        pending_list_type pending_;
+        statement_buffer<std::back_insert_iterator<pending_list_type>>
+            stmt_buf_;
+        sha256_hash sum_;
+        std::string sha256_sum_;
+    };
+    
     ///
-    /// Read statements from a stream in "upgrade" mode
+    /// Read all statements and the digest of a script in a single pass
+    ///
+    /// The action is that for which the script is intended: install scripts
+    /// are read whole, whereas upgrade (or rollback) scripts are partitioned
+    /// into both upgrade and rollback statements at once, so that a caller
+    /// needing both does not have to read the script twice.
     ///
     template<typename InputStream>
-    script_statements read_upgrade_statements(InputStream &is)
+    script_partitions read_script(InputStream &is, const script_action action)
     {
-        // Read all lines, up until we find the magic text.
+        line_reader<InputStream> reader{is};
         sha256_hash sum;
         std::string line, line_ending;
-        script_statements::list_type statements;
-        auto stmt_buf = make_statement_buffer(std::back_inserter(statements));
+        script_partitions::list_type forward, rollback;
+        auto forward_buf = make_statement_buffer(std::back_inserter(forward));
+        auto rollback_buf = make_statement_buffer(std::back_inserter(rollback));
+        bool after_marker = false;
         
-        // Record upgrade lines.
-        while (multiplatform_getline(is, line, line_ending))
+        while (reader.getline(line, line_ending))
         {
-            // Add to hash.
+            // Add lines (and ending) to hash.
             sum.update(line);
             sum.update(line_ending);
             
-            if (line.find(script_partition_marker) != std::string::npos)
-                break;
+            if (action != script_action::install && !after_marker &&
+                line.find(script_partition_marker) != std::string::npos) {
+                // Upgrade statements stop, and rollback statements start,
+                // after the magic text.
+                after_marker = true;
+                continue;
+            }
             
-            // Record the line.
-            stmt_buf.append(line + "\n");
-        }
-        // The remaining lines form part of the hash, but the statements there
-        // aren't parsed.
-        while (multiplatform_getline(is, line, line_ending))
-        {
-            // Add to hash.
-            sum.update(line);
-            sum.update(line_ending);
+            line += "\n"; // Ok to sanitise line endings
+            if (after_marker)
+                rollback_buf.append(line);
+            else
+                forward_buf.append(line);
         }
         
-        stmt_buf.finalise();
+        // Finalise anything left in the buffers.
+        forward_buf.finalise();
+        rollback_buf.finalise();
         
         // Calculate digest.
         sum.finalise();
         // Encode to hex.
         std::string sum_hex;
         sum.hex_encode(sum_hex);
-        return script_statements{statements, sum_hex};
+        return script_partitions{std::move(forward), std::move(rollback),
+                                 std::move(sum_hex)};
     }
-
+    
     ///
-    /// Read statements from a stream in "rollback" mode
+    /// Class representing the statements of a script relevant to one action
     ///
-    /// Note that the hash that is built up in rollback mode is actually
-    /// the hash of the 'upgrade' portion of the script.  This is because when
-    /// rolling back, it is beneficial to check that what the current script to
-    /// be rolled back has not changed from when it was applied to the database,
-    /// and the hash of the upgrade part is the way to make that check.
+    /// Kept for compatibility: read_script() yields every partition of a
+    /// script in one pass, without copying, and script_statement_stream
+    /// reads one statement at a time.
     ///
-    template<typename InputStream>
-    script_statements read_rollback_statements(InputStream &is)
+    class script_statements
     {
-        // Read all lines, from the magic text until the end.
-        sha256_hash sum;
-        std::string line, line_ending;
-        script_statements::list_type statements;
-        auto stmt_buf = make_statement_buffer(std::back_inserter(statements));
+    public:
+        typedef std::vector<std::string> list_type;
+        typedef list_type::const_iterator iterator;
         
-        while (multiplatform_getline(is, line, line_ending))
-        {
-            // Add to hash.
-            sum.update(line);
-            sum.update(line_ending);
-                
-            if (line.find(script_partition_marker) != std::string::npos)
-                break;
-        }
-        while (multiplatform_getline(is, line, line_ending))
+        script_statements(const list_type &statements,
+                          const std::string sha256_sum) :
+            statements_(statements),
+            sha256_sum_(sha256_sum)
+        {}
+
+        /// Iterator pointing to the first statement
+        iterator begin() { return statements_.cbegin(); }
+        /// Iterator pointing beyond the last statement
+        iterator end()   { return statements_.cend();   }
+        
+        const std::string &sha256_sum() const
         {
-            // Add to hash.
-            sum.update(line);
-            sum.update(line_ending);
-            
-            // Record the line.
-            stmt_buf.append(line + "\n");
+            return sha256_sum_;
         }
         
-        stmt_buf.finalise();
-        
-        // Calculate digest.
-        sum.finalise();
-        // Encode to hex.
-        std::string sum_hex;
-        sum.hex_encode(sum_hex);
-        return script_statements{statements, sum_hex};
+    private:
+        const list_type statements_;
+        const std::string sha256_sum_;
+    };
+    
+    ///
+    /// Read the statements of a script relevant to an action, as
+    /// read_script() does, keeping only those statements
+    ///
+    template<typename InputStream>
+    script_statements read_statements(InputStream &is,
+                                      const script_action action)
+    {
+        auto script = read_script(is, action);
+        return script_statements{script.statements(action),
+                                 script.sha256_sum()};
+    }
+    
+    ///
+    /// Read statements from a stream in "install" mode
+    ///
+    template<typename InputStream>
+    script_statements read_install_statements(InputStream &is)
+    {
+        return read_statements(is, script_action::install);
+    }
+    
+    ///
+    /// Read statements from a stream in "upgrade" mode
+    ///
+    template<typename InputStream>
+    script_statements read_upgrade_statements(InputStream &is)
+    {
+        return read_statements(is, script_action::upgrade);
+    }
+    
+    ///
+    /// Read statements from a stream in "rollback" mode
+    ///
+    /// As with read_script(), the digest is that of the whole script, so
+    /// that it can be checked against the hash recorded when the script was
+    /// applied.
+    ///
+    template<typename InputStream>
+    script_statements read_rollback_statements(InputStream &is)
+    {
+        return read_statements(is, script_action::rollback);
     }
 }
 
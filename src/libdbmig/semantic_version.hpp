@@ -21,10 +21,12 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <vector>
+#include <utility>
+#include <boost/container/small_vector.hpp>
 
 namespace dbmig
 {
@@ -50,7 +52,15 @@ namespace dbmig
             }
         };
     
-        typedef std::vector<appended_identifier_part> id_list;
+        ///
+        /// List of dot-separated identifiers
+        ///
+        /// Script versions carry exactly two build metadata identifiers
+        /// (e.g. "script.12") and usually no pre-release ones, so that many
+        /// are held inline without a separate allocation.
+        ///
+        typedef boost::container::small_vector<appended_identifier_part, 2>
+            id_list;
     
     private:
     
@@ -96,6 +106,14 @@ namespace dbmig
             str_expr_(""), pr_str_expr_(""), bm_str_expr_("")
         {}
         
+        semantic_version(
+            Tn mj, Tn mn, Tn pt,
+            id_list &&pr_ids, id_list &&bm_ids) :
+            mj_(mj), mn_(mn), pt_(pt),
+            pr_ids_(std::move(pr_ids)), bm_ids_(std::move(bm_ids)),
+            str_expr_(""), pr_str_expr_(""), bm_str_expr_("")
+        {}
+        
         /**
             Copy constructor
         */
@@ -120,17 +138,51 @@ namespace dbmig
             return *this;
         }
         
-        // TODO -implement move constructor and move assignment if C++11
+        /**
+            Move constructor
+            
+            The moved-from version is left as zero.
+        */
+        semantic_version(semantic_version &&sv) noexcept :
+            mj_(sv.mj_), mn_(sv.mn_), pt_(sv.pt_),
+            pr_ids_(std::move(sv.pr_ids_)), bm_ids_(std::move(sv.bm_ids_)),
+            str_expr_(std::move(sv.str_expr_)),
+            pr_str_expr_(std::move(sv.pr_str_expr_)),
+            bm_str_expr_(std::move(sv.bm_str_expr_))
+        {
+            sv.reset();
+        }
+        
+        /**
+            Move assignment
+            
+            The moved-from version is left as zero.
+        */
+        semantic_version &operator =(semantic_version &&v) noexcept
+        {
+            if (this == &v)
+                return *this;
+            mj_ = v.mj_;
+            mn_ = v.mn_;
+            pt_ = v.pt_;
+            pr_ids_ = std::move(v.pr_ids_);
+            bm_ids_ = std::move(v.bm_ids_);
+            str_expr_ = std::move(v.str_expr_);
+            pr_str_expr_ = std::move(v.pr_str_expr_);
+            bm_str_expr_ = std::move(v.bm_str_expr_);
+            v.reset();
+            return *this;
+        }
         
     private:
         
-        // ctor used only internally by parse() method.
-        semantic_version(
-            Tn mj, Tn mn, Tn pt,
-            id_list pr_ids, id_list bm_ids) :
-            mj_(mj), mn_(mn), pt_(pt), pr_ids_(pr_ids), bm_ids_(bm_ids),
-            str_expr_(""), pr_str_expr_(""), bm_str_expr_("")
-        {}
+        void reset()
+        {
+            mj_ = mn_ = pt_ = 0;
+            pr_ids_.clear();
+            bm_ids_.clear();
+            set_dirty();
+        }
         
     public:
         
@@ -151,7 +203,7 @@ namespace dbmig
         ///
         /// A semantic version representing zero, i.e. no version
         ///
-        static const semantic_version<Tn, Ts> zero()
+        static semantic_version<Tn, Ts> zero()
         {
             return semantic_version<Tn, Ts>{0, 0, 0};
         }
@@ -164,122 +216,201 @@ namespace dbmig
         /// number is incremented after this release is dependent on this public
         /// API and how it changes.
         ///
-        static const semantic_version<Tn, Ts> initial_public_api()
+        static semantic_version<Tn, Ts> initial_public_api()
         {
             return semantic_version<Tn, Ts>{1, 0, 0};
         }
         
     private:
     
-        static Tn parse_numerical_version_part(
-                const Ts &version_part_str)
+        typedef typename Ts::value_type char_type;
+        
+        // The parsing functions below report a problem by returning a
+        // description of it, or a null pointer if there is none, so that a
+        // parse which fails need not throw.  Only the public wrappers turn
+        // problems into exceptions, attaching the offending input as they do.
+        
+        static bool is_digit(char_type c)
+        {
+            return c >= '0' && c <= '9';
+        }
+        
+        static bool is_identifier_char(char_type c)
+        {
+            // Deliberately not std::isalnum(), which depends on the locale.
+            return is_digit(c) || (c >= 'A' && c <= 'Z') ||
+                (c >= 'a' && c <= 'z') || c == '-';
+        }
+        
+        static const char *parse_numerical_version_part(
+                const char_type *b, const char_type *e, Tn &value)
         {
             // From the semver 2.0.0 specification, clause 2:
             // A normal version number MUST take the form X.Y.Z where X, Y, and
             // Z are non-negative integers, and MUST NOT contain leading zeroes.
             
-            if (version_part_str == "")
-                throw std::domain_error("Version part must not be empty");
-            if (version_part_str[0] == '0' && version_part_str.length() != 1)
-                throw std::domain_error("Version part must not contain leading zeroes - got: " + version_part_str);
-            for (typename Ts::const_iterator i = version_part_str.begin();
-                i != version_part_str.end(); ++i)
+            if (b == e)
+                return "Version part must not be empty";
+            if (*b == '0' && e - b != 1)
+                return "Version part must not contain leading zeroes";
+            Tn v = 0;
+            for (const char_type *i = b; i != e; ++i)
             {
-                if (!isdigit(*i))
-                    throw std::domain_error("Version part must be a non-negative integer - got: " + version_part_str);
+                if (!is_digit(*i))
+                    return "Version part must be a non-negative integer";
+                Tn digit = static_cast<Tn>(*i - '0');
+                if (v > (std::numeric_limits<Tn>::max() - digit) / 10)
+                    return "Version part is too large";
+                v = v * 10 + digit;
             }
-
-            return atoi(version_part_str.c_str());
+            value = v;
+            return nullptr;
         }
         
-        static id_list parse_prerelease_str(const Ts &prerelease_str)
+        static const char *parse_identifiers(
+                const char_type *b, const char_type *e, bool prerelease,
+                id_list &ids)
         {
-            // From the semver 2.0.0 specification, clause 9:
+            // From the semver 2.0.0 specification, clauses 9 and 10:
             // A pre-release version MAY be denoted by appending a hyphen and
             // a series of dot separated identifiers immediately following the
             // patch version.
+            // Build metadata MAY be denoted by appending a plus sign and a
+            // series of dot separated identifiers immediately following the
+            // patch or pre-release version.
             // Identifiers MUST comprise only ASCII alphanumerics and hyphen
             // [0-9A-Za-z-].
             // Identifiers MUST NOT be empty.
-            // Numeric identifiers MUST NOT include leading zeroes.
-            id_list v;
-            if (prerelease_str == "")
-                return v;
-
-            // Handle situation where input string ends in a dot.  This won't
-            // get caught by the std::getline() loop.
-            if (prerelease_str[prerelease_str.length() - 1] == '.')
-                throw std::domain_error("Dot-separated pre-release version parts must not be empty - got: " + prerelease_str);
-
-            appended_identifier_part aip;
-            std::stringstream ss(prerelease_str);
-            for (
-                std::getline(ss, aip.str_value, '.');
-                (ss.rdstate() & std::stringstream::failbit) == 0;
-                std::getline(ss, aip.str_value, '.'))
+            // Numeric identifiers (of a pre-release) MUST NOT include leading
+            // zeroes.
+            ids.clear();
+            if (b == e)
+                return nullptr;
+            
+            for (;;)
             {
-                if (aip.str_value == "")
-                    throw std::domain_error("Dot-separated pre-release version parts must not be empty - got: " + prerelease_str);
+                const char_type *dot = std::find(b, e, '.');
+                if (dot == b)
+                    return prerelease
+                        ? "Dot-separated pre-release version parts must not be empty"
+                        : "Dot-separated build metadata parts must not be empty";
+                
+                appended_identifier_part aip;
                 aip.is_numeric = true;
-                for (typename Ts::const_iterator i = aip.str_value.begin();
-                    i != aip.str_value.end(); ++i)
+                aip.numeric_value = 0;
+                for (const char_type *i = b; i != dot; ++i)
                 {
-                    if (!isalnum(*i) && *i != '-')
-                        throw std::domain_error("Dot-separated pre-release version parts must comprise only ASCII alphanumerics and hyphen - got: " + prerelease_str);
-                    if (!isdigit(*i))
+                    if (!is_identifier_char(*i))
+                        return prerelease
+                            ? "Dot-separated pre-release version parts must comprise only ASCII alphanumerics and hyphen"
+                            : "Dot-separated build metadata parts must comprise only ASCII alphanumerics and hyphen";
+                    if (!is_digit(*i))
                         aip.is_numeric = false;
                 }
                 if (aip.is_numeric)
                 {
-                    if (aip.str_value.length() > 1 && aip.str_value[0] == '0')
-                        throw std::domain_error("Dot-separated numeric pre-release version parts must not include leading zeroes - got: " + prerelease_str);
-                    aip.numeric_value = atoi(aip.str_value.c_str());
+                    if (prerelease && dot - b > 1 && *b == '0')
+                        return "Dot-separated numeric pre-release version parts must not include leading zeroes";
+                    // Numeric identifiers have no upper limit (think of
+                    // timestamps), so saturate rather than overflow.
+                    for (const char_type *i = b; i != dot; ++i)
+                    {
+                        Tn digit = static_cast<Tn>(*i - '0');
+                        if (aip.numeric_value >
+                            (std::numeric_limits<Tn>::max() - digit) / 10)
+                        {
+                            aip.numeric_value = std::numeric_limits<Tn>::max();
+                            break;
+                        }
+                        aip.numeric_value = aip.numeric_value * 10 + digit;
+                    }
                 }
-                v.push_back(aip);
+                aip.str_value.assign(b, dot);
+                ids.push_back(std::move(aip));
+                
+                if (dot == e)
+                    return nullptr;
+                b = dot + 1;
             }
-            return v;
         }
         
-        static id_list parse_build_metadata_str(const Ts &build_metadata_str)
+        static const char *parse_parts(
+                const char_type *b, const char_type *e, semantic_version &v)
         {
-            // From the semver 2.0.0 specification, clause 10:
-            // Build metadata MAY be denoted by appending a plus sign and a
-            // series of dot separated identifiers immediately following the
-            // patch or pre-release version.
-            // Identifiers MUST comprise only ASCII alphanumerics and hyphen
-            // [0-9A-Za-z-].
-            // Identifiers MUST NOT be empty.
-            id_list v;
-            if (build_metadata_str == "")
-                return v;
+            if (b == e)
+                return "Input string cannot be empty";
             
-            // Handle situation where input string ends in a dot.  This won't
-            // get caught by the std::getline() loop.
-            if (build_metadata_str[build_metadata_str.length() - 1] == '.')
-                throw std::domain_error("Dot-separated build metadata version parts must not be empty - got: " + build_metadata_str);
-
-            appended_identifier_part aip;
-            std::stringstream ss(build_metadata_str);
-            for (
-                std::getline(ss, aip.str_value, '.');
-                (ss.rdstate() & std::stringstream::failbit) == 0;
-                std::getline(ss, aip.str_value, '.'))
+            // Major version part.
+            const char_type *dot = std::find(b, e, '.');
+            if (dot == e)
+                return "No dots '.' found in input string - "
+                    "a normal version number MUST take the form X.Y.Z";
+            if (auto err = parse_numerical_version_part(b, dot, v.mj_))
+                return err;
+            
+            // Minor version part.
+            b = dot + 1;
+            dot = std::find(b, e, '.');
+            if (dot == e)
+                return "No second dot '.' found in input string - "
+                    "a normal version number MUST take the form X.Y.Z";
+            if (auto err = parse_numerical_version_part(b, dot, v.mn_))
+                return err;
+            
+            // The patch part ends at the start of the pre-release or build
+            // metadata, if present.  A hyphen within the build metadata
+            // does not start a pre-release.
+            b = dot + 1;
+            const char_type *bm = std::find(b, e, '+');
+            const char_type *pr = std::find(b, bm, '-');
+            if (auto err = parse_numerical_version_part(b, pr, v.pt_))
+                return err;
+            
+            if (pr != bm)
             {
-                if (aip.str_value == "")
-                    throw std::domain_error("Dot-separated build metadata parts must not be empty - got: " + build_metadata_str);
-                aip.is_numeric = true;
-                for (typename Ts::const_iterator i = aip.str_value.begin();
-                    i != aip.str_value.end(); ++i)
-                {
-                    if (!isalnum(*i) && *i != '-')
-                        throw std::domain_error("Dot-separated build metadata parts must comprise only ASCII alphanumerics and hyphen - got: " + build_metadata_str);
-                    if (!isdigit(*i))
-                        aip.is_numeric = false;
-                }
-                if (aip.is_numeric)
-                    aip.numeric_value = atoi(aip.str_value.c_str());
-                v.push_back(aip);
+                if (pr + 1 == bm)
+                    return "If a pre-release is indicated with a hyphen, "
+                        "it cannot be empty";
+                if (auto err = parse_identifiers(pr + 1, bm, true, v.pr_ids_))
+                    return err;
             }
+            if (bm != e)
+            {
+                if (bm + 1 == e)
+                    return "If build metadata is indicated with a plus sign, "
+                        "it cannot be empty";
+                if (auto err = parse_identifiers(bm + 1, e, false, v.bm_ids_))
+                    return err;
+            }
+            return nullptr;
+        }
+        
+        static void throw_parse_error(const char *err,
+                                      const char_type *b, const char_type *e)
+        {
+            std::string msg{err};
+            if (b != e)
+                msg.append(" - got: ").append(b, e);
+            throw std::domain_error(msg);
+        }
+        
+        static id_list parse_prerelease_str(const Ts &prerelease_str)
+        {
+            id_list v;
+            auto b = prerelease_str.data();
+            auto e = b + prerelease_str.size();
+            if (auto err = parse_identifiers(b, e, true, v))
+                throw_parse_error(err, b, e);
+            return v;
+        }
+        
+        static id_list parse_build_metadata_str(const Ts &build_metadata_str)
+        {
+            id_list v;
+            auto b = build_metadata_str.data();
+            auto e = b + build_metadata_str.size();
+            if (auto err = parse_identifiers(b, e, false, v))
+                throw_parse_error(err, b, e);
             return v;
         }
         
@@ -318,78 +449,31 @@ namespace dbmig
         */
         static semantic_version parse(const Ts &version_str)
         {
-            Ts mj_str, mn_str, pt_str, pr_str, bm_str;
-            if (version_str == "")
-                throw std::domain_error("Input string cannot be empty");
-            
-            // NOTE: at the time of coding, <regex> isn't fully supported on
-            // available compilers (e.g. Ubuntu 12.04 LTS only provides GCC 4.7)
-            // so we're doing it the hard way.
-            std::stringstream ss(version_str);
-            
-            // Look for the first dot (major version part).
-            std::getline(ss, mj_str, '.');
-            if (ss.rdstate() & std::stringstream::eofbit)
-            {
-                throw std::domain_error(
-                    "No dots '.' found in input string - "
-                    "a normal version number MUST take the form X.Y.Z");
-            }
-            Tn mj = parse_numerical_version_part(mj_str);
-            
-            // Look for the first dot (minor version part).
-            std::getline(ss, mn_str, '.');
-            if (ss.rdstate() & std::stringstream::eofbit)
-            {
-                throw std::domain_error(
-                    "No second dot '.' found in input string - "
-                    "a normal version number MUST take the form X.Y.Z");
-            }
-            Tn mn = parse_numerical_version_part(mn_str);
-            
-            // Go to the end now, and parse the rest in a different way, since
-            // we can't be certain of a fixed delimiter anymore.
-            Ts ptprbm_str;
-            std::getline(ss, ptprbm_str);
-            size_t pr_pos = ptprbm_str.find('-');
-            size_t bm_pos = ptprbm_str.find('+');
-            if (pr_pos != Ts::npos && bm_pos != Ts::npos)
-            {
-                // Patch, pre-release, and build metadata are all present.
-                pt_str = ptprbm_str.substr(0, pr_pos);
-                pr_str = ptprbm_str.substr(pr_pos + 1, bm_pos - pr_pos - 1);
-                bm_str = ptprbm_str.substr(bm_pos + 1);
-                if (pr_str == "")
-                    throw std::domain_error("If a pre-release is indicated with a hyphen, it cannot be empty");
-                if (bm_str == "")
-                    throw std::domain_error("If build metadata is indicated with a plus sign, it cannot be empty");
-            }
-            else if (pr_pos != Ts::npos)
-            {
-                // Patch and pre-release are present, but no build metadata.
-                pt_str = ptprbm_str.substr(0, pr_pos);
-                pr_str = ptprbm_str.substr(pr_pos + 1);
-                if (pr_str == "")
-                    throw std::domain_error("If a pre-release is indicated with a hyphen, it cannot be empty");
-            }
-            else if (bm_pos != Ts::npos)
-            {
-                // Patch and build metadata are present, but no pre-release.
-                pt_str = ptprbm_str.substr(0, bm_pos);
-                bm_str = ptprbm_str.substr(bm_pos + 1);
-                if (bm_str == "")
-                    throw std::domain_error("If build metadata is indicated with a plus sign, it cannot be empty");
-            }
-            else
-            {
-                // Patch is present, but no pre-release or build metadata.
-                pt_str = ptprbm_str;
-            }
-            Tn pt = parse_numerical_version_part(pt_str);
-            id_list pr_ids = parse_prerelease_str(pr_str);
-            id_list bm_ids = parse_build_metadata_str(bm_str);
-
-            return semantic_version(mj, mn, pt, pr_ids, bm_ids);
+            return parse(version_str.data(),
+                         version_str.data() + version_str.size());
+        }
+        static semantic_version parse(const char_type *b, const char_type *e)
+        {
+            semantic_version v{0};
+            if (auto err = parse_parts(b, e, v))
+                throw_parse_error(err, b, e);
+            return v;
+        }
+        
+        /**
+            Parse a version as parse() does, but report failure by return
+            value rather than by throwing std::domain_error.  On failure, v
+            is left unspecified, and error (if not null) is set to a
+            description of the problem.
+        */
+        static bool try_parse(const char_type *b, const char_type *e,
+                              semantic_version &v, const char **error = nullptr)
+        {
+            v = semantic_version{0};
+            const char *err = parse_parts(b, e, v);
+            if (error)
+                *error = err;
+            return err == nullptr;
         }
         
         /**
@@ -19,6 +19,7 @@
 #ifndef DBMIG_SEMVER_COMPARE_INCLUDED
 #define DBMIG_SEMVER_COMPARE_INCLUDED
 
+#include <cstdint>
 #include "semantic_version.hpp"
 
 namespace dbmig
@@ -41,12 +42,151 @@ namespace dbmig
         high
     };
     
+    ///
+    /// Compact, precomputed ordering key for the version of a script
+    ///
+    /// Script versions almost always take the form X.Y.Z+script.N, and the
+    /// versions they are compared against are usually either those or plain
+    /// X.Y.Z versions.  For both forms, the key packs the four numbers into
+    /// a pair of integers, so that ordering and equality need never look at
+    /// the identifier lists of the versions themselves.  Any other form (with
+    /// a pre-release, or other build metadata) cannot be packed, and versions
+    /// of that form must be compared in full.
+    ///
+    struct script_key
+    {
+        enum class form : unsigned char
+        {
+            script, // X.Y.Z+script.N
+            plain,  // X.Y.Z
+            other   // Anything else
+        };
+        
+        explicit script_key(const semver &v) :
+            mj_mn((std::uint64_t(v.mj()) << 32) | std::uint32_t(v.mn())),
+            pt_num(std::uint64_t(v.pt()) << 32),
+            kind(form::other)
+        {
+            auto &bm_ids = v.bm_ids();
+            if (!v.pr_ids().empty())
+                return;
+            if (bm_ids.empty()) {
+                kind = form::plain;
+            }
+            else if (bm_ids.size() == 2 && bm_ids[1].is_numeric &&
+                     bm_ids[0].str_value == "script") {
+                kind = form::script;
+                pt_num |= std::uint32_t(bm_ids[1].numeric_value);
+            }
+        }
+        
+        bool packed() const { return kind != form::other; }
+        
+        ///
+        /// Compare X.Y.Z of two packed keys.
+        ///
+        int compare_xyz(const script_key &other) const
+        {
+            if (mj_mn != other.mj_mn)
+                return mj_mn < other.mj_mn ? -1 : 1;
+            auto pt = pt_num >> 32, other_pt = other.pt_num >> 32;
+            if (pt != other_pt)
+                return pt < other_pt ? -1 : 1;
+            return 0;
+        }
+        
+        ///
+        /// Compare the script numbers of two packed keys.
+        ///
+        int compare_num(const script_key &other) const
+        {
+            std::uint32_t num = pt_num, other_num = other.pt_num;
+            if (num != other_num)
+                return num < other_num ? -1 : 1;
+            return 0;
+        }
+        
+        ///
+        /// Compare two packed keys as semver::metadata_compare would.
+        ///
+        int metadata_compare_to(const script_key &other) const
+        {
+            int val = compare_xyz(other);
+            if (val != 0)
+                return val;
+            if (kind == form::script && other.kind == form::script)
+                return compare_num(other);
+            if (kind == other.kind)
+                return 0;
+            // Build metadata is compared like a pre-release, so that the
+            // version with any at all has the lower precedence.
+            return kind == form::script ? -1 : 1;
+        }
+        
+        ///
+        /// Compare two packed keys as semver_script_compare would.
+        ///
+        template<non_script_alignment Alignment>
+        int script_compare_to(const script_key &other) const
+        {
+            int val = compare_xyz(other);
+            if (val != 0)
+                return val;
+            if (kind == form::script && other.kind == form::script)
+                return compare_num(other);
+            if (kind == other.kind)
+                return 0;
+            // A plain version sits below (low) or above (high) any scripts
+            // of the same X.Y.Z.
+            bool low = Alignment == non_script_alignment::low;
+            return (kind == form::plain) == low ? -1 : 1;
+        }
+        
+        bool operator==(const script_key &other) const
+        {
+            return mj_mn == other.mj_mn && pt_num == other.pt_num &&
+                kind == other.kind;
+        }
+        
+        std::uint64_t mj_mn;  // major << 32 | minor
+        std::uint64_t pt_num; // patch << 32 | script number
+        form kind;
+    };
+    
+    ///
+    /// Order semvers, with a key for each, as semver::metadata_compare would
+    ///
+    /// The versions themselves are only consulted if either key is unpacked.
+    ///
+    struct script_key_metadata_compare
+    {
+        bool operator()(const script_key &ka, const semver &a,
+                        const script_key &kb, const semver &b) const {
+            if (ka.packed() && kb.packed())
+                return ka.metadata_compare_to(kb) < 0;
+            return semver::metadata_compare{}(a, b);
+        }
+    };
+    
     template<non_script_alignment Alignment>
     struct semver_script_compare
     {
         semver::strict_compare cmp;
         semver::identifier_part_compare pcmp;
         
+        ///
+        /// Compare semvers, along with a precomputed key for each.
+        ///
+        /// The versions themselves are only consulted if either key is
+        /// unpacked.
+        ///
+        bool operator()(const script_key &ka, const semver &a,
+                        const script_key &kb, const semver &b) const {
+            if (ka.packed() && kb.packed())
+                return ka.script_compare_to<Alignment>(kb) < 0;
+            return (*this)(a, b);
+        }
+        
         bool operator()(const semver &a, const semver &b) const {
             // Try a strict comparison first.
             auto val = cmp.compare_to(a, b);
@@ -0,0 +1,301 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sha256_backend.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Hardware SHA256 relies on the GCC/Clang target attribute, so that the
+// instructions can be used without requiring them of every CPU.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DBMIG_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define DBMIG_SHA256_ARM
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace dbmig {
+
+#if defined(DBMIG_SHA256_X86) || defined(DBMIG_SHA256_ARM)
+
+// Round constants.
+static const std::uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#endif
+
+#ifdef DBMIG_SHA256_X86
+
+static bool detect_hardware()
+{
+    // SHA (leaf 7, EBX bit 29), plus SSSE3 and SSE4.1 (leaf 1, ECX bits 9
+    // and 19) for the shuffles and blends around it.
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    bool ssse3 = (ecx & (1u << 9)) != 0;
+    bool sse41 = (ecx & (1u << 19)) != 0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+    bool sha = (ebx & (1u << 29)) != 0;
+    return sha && ssse3 && sse41;
+}
+
+#define DBMIG_SHA256_X86_TARGET \
+    __attribute__((target("sha,sse4.1,ssse3")))
+
+///
+/// Derive the next four message words from the previous sixteen.
+///
+DBMIG_SHA256_X86_TARGET __attribute__((always_inline))
+static inline __m128i schedule(__m128i w0, __m128i w1, __m128i w2, __m128i w3)
+{
+    __m128i w = _mm_sha256msg1_epu32(w0, w1);
+    w = _mm_add_epi32(w, _mm_alignr_epi8(w3, w2, 4));
+    return _mm_sha256msg2_epu32(w, w3);
+}
+
+///
+/// Perform four rounds, using the given message words.
+///
+DBMIG_SHA256_X86_TARGET __attribute__((always_inline))
+static inline void rounds(__m128i &state0, __m128i &state1, __m128i w, int i)
+{
+    __m128i msg = _mm_add_epi32(w, _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(k + 4 * i)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    msg = _mm_shuffle_epi32(msg, 0x0e);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+}
+
+///
+/// Compress whole blocks using the x86 SHA extensions.
+///
+/// The state is kept in the ABEF/CDGH arrangement that the instructions
+/// expect.
+///
+DBMIG_SHA256_X86_TARGET
+static void compress(std::uint32_t state[8], const unsigned char *data,
+                     std::size_t num_blocks)
+{
+    const __m128i byte_swap = _mm_set_epi64x(
+        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+    __m128i state1 = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);              // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1b);        // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);     // CDGH
+    
+    for (; num_blocks != 0; --num_blocks, data += 64) {
+        const __m128i abef = state0, cdgh = state1;
+        auto p = reinterpret_cast<const __m128i *>(data);
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128(p), byte_swap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), byte_swap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), byte_swap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), byte_swap);
+        rounds(state0, state1, w0, 0);
+        rounds(state0, state1, w1, 1);
+        rounds(state0, state1, w2, 2);
+        rounds(state0, state1, w3, 3);
+        for (int i = 4; i < 16; i += 4) {
+            w0 = schedule(w0, w1, w2, w3);
+            rounds(state0, state1, w0, i);
+            w1 = schedule(w1, w2, w3, w0);
+            rounds(state0, state1, w1, i + 1);
+            w2 = schedule(w2, w3, w0, w1);
+            rounds(state0, state1, w2, i + 2);
+            w3 = schedule(w3, w0, w1, w2);
+            rounds(state0, state1, w3, i + 3);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    
+    tmp = _mm_shuffle_epi32(state0, 0x1b);        // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xb1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), state1);
+}
+
+#elif defined(DBMIG_SHA256_ARM)
+
+static bool detect_hardware()
+{
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+
+///
+/// Compress whole blocks using the ARMv8 SHA2 instructions.
+///
+__attribute__((target("+crypto")))
+static void compress(std::uint32_t state[8], const unsigned char *data,
+                     std::size_t num_blocks)
+{
+    uint32x4_t state0 = vld1q_u32(state);
+    uint32x4_t state1 = vld1q_u32(state + 4);
+    
+    for (; num_blocks != 0; --num_blocks, data += 64) {
+        const uint32x4_t abcd = state0, efgh = state1;
+        uint32x4_t w[4];
+        for (int i = 0; i < 16; ++i) {
+            uint32x4_t wi;
+            if (i < 4) {
+                wi = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+            }
+            else {
+                // w[i & 3] holds words i-4, and so on round the ring.
+                wi = vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]);
+                wi = vsha256su1q_u32(wi, w[(i + 2) & 3], w[(i + 3) & 3]);
+            }
+            w[i & 3] = wi;
+            
+            uint32x4_t msg = vaddq_u32(wi, vld1q_u32(k + 4 * i));
+            uint32x4_t prev0 = state0;
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, prev0, msg);
+        }
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+    
+    vst1q_u32(state, state0);
+    vst1q_u32(state + 4, state1);
+}
+
+#else
+
+static bool detect_hardware()
+{
+    return false;
+}
+
+static void compress(std::uint32_t *, const unsigned char *, std::size_t)
+{}
+
+#endif
+
+///
+/// Whether the CPU we are running on has SHA256 instructions.
+///
+bool accelerated_sha256::hardware_supported()
+{
+    static const bool supported = detect_hardware();
+    return supported;
+}
+
+accelerated_sha256::accelerated_sha256() :
+    use_hardware_(hardware_supported())
+{
+    reset();
+}
+
+void accelerated_sha256::reset()
+{
+    static const std::uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    std::copy(initial_state, initial_state + 8, state_);
+    pending_size_ = 0;
+    length_ = 0;
+}
+
+void accelerated_sha256::Update(const unsigned char *data, std::size_t length)
+{
+    if (!use_hardware_) {
+        fallback_.Update(data, length);
+        return;
+    }
+    
+    length_ += length;
+    
+    // Complete any partial block first.
+    if (pending_size_ != 0) {
+        auto n = std::min(length, BLOCKSIZE - pending_size_);
+        std::memcpy(pending_ + pending_size_, data, n);
+        pending_size_ += n;
+        data += n;
+        length -= n;
+        if (pending_size_ < BLOCKSIZE)
+            return;
+        compress(state_, pending_, 1);
+        pending_size_ = 0;
+    }
+    
+    // Then compress as many whole blocks as possible straight from the input.
+    auto num_blocks = length / BLOCKSIZE;
+    compress(state_, data, num_blocks);
+    data += num_blocks * BLOCKSIZE;
+    length -= num_blocks * BLOCKSIZE;
+    
+    std::memcpy(pending_, data, length);
+    pending_size_ = length;
+}
+
+void accelerated_sha256::Final(unsigned char *digest)
+{
+    if (!use_hardware_) {
+        fallback_.Final(digest);
+        return;
+    }
+    
+    // Pad with a single one bit, zeros, and the length in bits, such that
+    // the total is a whole number of blocks.
+    std::uint64_t bit_length = length_ * 8;
+    unsigned char padding[2 * BLOCKSIZE] = {0x80};
+    auto pad_size = (pending_size_ < BLOCKSIZE - 8 ? BLOCKSIZE : 2 * BLOCKSIZE)
+        - pending_size_;
+    for (int i = 0; i < 8; ++i)
+        padding[pad_size - 1 - i] = static_cast<unsigned char>(
+            bit_length >> (8 * i));
+    Update(padding, pad_size);
+    
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i]     = static_cast<unsigned char>(state_[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(state_[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(state_[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(state_[i]);
+    }
+    reset();
+}
+
+} // dbmig namespace
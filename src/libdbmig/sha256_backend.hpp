@@ -0,0 +1,71 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_SHA256_BACKEND_INCLUDED
+#define DBMIG_SHA256_BACKEND_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cryptopp/sha.h>
+
+namespace dbmig
+{
+    ///
+    /// SHA256 hash backend using CPU instructions where available
+    ///
+    /// On x86 CPUs with the SHA extensions (SHA-NI), or ARMv8 CPUs with the
+    /// SHA2 instructions, blocks are compressed using those instructions.
+    /// Otherwise, hashing is delegated to Crypto++.  Which is used is decided
+    /// at runtime, once; the digest is the same either way.
+    ///
+    /// This has the same interface as a Crypto++ hash, so that either may be
+    /// used as the backend of the hash class template.
+    ///
+    class accelerated_sha256
+    {
+    public:
+        enum { DIGESTSIZE = 32, BLOCKSIZE = 64 };
+        
+        accelerated_sha256();
+        
+        void Update(const unsigned char *data, std::size_t length);
+        
+        ///
+        /// Write the digest, and reset ready to hash another message.
+        ///
+        void Final(unsigned char *digest);
+        
+        ///
+        /// Whether the CPU we are running on has SHA256 instructions.
+        ///
+        static bool hardware_supported();
+        
+    private:
+        
+        void reset();
+        
+        CryptoPP::SHA256 fallback_;
+        bool use_hardware_;
+        std::uint32_t state_[8];
+        unsigned char pending_[BLOCKSIZE];
+        std::size_t pending_size_;
+        std::uint64_t length_;
+    };
+}
+
+#endif // DBMIG_SHA256_BACKEND_INCLUDED
@@ -0,0 +1,327 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sql_lexer.hpp"
+
+#include <cctype>
+#include <cstring>
+#include "char_scan.hpp"
+
+namespace dbmig {
+
+///
+/// Outcome of trying to match a multi-character token at a given position
+///
+enum class token_match
+{
+    no_match,
+    match,
+    // The buffer ended before the token could be resolved either way.
+    incomplete
+};
+
+static bool is_newline(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static bool is_ident_start(char c)
+{
+    auto u = static_cast<unsigned char>(c);
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u == '_' ||
+        u >= 0x80;
+}
+
+static bool is_ident_char(char c)
+{
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+// Characters that may change the state of the lexer from normal.
+static const char_set normal_specials{
+    ';', '\'', '"', '\n', '\r', '-', '/', '$'};
+static const char_set newline_chars{'\n', '\r'};
+static const char_set block_comment_specials{'*', '/'};
+
+///
+/// Try to match a batch separator (a line consisting only of "GO").
+///
+/// On success, end is set to the position of the line ending (or the end of
+/// the buffer), which is left for the caller to consume.
+///
+static token_match match_batch_separator(const char *buf, std::size_t size,
+                                         bool at_eof, std::size_t pos,
+                                         std::size_t &end)
+{
+    static const char word[] = "go";
+
+    auto i = pos;
+    while (i < size && is_blank(buf[i]))
+        ++i;
+    for (int w = 0; w < 2; ++w, ++i) {
+        if (i == size)
+            return at_eof ? token_match::no_match : token_match::incomplete;
+        if (std::tolower(static_cast<unsigned char>(buf[i])) != word[w])
+            return token_match::no_match;
+    }
+    while (i < size && is_blank(buf[i]))
+        ++i;
+    if (i == size && !at_eof)
+        return token_match::incomplete;
+    if (i != size && !is_newline(buf[i]))
+        return token_match::no_match;
+
+    end = i;
+    return token_match::match;
+}
+
+///
+/// Try to match a dollar-quote tag ($$ or $tag$) starting at buf[pos].
+///
+static token_match match_dollar_tag(const char *buf, std::size_t size,
+                                    bool at_eof, std::size_t pos,
+                                    std::size_t &end)
+{
+    auto i = pos + 1;
+    if (i < size && is_ident_start(buf[i])) {
+        while (++i < size && is_ident_char(buf[i]))
+            ;
+    }
+    if (i == size)
+        return at_eof ? token_match::no_match : token_match::incomplete;
+    if (buf[i] != '$')
+        return token_match::no_match;
+
+    end = i + 1;
+    return token_match::match;
+}
+
+
+sql_lexer::sql_lexer() :
+    state_(lex_state::normal),
+    pos_(0),
+    at_line_start_(true),
+    comment_depth_(0),
+    dollar_tag_()
+{}
+
+///
+/// Scan forward for the next delimiter in buf[0, size).
+///
+bool sql_lexer::next_delimiter(const char *buf, std::size_t size, bool at_eof,
+                               std::size_t &delim_begin,
+                               std::size_t &delim_end)
+{
+    const char *buf_end = buf + size;
+
+    while (pos_ < size) {
+        switch (state_) {
+        case lex_state::normal:
+        {
+            if (at_line_start_) {
+                // Batch separators only count when on a line of their own.
+                std::size_t end;
+                auto m = match_batch_separator(buf, size, at_eof, pos_, end);
+                if (m == token_match::incomplete)
+                    return false;
+                at_line_start_ = false;
+                if (m == token_match::match) {
+                    delim_begin = pos_;
+                    delim_end = end;
+                    pos_ = end;
+                    return true;
+                }
+            }
+
+            char c = buf[pos_];
+            switch (c) {
+            case ';':
+                delim_begin = pos_;
+                delim_end = ++pos_;
+                return true;
+            case '\'':
+                state_ = lex_state::single_quote;
+                ++pos_;
+                break;
+            case '"':
+                state_ = lex_state::double_quote;
+                ++pos_;
+                break;
+            case '\n':
+            case '\r':
+                at_line_start_ = true;
+                ++pos_;
+                break;
+            case '-':
+            case '/':
+                // Possible start of a comment; we need the next character.
+                if (pos_ + 1 == size) {
+                    if (!at_eof)
+                        return false;
+                    ++pos_;
+                }
+                else if (c == '-' && buf[pos_ + 1] == '-') {
+                    state_ = lex_state::line_comment;
+                    pos_ += 2;
+                }
+                else if (c == '/' && buf[pos_ + 1] == '*') {
+                    state_ = lex_state::block_comment;
+                    comment_depth_ = 1;
+                    pos_ += 2;
+                }
+                else {
+                    ++pos_;
+                }
+                break;
+            case '$':
+            {
+                // A dollar within an identifier is not a quote.
+                if (pos_ > 0 && is_ident_char(buf[pos_ - 1])) {
+                    ++pos_;
+                    break;
+                }
+                std::size_t end;
+                auto m = match_dollar_tag(buf, size, at_eof, pos_, end);
+                if (m == token_match::incomplete)
+                    return false;
+                if (m == token_match::match) {
+                    dollar_tag_.assign(buf + pos_, end - pos_);
+                    state_ = lex_state::dollar_quote;
+                    pos_ = end;
+                }
+                else {
+                    ++pos_;
+                }
+                break;
+            }
+            default:
+                // Skip ahead to the next character of interest.
+                pos_ = find_first_of(buf + pos_ + 1, buf_end,
+                                     normal_specials) - buf;
+            }
+            break;
+        }
+        case lex_state::single_quote:
+        case lex_state::double_quote:
+        {
+            // A doubled quote character is an escape, which this handles
+            // naturally by leaving and immediately re-entering the state.
+            char q = state_ == lex_state::single_quote ? '\'' : '"';
+            auto p = static_cast<const char *>(
+                std::memchr(buf + pos_, q, size - pos_));
+            if (p == nullptr) {
+                pos_ = size;
+            }
+            else {
+                pos_ = p - buf + 1;
+                state_ = lex_state::normal;
+            }
+            break;
+        }
+        case lex_state::dollar_quote:
+        {
+            auto p = static_cast<const char *>(
+                std::memchr(buf + pos_, '$', size - pos_));
+            if (p == nullptr) {
+                pos_ = size;
+                break;
+            }
+            pos_ = p - buf;
+            if (size - pos_ < dollar_tag_.size()) {
+                if (!at_eof)
+                    return false;
+                pos_ = size;
+            }
+            else if (dollar_tag_.compare(
+                         0, dollar_tag_.size(), p, dollar_tag_.size()) == 0) {
+                pos_ += dollar_tag_.size();
+                state_ = lex_state::normal;
+            }
+            else {
+                ++pos_;
+            }
+            break;
+        }
+        case lex_state::line_comment:
+        {
+            // Leave the line ending itself to be handled in the normal state.
+            auto p = find_first_of(buf + pos_, buf_end, newline_chars);
+            pos_ = p - buf;
+            if (p != buf_end)
+                state_ = lex_state::normal;
+            break;
+        }
+        case lex_state::block_comment:
+        {
+            auto p = find_first_of(buf + pos_, buf_end,
+                                   block_comment_specials);
+            pos_ = p - buf;
+            if (p == buf_end)
+                break;
+            if (pos_ + 1 == size) {
+                if (!at_eof)
+                    return false;
+                pos_ = size;
+            }
+            else if (p[0] == '*' && p[1] == '/') {
+                pos_ += 2;
+                if (--comment_depth_ == 0)
+                    state_ = lex_state::normal;
+            }
+            else if (p[0] == '/' && p[1] == '*') {
+                // Block comments nest, as per the SQL standard.
+                pos_ += 2;
+                ++comment_depth_;
+            }
+            else {
+                ++pos_;
+            }
+            break;
+        }
+        }
+    }
+
+    return false;
+}
+
+///
+/// Inform the lexer that the first n bytes of its buffer were erased.
+///
+void sql_lexer::discard(std::size_t n)
+{
+    pos_ -= n;
+}
+
+///
+/// Reset the lexer to scan a new buffer from the beginning.
+///
+void sql_lexer::reset()
+{
+    state_ = lex_state::normal;
+    pos_ = 0;
+    at_line_start_ = true;
+    comment_depth_ = 0;
+    dollar_tag_.clear();
+}
+
+} // dbmig namespace
@@ -0,0 +1,89 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_SQL_LEXER_INCLUDED
+#define DBMIG_SQL_LEXER_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+namespace dbmig
+{
+    ///
+    /// Incremental tokenizer that finds statement and batch delimiters in SQL
+    ///
+    /// The lexer is fed a buffer that may grow between calls, and remembers
+    /// how far through it has already scanned, so that every byte is only
+    /// examined once regardless of how large a single statement becomes.
+    ///
+    /// A semicolon is a statement delimiter, and a line consisting solely of
+    /// the word GO (in any case) is a batch delimiter.  Neither is recognised
+    /// within single-quoted literals, double-quoted identifiers, dollar-quoted
+    /// strings ($$...$$ or $tag$...$tag$), line comments or (nested) block
+    /// comments.
+    ///
+    class sql_lexer
+    {
+    public:
+        sql_lexer();
+
+        ///
+        /// Scan forward for the next delimiter in buf[0, size).
+        ///
+        /// Scanning resumes from wherever the previous call left off.  If a
+        /// delimiter is found, its position is written to delim_begin and
+        /// delim_end, and true is returned.  If the end of the buffer is
+        /// reached first, false is returned; the caller may then append more
+        /// data to the buffer and call again.  The at_eof flag indicates that
+        /// no further data will be appended, so that tokens straddling the
+        /// end of the buffer can be resolved.
+        ///
+        bool next_delimiter(const char *buf, std::size_t size, bool at_eof,
+                            std::size_t &delim_begin, std::size_t &delim_end);
+
+        ///
+        /// Inform the lexer that the first n bytes of its buffer were erased.
+        ///
+        void discard(std::size_t n);
+
+        ///
+        /// Reset the lexer to scan a new buffer from the beginning.
+        ///
+        void reset();
+
+    private:
+
+        enum class lex_state
+        {
+            normal,
+            single_quote,
+            double_quote,
+            dollar_quote,
+            line_comment,
+            block_comment
+        };
+
+        lex_state state_;
+        std::size_t pos_;
+        bool at_line_start_;
+        unsigned int comment_depth_;
+        std::string dollar_tag_;
+    };
+}
+
+#endif // DBMIG_SQL_LEXER_INCLUDED
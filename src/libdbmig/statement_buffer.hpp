@@ -19,9 +19,10 @@
 #ifndef DBMIG_STATEMENT_BUFFER_INCLUDED
 #define DBMIG_STATEMENT_BUFFER_INCLUDED
 
+#include <stdexcept>
 #include <string>
-#include <boost/regex.hpp>
 #include <boost/algorithm/string/trim.hpp>
+#include "sql_lexer.hpp"
 
 namespace dbmig
 {
@@ -29,23 +30,45 @@ namespace dbmig
     /// Struct that can be fed lines from a stream, and will parse them into the
     /// individual statements (according to statement and/or batch separators).
     ///
+    /// Delimiters are found with an incremental sql_lexer, so the cost of
+    /// appending a line is proportional to the length of that line, rather
+    /// than to the length of the statement accumulated so far.  Statements
+    /// that are empty after trimming (e.g. a GO following a semicolon) are
+    /// not written to the OutputIterator.
+    ///
     template <typename OutputIterator>
     class statement_buffer
     {
     public:
         ///
-        /// Instantiate a statement buffer using a delimiter regex that can
-        /// match statement or batch delimiters in most SQL scripts.
+        /// The delimiter regex that statement buffers used to be built with,
+        /// matching semicolons and GO outside of quotes
         ///
+        static const char *default_delim_regex()
+        {
+            return "'.*(?:go|;).*'|\".*(?:go|;).*\"|(go|;)";
+        }
+        
         statement_buffer(OutputIterator oi) :
-            oi_{oi},
-            delim_regex_{"'.*(?:go|;).*'|\".*(?:go|;).*\"|(go|;)",
-                         boost::regex::icase}
+            oi_{oi}
         {}
+        
+        ///
+        /// Instantiate a statement buffer using a delimiter regex.
+        ///
+        /// Delimiters are no longer found with a regex, so the only regex
+        /// accepted is default_delim_regex(), which the lexer stands in for.
+        /// Any other throws std::invalid_argument.
+        ///
         statement_buffer(OutputIterator oi, std::string delim_regex_str) :
-            oi_{oi},
-            delim_regex_{delim_regex_str, boost::regex::icase}
-        {}
+            oi_{oi}
+        {
+            if (delim_regex_str != default_delim_regex()) {
+                throw std::invalid_argument{
+                    "Unsupported statement delimiter regex: " +
+                    delim_regex_str};
+            }
+        }
         
         ///
         /// Append a line to the statement buffer.
@@ -55,23 +78,7 @@ namespace dbmig
             buf_.append(line);
             
             // Can we parse any statements?
-            boost::smatch results;
-            while (boost::regex_search(buf_, results, delim_regex_) &&
-                !results.empty()) {
-                // Found a statement (or batch) terminator.
-                auto sm = results[0];
-                auto pos_beg = buf_.cbegin();
-                int pos_curr_end = std::distance(pos_beg, sm.first);
-                int pos_next_beg = std::distance(pos_beg, sm.second);
-                // Extract the delimited statement, trim, and store.
-                auto stmt = buf_.substr(0, pos_curr_end);
-                boost::trim(stmt);
-                // Erase the statement from the buffer.
-                buf_.erase(0, pos_next_beg);
-                
-                // Write to the OutputIterator and increment.
-                *oi_++ = stmt;
-            }
+            split(false);
         }
         
         ///
@@ -79,18 +86,45 @@ namespace dbmig
         ///
         void finalise()
         {
+            split(true);
+            
             // See if anything is left in the statement buffer.
             boost::trim(buf_);
             if (!buf_.empty()) {
                 // Add the last statement.
                 *oi_++ = buf_;
-                buf_.clear();
             }
+            buf_.clear();
+            lexer_.reset();
         }
         
     private:
+    
+        void split(bool at_eof)
+        {
+            std::size_t consumed = 0, delim_begin, delim_end;
+            while (lexer_.next_delimiter(buf_.data(), buf_.size(), at_eof,
+                                         delim_begin, delim_end)) {
+                // Found a statement (or batch) terminator.  Extract the
+                // delimited statement, trim, and store.
+                auto stmt = buf_.substr(consumed, delim_begin - consumed);
+                boost::trim(stmt);
+                consumed = delim_end;
+                
+                // Write to the OutputIterator and increment.
+                if (!stmt.empty())
+                    *oi_++ = stmt;
+            }
+            
+            // Erase any complete statements from the buffer.
+            if (consumed > 0) {
+                buf_.erase(0, consumed);
+                lexer_.discard(consumed);
+            }
+        }
+        
         OutputIterator oi_;
-        const boost::regex delim_regex_;
+        sql_lexer lexer_;
         std::string buf_;
     };
 
@@ -18,6 +18,9 @@
 
 #include "time.hpp"
 
+#include <cmath>
+#include <cstdio>
+
 using namespace std;
 
 namespace dbmig {
@@ -37,6 +40,20 @@ std::tm localtime(const std::time_t &time)
   return tm_snapshot;
 }
 
+///
+/// Thread-safe replacement for std::gmtime
+///
+std::tm gmtime(const std::time_t &time)
+{
+  std::tm tm_snapshot;
+#if (defined(WIN32) || defined(_WIN32) || defined(__WIN32__))
+  gmtime_s(&tm_snapshot, &time);
+#else
+  gmtime_r(&time, &tm_snapshot); // POSIX
+#endif
+  return tm_snapshot;
+}
+
 ///
 /// Get the current time as std::time_t
 ///
@@ -47,6 +64,52 @@ std::time_t now()
   return std::chrono::system_clock::to_time_t(system_now);
 }
 
+///
+/// Format a point in time as an ISO 8601 timestamp in UTC, to the microsecond
+///
+/// The UTC offset is given explicitly, so that the timestamp means the same
+/// whatever time zone the database session happens to be in.
+///
+std::string to_timestamp(const std::chrono::system_clock::time_point &time)
+{
+  using namespace std::chrono;
+  // Split into whole seconds and microseconds, rounding towards the past
+  // (to_time_t() may round to nearest).
+  auto since_epoch = duration_cast<microseconds>(time.time_since_epoch());
+  auto secs = duration_cast<seconds>(since_epoch);
+  if (secs > since_epoch)
+    secs -= seconds{1};
+  auto micros = (since_epoch - secs).count();
+  auto tm = gmtime(system_clock::to_time_t(system_clock::time_point{secs}));
+  
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%06d+00:00",
+                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(micros));
+  return buf;
+}
+
+///
+/// Format a number of seconds as an interval of hours, minutes and seconds
+/// (HH:MM:SS.ffffff), to the microsecond
+///
+std::string to_interval(const double seconds)
+{
+  // Work in whole microseconds, so that rounding never gives 60 seconds.
+  long long micros = std::llround(seconds * 1e6);
+  if (micros < 0)
+    micros = 0;
+  long long hours = micros / 3600000000LL;
+  int minutes = static_cast<int>(micros / 60000000LL % 60);
+  int secs = static_cast<int>(micros / 1000000LL % 60);
+  int fraction = static_cast<int>(micros % 1000000LL);
+  
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%02lld:%02d:%02d.%06d",
+                hours, minutes, secs, fraction);
+  return buf;
+}
+
 } // time namespace
 } // dbmig namespace
 
@@ -21,6 +21,7 @@
 
 #include <chrono>
 #include <ctime>
+#include <string>
 
 namespace dbmig {
 namespace time {
@@ -30,11 +31,27 @@ namespace time {
 ///
 std::tm localtime(const std::time_t &time);
 
+///
+/// Thread-safe replacement for std::gmtime
+///
+std::tm gmtime(const std::time_t &time);
+
 ///
 /// Get the current time as std::time_t
 ///
 std::time_t now();
 
+///
+/// Format a point in time as an ISO 8601 timestamp in UTC, to the microsecond
+///
+std::string to_timestamp(const std::chrono::system_clock::time_point &time);
+
+///
+/// Format a number of seconds as an interval of hours, minutes and seconds
+/// (HH:MM:SS.ffffff), to the microsecond
+///
+std::string to_interval(const double seconds);
+
 } // time
 } // dbmig
 
@@ -0,0 +1,530 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "watched_repository.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/filesystem.hpp>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "script_dir.hpp"
+#include "script_filename.hpp"
+#include "dir_scan.hpp"
+#include "bundle.hpp"
+#include "fs_encoding.hpp"
+
+using std::string;
+
+namespace dbmig {
+
+///
+/// Read both script directories of a repository in full.
+///
+static std::shared_ptr<const repository> scan_repository(const string &path)
+{
+    return std::make_shared<const repository>(path + "/latest",
+        script_dir(path + "/upgrade"), script_dir(path + "/install"));
+}
+
+///
+/// Changes to a repository that have yet to make it into a snapshot
+///
+struct pending_changes
+{
+    pending_changes() : everything(false) {}
+    
+    bool empty() const
+    {
+        return !everything && upgrade.empty() && install.empty();
+    }
+    
+    // Set if the whole repository must be scanned again.
+    bool everything;
+    // Changed version sub-directories of each script directory, by their
+    // paths within it, or "" for its root.
+    std::unordered_set<string> upgrade;
+    std::unordered_set<string> install;
+};
+
+#ifdef __linux__
+
+///
+/// What an inotify watch is watching
+///
+struct watch_target
+{
+    enum kind_type { repository_root, script_root, group_dir, sub_dir } kind;
+    script_action action;
+    // The path within the script directory, for any but the roots.
+    string sub_dir_name;
+};
+
+///
+/// Is the directory of the given name a version sub-directory (X.Y.Z),
+/// rather than a grouping directory?
+///
+static bool is_version_dir_name(const string &name)
+{
+    unsigned int mj, mn, pt;
+    return parse_script_dir_name(name, mj, mn, pt);
+}
+
+#endif
+
+// Private impl class
+struct watched_repository::impl
+{
+    explicit impl(const string &path);
+    ~impl();
+    
+    const string path_;
+    
+    // Guards the snapshot and last error, but only while they are copied
+    // or replaced, never while a snapshot is built.
+    mutable std::mutex snapshot_mutex_;
+    std::shared_ptr<const repository> snapshot_;
+    std::exception_ptr last_error_;
+    
+    // Only one snapshot is built at a time.
+    std::mutex rebuild_mutex_;
+    // Set if changes were lost when a rebuild failed.
+    bool stale_;
+    
+    void publish(std::shared_ptr<const repository> snapshot);
+    void rebuild(const pending_changes &changes);
+
+#ifdef __linux__
+    int inotify_fd_;
+    int stop_pipe_[2];
+    // Only touched by the watcher thread, once it has started.
+    std::unordered_map<int, watch_target> watches_;
+    std::thread watcher_;
+    
+    void add_watch(const string &dir_path, const watch_target &target);
+    void watch_everything();
+    void read_events(pending_changes &changes);
+    void watch_loop();
+#endif
+};
+
+
+watched_repository::watched_repository(const string &path)
+    : pimpl_(new impl(path))
+{}
+
+watched_repository::~watched_repository() = default;
+
+///
+/// The latest snapshot of the repository
+///
+std::shared_ptr<const repository> watched_repository::snapshot() const
+{
+    std::lock_guard<std::mutex> lock{pimpl_->snapshot_mutex_};
+    return pimpl_->snapshot_;
+}
+
+///
+/// Scan the repository in full, now, and publish the result
+///
+void watched_repository::refresh()
+{
+    auto &impl = *pimpl_;
+    std::lock_guard<std::mutex> lock{impl.rebuild_mutex_};
+    impl.publish(scan_repository(impl.path_));
+    impl.stale_ = false;
+}
+
+///
+/// The error from the latest failed attempt to rebuild the snapshot in the
+/// background, if it has not been rebuilt successfully since
+///
+std::exception_ptr watched_repository::last_error() const
+{
+    std::lock_guard<std::mutex> lock{pimpl_->snapshot_mutex_};
+    return pimpl_->last_error_;
+}
+
+///
+/// Replace the current snapshot.
+///
+void watched_repository::impl::publish(
+    std::shared_ptr<const repository> snapshot)
+{
+    std::lock_guard<std::mutex> lock{snapshot_mutex_};
+    snapshot_.swap(snapshot);
+    last_error_ = nullptr;
+    // Any reader of the old snapshot keeps it alive; otherwise, it is
+    // freed here, once the lock is released.
+}
+
+///
+/// Build and publish a snapshot with the given changes, reusing what it can
+/// from the current one.
+///
+/// If the changed parts cannot be rescanned (say, because a sub-directory
+/// went away while it was being scanned), the whole repository is scanned.
+/// If that fails too, the current snapshot is kept, the error recorded, and
+/// the next rebuild made a full scan.
+///
+void watched_repository::impl::rebuild(const pending_changes &changes)
+{
+    std::lock_guard<std::mutex> lock{rebuild_mutex_};
+    std::shared_ptr<const repository> next;
+    if (!changes.everything && !stale_) {
+        auto previous = snapshot_;
+        try {
+            next = std::make_shared<const repository>(
+                previous->latest_schema_path(),
+                script_dir(previous->scripts(script_action::upgrade),
+                    std::vector<string>(changes.upgrade.begin(),
+                                        changes.upgrade.end())),
+                script_dir(previous->scripts(script_action::install),
+                    std::vector<string>(changes.install.begin(),
+                                        changes.install.end())));
+        }
+        catch (const std::exception &) {
+            // Fall back to a full scan.
+        }
+    }
+    try {
+        if (!next)
+            next = scan_repository(path_);
+        publish(std::move(next));
+        stale_ = false;
+    }
+    catch (const std::exception &) {
+        // The changes are lost, so the next rebuild must scan everything.
+        stale_ = true;
+        std::lock_guard<std::mutex> lock{snapshot_mutex_};
+        last_error_ = std::current_exception();
+    }
+}
+
+#ifndef __linux__
+
+watched_repository::impl::impl(const string &path) :
+    path_(path), stale_(false)
+{
+    if (is_bundle(path))
+        throw std::invalid_argument{"a bundle cannot be watched: " + path};
+    snapshot_ = scan_repository(path_);
+}
+
+watched_repository::impl::~impl() = default;
+
+#else
+
+///
+/// How long the repository must be quiet for before changes are applied
+///
+static const std::chrono::milliseconds settle_time{50};
+
+///
+/// How long changes may be held back for while the repository stays busy
+///
+static const std::chrono::milliseconds max_delay{1000};
+
+///
+/// The events that may change the scripts within a watched directory
+///
+static const std::uint32_t watched_events =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+static boost::filesystem::filesystem_error watch_error(const char *what,
+                                                       const string &path)
+{
+    return boost::filesystem::filesystem_error{what, path,
+        boost::system::error_code{errno, boost::system::system_category()}};
+}
+
+watched_repository::impl::impl(const string &path) :
+    path_(path), stale_(false), inotify_fd_(-1), stop_pipe_{-1, -1}
+{
+    if (is_bundle(path))
+        throw std::invalid_argument{"a bundle cannot be watched: " + path};
+    
+    try {
+        inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0)
+            throw watch_error("Cannot watch directory", path);
+        if (::pipe2(stop_pipe_, O_CLOEXEC) != 0)
+            throw watch_error("Cannot watch directory", path);
+        
+        // Watch before scanning, so that no change is missed.
+        watch_everything();
+        snapshot_ = scan_repository(path_);
+    }
+    catch (...) {
+        for (int fd : {inotify_fd_, stop_pipe_[0], stop_pipe_[1]}) {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        throw;
+    }
+    
+    watcher_ = std::thread{&impl::watch_loop, this};
+}
+
+watched_repository::impl::~impl()
+{
+    // Wake the watcher thread, and wait for it to finish.
+    char stop = 0;
+    while (::write(stop_pipe_[1], &stop, 1) < 0 && errno == EINTR)
+        continue;
+    watcher_.join();
+    
+    ::close(inotify_fd_);
+    ::close(stop_pipe_[0]);
+    ::close(stop_pipe_[1]);
+}
+
+///
+/// Watch a directory.
+///
+void watched_repository::impl::add_watch(const string &dir_path,
+                                         const watch_target &target)
+{
+    int wd = ::inotify_add_watch(inotify_fd_,
+                                 utf8_to_fs<char>(dir_path).c_str(),
+                                 watched_events);
+    if (wd < 0)
+        throw watch_error("Cannot watch directory", dir_path);
+    // The same directory under a new name keeps its watch.
+    watches_[wd] = target;
+}
+
+///
+/// Watch the repository, both its script directories and all of their
+/// sub-directories, however deeply grouped, forgetting any existing watches.
+///
+void watched_repository::impl::watch_everything()
+{
+    for (auto &watch : watches_)
+        ::inotify_rm_watch(inotify_fd_, watch.first);
+    watches_.clear();
+    
+    add_watch(path_, {watch_target::repository_root,
+                      script_action::upgrade, ""});
+    for (auto action : {script_action::upgrade, script_action::install}) {
+        auto dir_path = path_ + "/" + to_string(action);
+        add_watch(dir_path, {watch_target::script_root, action, ""});
+        walk_directory_tree(open_dir{dir_path},
+            [&](const string &relative_path, const open_dir &dir,
+                dir_entry_list &entries)
+            {
+                if (!relative_path.empty())
+                    add_watch(dir.path(), {watch_target::group_dir, action,
+                                           relative_path});
+                
+                // Version sub-directories are watched, but not walked.
+                auto prefix = relative_path.empty() ? ""
+                    : relative_path + "/";
+                entries.erase(std::remove_if(entries.begin(), entries.end(),
+                    [&](const dir_entry &entry)
+                    {
+                        if (entry.type != dir_entry_type::directory)
+                            return true;
+                        if (!is_version_dir_name(entry.name))
+                            return false;
+                        add_watch(dir.path() + "/" + entry.name,
+                                  {watch_target::sub_dir, action,
+                                   prefix + entry.name});
+                        return true;
+                    }),
+                    entries.end());
+            });
+    }
+}
+
+///
+/// Read whatever events are waiting, and note what they change.
+///
+void watched_repository::impl::read_events(pending_changes &changes)
+{
+    alignas(inotify_event) char buf[16384];
+    for (;;) {
+        auto len = ::read(inotify_fd_, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return;
+        
+        for (char *p = buf; p < buf + len; ) {
+            auto ev = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + ev->len;
+            
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were lost, so nothing can be trusted.
+                changes.everything = true;
+                continue;
+            }
+            auto it = watches_.find(ev->wd);
+            if (it == watches_.end())
+                continue;
+            if (ev->mask & IN_IGNORED) {
+                watches_.erase(it);
+                continue;
+            }
+            
+            auto target = it->second;
+            auto &changed = target.action == script_action::install
+                ? changes.install : changes.upgrade;
+            string name = ev->len ? ev->name : "";
+            switch (target.kind) {
+                case watch_target::repository_root:
+                    if (name == "upgrade" || name == "install" ||
+                        (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)))
+                        changes.everything = true;
+                    break;
+                
+                case watch_target::script_root:
+                case watch_target::group_dir:
+                {
+                    if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        changes.everything = true;
+                        break;
+                    }
+                    // Scripts within a grouping directory are bad, and a
+                    // rescan of the root walks them all.
+                    changed.insert("");
+                    if (!(ev->mask & IN_ISDIR))
+                        break;
+                    if (!is_version_dir_name(name)) {
+                        // A grouping directory came or went, along with
+                        // whatever it holds.
+                        changes.everything = true;
+                        break;
+                    }
+                    // A version sub-directory came or went.
+                    auto sub_dir = target.sub_dir_name.empty() ? name
+                        : target.sub_dir_name + "/" + name;
+                    changed.insert(sub_dir);
+                    if (ev->mask & IN_MOVED_FROM) {
+                        for (auto &watch : watches_) {
+                            if (watch.second.kind == watch_target::sub_dir &&
+                                watch.second.action == target.action &&
+                                watch.second.sub_dir_name == sub_dir) {
+                                ::inotify_rm_watch(inotify_fd_, watch.first);
+                                break;
+                            }
+                        }
+                    }
+                    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        try {
+                            add_watch(path_ + "/" + to_string(target.action) +
+                                      "/" + sub_dir,
+                                      {watch_target::sub_dir, target.action,
+                                       sub_dir});
+                        }
+                        catch (const std::exception &) {
+                            // Gone again already, or out of watches.
+                            changes.everything = true;
+                        }
+                    }
+                    break;
+                }
+                
+                case watch_target::sub_dir:
+                    changed.insert(target.sub_dir_name);
+                    break;
+            }
+        }
+    }
+}
+
+///
+/// Wait for changes, and once they have settled, publish a new snapshot
+/// with them, until told to stop.
+///
+void watched_repository::impl::watch_loop()
+{
+    typedef std::chrono::steady_clock clock;
+    pending_changes changes;
+    clock::time_point first_change, last_change;
+    bool rewatch = false;
+    
+    for (;;) {
+        int timeout = -1;
+        if (!changes.empty()) {
+            auto now = clock::now();
+            auto due = std::min(last_change + settle_time,
+                                first_change + max_delay);
+            timeout = due <= now ? 0 : static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    due - now).count()) + 1;
+        }
+        
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+        int n = ::poll(fds, 2, timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            std::lock_guard<std::mutex> lock{snapshot_mutex_};
+            last_error_ = std::make_exception_ptr(
+                watch_error("Cannot watch directory", path_));
+            return;
+        }
+        if (fds[1].revents)
+            return;
+        
+        if (fds[0].revents) {
+            bool had_changes = !changes.empty();
+            read_events(changes);
+            if (!changes.empty()) {
+                last_change = clock::now();
+                if (!had_changes)
+                    first_change = last_change;
+            }
+            continue;
+        }
+        
+        // Quiet for long enough; apply the changes.
+        if (changes.everything || rewatch) {
+            changes.everything = true;
+            try {
+                watch_everything();
+                rewatch = false;
+            }
+            catch (const std::exception &) {
+                // Try again at the next change.
+                rewatch = true;
+            }
+        }
+        rebuild(changes);
+        changes = pending_changes{};
+    }
+}
+
+#endif
+
+} // dbmig namespace
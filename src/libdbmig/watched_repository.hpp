@@ -0,0 +1,94 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_WATCHED_REPOSITORY_INCLUDED
+#define DBMIG_WATCHED_REPOSITORY_INCLUDED
+
+#include <exception>
+#include <memory>
+#include <string>
+#include "repository.hpp"
+
+namespace dbmig
+{
+    ///
+    /// A repository directory that is kept up to date as it changes on disk
+    ///
+    /// Intended for long-running processes, which would otherwise have to
+    /// open (and so scan) the repository afresh for every request.  Each
+    /// state of the repository is published as an immutable snapshot, which
+    /// readers may hold for as long as they like: a change on disk causes a
+    /// new snapshot to be built alongside, and then published in place of the
+    /// old one, so that a reader never waits for a rescan, and never sees a
+    /// half-updated set of scripts.
+    ///
+    /// On Linux, a background thread watches the repository with inotify.
+    /// Once changes have settled, only those sub-directories in which
+    /// something changed are rescanned, and the scripts of the rest are
+    /// carried over from the previous snapshot.  Elsewhere, or if the watch
+    /// loses track (for instance, if the kernel's event queue overflows),
+    /// the repository is scanned in full, and refresh() may be called to do
+    /// so on demand.
+    ///
+    /// Only changes to the names of scripts are tracked; a script whose
+    /// contents change is read afresh whenever it is run or hashed anyway.
+    ///
+    class watched_repository
+    {
+    public:
+    
+        ///
+        /// Scan the repository directory at the given path, and start
+        /// watching it
+        ///
+        /// Throws if the repository cannot be scanned in full, or cannot be
+        /// watched.  Bundles never change, so cannot be watched.
+        ///
+        explicit watched_repository(const std::string &path);
+        ~watched_repository();
+        
+        ///
+        /// The latest snapshot of the repository
+        ///
+        /// Both of its script directories have been read in full, so it may
+        /// be shared freely between threads.
+        ///
+        std::shared_ptr<const repository> snapshot() const;
+        
+        ///
+        /// Scan the repository in full, now, and publish the result
+        ///
+        /// Throws, leaving the current snapshot in place, if the repository
+        /// cannot be scanned.
+        ///
+        void refresh();
+        
+        ///
+        /// The error from the latest failed attempt to rebuild the snapshot
+        /// in the background, if it has not been rebuilt successfully since
+        ///
+        std::exception_ptr last_error() const;
+    
+    private:
+    
+        struct impl;
+        std::unique_ptr<impl> pimpl_;
+    };
+}
+
+#endif // DBMIG_WATCHED_REPOSITORY_INCLUDED
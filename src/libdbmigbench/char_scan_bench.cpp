@@ -0,0 +1,118 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "char_scan.hpp"
+#include "getline.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace dbmig;
+
+static const char *isa_name(const scan_isa isa)
+{
+    switch (isa) {
+        case scan_isa::sse2: return "sse2";
+        case scan_isa::avx2: return "avx2";
+        default:             return "scalar";
+    }
+}
+
+///
+/// Build a script of roughly the given size, made of typical-length lines.
+///
+static string make_script(size_t size)
+{
+    string script;
+    script.reserve(size + 100);
+    for (size_t i = 0; script.size() < size; ++i)
+        script += "INSERT INTO some_table (id, name, description) VALUES (" +
+            to_string(i) + ", 'name', 'a longer description');\n";
+    return script;
+}
+
+template <typename Func>
+static void report(const string &name, const string &script, Func func)
+{
+    auto start = chrono::steady_clock::now();
+    size_t found = func(script);
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << script.size() / 1e6 << " MB, " << found
+         << " found in " << secs.count() << " s = "
+         << script.size() / 1e9 / secs.count() << " GB/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64000000;
+    auto script = make_script(size);
+    const char_set lexer_chars{
+        ';', '\'', '"', '\n', '\r', '-', '/', '$'};
+    const char_set newline_chars{'\n', '\r'};
+
+    // Raw scanning for the characters of interest to the lexer (dense), and
+    // for line endings (sparse).
+    for (auto isa : {scan_isa::scalar, scan_isa::sse2, scan_isa::avx2}) {
+        if (isa > best_scan_isa())
+            continue;
+        for (auto set : {&lexer_chars, &newline_chars}) {
+            report(string("find_first_of ") + isa_name(isa) +
+                   (set == &lexer_chars ? " (lexer)" : " (newlines)"),
+                   script,
+                [&](const string &s)
+                {
+                    size_t found = 0;
+                    auto b = s.data(), e = s.data() + s.size();
+                    while ((b = find_first_of(b, e, *set, isa)) != e) {
+                        ++found;
+                        ++b;
+                    }
+                    return found;
+                });
+        }
+    }
+
+    // Line splitting, as it was and as it is now.
+    report("multiplatform_getline", script, [](const string &s)
+        {
+            istringstream is{s};
+            string line, line_ending;
+            size_t found = 0;
+            while (multiplatform_getline(is, line, line_ending))
+                ++found;
+            return found;
+        });
+    report(string("line_reader ") + isa_name(best_scan_isa()), script,
+        [](const string &s)
+        {
+            istringstream is{s};
+            line_reader<istringstream> reader{is};
+            string line, line_ending;
+            size_t found = 0;
+            while (reader.getline(line, line_ending))
+                ++found;
+            return found;
+        });
+
+    return 0;
+}
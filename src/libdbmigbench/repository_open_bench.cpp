@@ -0,0 +1,117 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "repository.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// Build a repository with the given number of upgrade versions, each with a
+/// handful of scripts, and an install script for every hundredth version.
+///
+static void make_repository(const fs::path &path, size_t num_versions)
+{
+    for (size_t i = 0; i < num_versions; ++i) {
+        auto ver = "1." + to_string(i / 100) + "." + to_string(i % 100);
+        auto upgrade_dir = path / "upgrade" / ver;
+        fs::create_directories(upgrade_dir);
+        for (int n = 1; n <= 5; ++n) {
+            nowide::ofstream ofs{
+                (upgrade_dir / ("000" + to_string(n) + "_change.sql"))
+                    .string().c_str()};
+            ofs << "SELECT 1;\n";
+        }
+        if (i % 100 == 0) {
+            auto install_dir = path / "install" / ver;
+            fs::create_directories(install_dir);
+            nowide::ofstream ofs{
+                (install_dir / (ver + "+script.1_install.sql"))
+                    .string().c_str()};
+            ofs << "SELECT 1;\n";
+        }
+    }
+}
+
+template <typename Func>
+static void report(const string &name, size_t runs, Func func)
+{
+    auto start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < runs; ++i)
+        found += func();
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << runs << " opens (" << found / runs
+         << " scripts each) in " << secs.count() << " s = "
+         << secs.count() * 1e3 / runs << " ms/open" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_versions = argc > 1 ? strtoul(argv[1], nullptr, 10) : 5000;
+    size_t runs = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+
+    auto path = fs::temp_directory_path() /
+                fs::unique_path("dbmig-bench-%%%%-%%%%");
+    make_repository(path, num_versions);
+    auto repo_path = path.string();
+    auto last = semver::parse("1." + to_string((num_versions - 1) / 100) +
+                              "." + to_string((num_versions - 1) % 100));
+
+    // Every command used to read both script directories on open.
+    report("open, read both", runs, [&]
+        {
+            repository repo{repo_path};
+            auto &ins = repo.scripts(script_action::install);
+            auto &upg = repo.scripts(script_action::upgrade);
+            return size_t(distance(ins.begin(), ins.end()) +
+                          distance(upg.begin(), upg.end()));
+        });
+    report("open, rollback one script", runs, [&]
+        {
+            repository repo{repo_path};
+            auto r = repo.upgrade_script_at(semver{last.mj(), last.mn(),
+                                                   last.pt(), "", "script.5"});
+            return size_t(distance(r.first, r.second));
+        });
+    report("open, fresh install", runs, [&]
+        {
+            repository repo{repo_path};
+            auto r = repo.nearest_install_script(last);
+            return size_t(distance(r.first, r.second));
+        });
+    report("open lazily, rollback one script", runs, [&]
+        {
+            repository repo{repo_path, script_loading::lazy};
+            auto r = repo.upgrade_script_at(semver{last.mj(), last.mn(),
+                                                   last.pt(), "", "script.5"});
+            return size_t(distance(r.first, r.second));
+        });
+
+    fs::remove_all(path);
+    return 0;
+}
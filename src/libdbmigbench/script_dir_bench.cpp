@@ -0,0 +1,165 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_dir.hpp"
+#include "semver_compare.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace dbmig;
+
+typedef map<semver, string, semver::metadata_compare> legacy_map;
+
+///
+/// Build the given number of scripts, spread over patch versions with a
+/// handful of scripts each, in the order a directory listing might give.
+///
+static script_dir::list_type make_scripts(size_t num_scripts)
+{
+    script_dir::list_type scripts;
+    for (size_t i = 0; i < num_scripts; ++i) {
+        unsigned int patch = i / 5, num = i % 5 + 1;
+        scripts.emplace_back(
+            semver{patch / 1000, patch % 1000, 0, "",
+                   "script." + to_string(num)},
+            to_string(patch) + "/000" + to_string(num) + "_change.sql");
+    }
+    shuffle(scripts.begin(), scripts.end(), mt19937{42});
+    return scripts;
+}
+
+///
+/// Pick pairs of (from, to) versions that each span a few scripts.
+///
+static vector<pair<semver, semver>> make_queries(
+    const script_dir::list_type &scripts, size_t num_queries)
+{
+    vector<pair<semver, semver>> queries;
+    mt19937 gen{7};
+    uniform_int_distribution<size_t> pick{0, scripts.size() - 1};
+    for (size_t i = 0; i < num_queries; ++i) {
+        auto from = scripts[pick(gen)].first;
+        auto to = from;
+        to.next_minor();
+        queries.emplace_back(from, to);
+    }
+    return queries;
+}
+
+///
+/// A range query as script_dir performed it when backed by a std::map.
+///
+static size_t legacy_range(const legacy_map &m, const semver &from,
+                           const semver &to)
+{
+    semver_script_compare<non_script_alignment::low> lcmp;
+    semver_script_compare<non_script_alignment::high> hcmp;
+    auto l = lower_bound(m.begin(), m.end(), from,
+        [&](const legacy_map::value_type &kvp, const semver &v)
+        {
+            return lcmp(kvp.first, v);
+        });
+    if (l != m.end() && l->first == from)
+        ++l;
+    auto u = upper_bound(l, m.end(), to,
+        [&](const semver &v, const legacy_map::value_type &kvp)
+        {
+            return hcmp(v, kvp.first);
+        });
+    return distance(l, u);
+}
+
+template <typename Func>
+static void report(const string &name, size_t count, const char *unit,
+                   Func func)
+{
+    auto start = chrono::steady_clock::now();
+    size_t found = func();
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << count << " " << unit << " (" << found
+         << " scripts) in " << secs.count() << " s = "
+         << count / secs.count() << " " << unit << "/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_scripts = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t num_queries = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+    size_t legacy_queries = argc > 3 ? strtoul(argv[3], nullptr, 10) : 100;
+    auto scripts = make_scripts(num_scripts);
+    auto queries = make_queries(scripts, num_queries);
+
+    legacy_map m;
+    report("std::map build", num_scripts, "scripts", [&]
+        {
+            for (auto &s : scripts)
+                m.insert(s);
+            return m.size();
+        });
+    unique_ptr<script_dir> sd;
+    report("script_dir build", num_scripts, "scripts", [&]
+        {
+            auto copy = scripts;
+            sd.reset(new script_dir{"bench", move(copy)});
+            return size_t(distance(sd->begin(), sd->end()));
+        });
+
+    report("std::map range", legacy_queries, "queries", [&]
+        {
+            size_t found = 0;
+            for (size_t i = 0; i < legacy_queries; ++i)
+                found += legacy_range(m, queries[i].first, queries[i].second);
+            return found;
+        });
+    report("script_dir range", num_queries, "queries", [&]
+        {
+            size_t found = 0;
+            for (auto &q : queries) {
+                auto r = sd->range(q.first, q.second);
+                found += distance(r.first, r.second);
+            }
+            return found;
+        });
+
+    report("std::map iterate", num_scripts, "scripts", [&]
+        {
+            size_t found = 0;
+            for (auto &kvp : m)
+                found += kvp.second.size() > 0;
+            return found;
+        });
+    report("script_dir iterate", num_scripts, "scripts", [&]
+        {
+            size_t found = 0;
+            for (auto it = sd->begin(); it != sd->end(); ++it)
+                found += it->second.size() > 0;
+            return found;
+        });
+
+    return 0;
+}
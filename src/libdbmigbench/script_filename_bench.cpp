@@ -0,0 +1,146 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_filename.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace dbmig;
+
+typedef pair<string, string> dir_entry; // parent dir (if any), filename
+
+///
+/// Sub-directory filename parsing as it was with regular expressions, kept
+/// for comparison (less its error reporting).
+///
+static semver legacy_parse(const string &parent_dir_name,
+                           const string &filename)
+{
+    static const boost::regex pat{
+        R"((\d+\.\d+\.\d+)/(?:\1\+)?(?:script\.)?(\d+)(?:_.*)?(?:\..*)?)"};
+    boost::smatch results;
+    auto str = parent_dir_name + "/" + filename;
+    boost::regex_match(str, results, pat,
+        boost::match_default | boost::match_partial);
+    auto ver = semver::parse(results[1].str() + "+script." +
+                             results[2].str());
+    auto bms = "script." + to_string(ver.bm_ids()[1].numeric_value);
+    return semver{ver.mj(), ver.mn(), ver.pt(), "", bms};
+}
+
+///
+/// Top-level filename parsing as it was with regular expressions.
+///
+static semver legacy_parse(const string &filename)
+{
+    static const boost::regex pat{
+        R"((\d+\.\d+\.\d+)\+script\.(\d+)(?:_.*)?(?:\..*)?)"};
+    boost::smatch results;
+    boost::regex_match(filename, results, pat,
+        boost::match_default | boost::match_partial);
+    auto ver = semver::parse(results[1].str() + "+script." +
+                             results[2].str());
+    auto bms = "script." + to_string(ver.bm_ids()[1].numeric_value);
+    return semver{ver.mj(), ver.mn(), ver.pt(), "", bms};
+}
+
+///
+/// Build directory entries in each of the supported layouts.
+///
+static vector<dir_entry> make_entries(size_t num_entries)
+{
+    vector<dir_entry> entries;
+    for (size_t i = 0; i < num_entries; ++i) {
+        auto ver = to_string(i / 5000) + "." + to_string(i / 5 % 1000) + ".0";
+        auto num = to_string(i % 5 + 1);
+        switch (i % 4) {
+            case 0:
+                entries.emplace_back("", ver + "+script." + num + "_foo.sql");
+                break;
+            case 1:
+                entries.emplace_back(ver, "000" + num + "_bar.sql");
+                break;
+            case 2:
+                entries.emplace_back(ver, "script." + num + "_baz.sql");
+                break;
+            default:
+                entries.emplace_back(ver, ver + "+script." + num + ".sql");
+                break;
+        }
+    }
+    return entries;
+}
+
+template <typename Func>
+static void report(const char *name, const vector<dir_entry> &entries,
+                   Func func)
+{
+    auto start = chrono::steady_clock::now();
+    unsigned long sum = 0;
+    for (auto &e : entries) {
+        auto v = e.first.empty() ? func(e.second) : func(e.first, e.second);
+        sum += v.mj() + v.mn() + v.bm_ids()[1].numeric_value;
+    }
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << entries.size() << " filenames (checksum " << sum
+         << ") in " << secs.count() << " s = "
+         << entries.size() / 1e6 / secs.count() << " M/s" << endl;
+}
+
+struct legacy_parser
+{
+    semver operator()(const string &f) const
+    {
+        return legacy_parse(f);
+    }
+    semver operator()(const string &d, const string &f) const
+    {
+        return legacy_parse(d, f);
+    }
+};
+
+struct direct_parser
+{
+    semver operator()(const string &f) const
+    {
+        return parse_script_filename(f);
+    }
+    semver operator()(const string &d, const string &f) const
+    {
+        return parse_script_filename(d, f);
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    size_t num_entries = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    auto entries = make_entries(num_entries);
+
+    report("legacy regex parse", entries, legacy_parser{});
+    report("parse_script_filename", entries, direct_parser{});
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mapped_script.hpp"
+#include "script_stream.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+
+using namespace std;
+using namespace dbmig;
+
+// Count every heap allocation made by the process.
+static atomic<size_t> num_allocs{0};
+
+void *operator new(size_t size)
+{
+    ++num_allocs;
+    if (void *p = malloc(size == 0 ? 1 : size))
+        return p;
+    throw bad_alloc{};
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+///
+/// Write a script of the given number of statements to a temporary file.
+///
+static string make_script_file(size_t num_statements)
+{
+    auto path = boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("dbmig-bench-%%%%-%%%%.sql");
+    nowide::ofstream ofs{path.string().c_str()};
+    ofs << "-- Generated benchmark script\n";
+    for (size_t i = 0; i < num_statements; ++i)
+        ofs << "INSERT INTO t (id, body)\n    VALUES (" << i
+            << ", 'it''s a ; test');\n";
+    ofs << "--//@UNDO\nDELETE FROM t;\n";
+    return path.string();
+}
+
+template <typename Func>
+static void report(const char *name, const string &path, int iterations,
+                   Func func)
+{
+    double mb = boost::filesystem::file_size(path) / 1e6 * iterations;
+    size_t statements = 0;
+    auto allocs_before = num_allocs.load();
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        statements += func(path);
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+    auto allocs = num_allocs.load() - allocs_before;
+
+    cout << name << ": " << mb << " MB, " << statements << " statements in "
+         << secs.count() << " s = " << mb / secs.count() << " MB/s, "
+         << allocs / mb << " allocations/MB" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_statements = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+    auto path = make_script_file(num_statements);
+
+    report("ifstream + statement_buffer", path, iterations,
+        [](const string &path)
+        {
+            nowide::ifstream ifs{path.c_str()};
+            auto script = read_script(ifs, script_action::install);
+            return script.statements(script_action::install).size();
+        });
+    report("mapped_script", path, iterations,
+        [](const string &path)
+        {
+            mapped_script script{path};
+            return script.statements(script_action::install).size();
+        });
+
+    remove(path.c_str());
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "semantic_version.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace dbmig;
+
+typedef semver::id_list id_list;
+
+///
+/// The components of a version, as produced by the legacy parser.
+///
+struct legacy_version
+{
+    unsigned int mj, mn, pt;
+    id_list pr_ids, bm_ids;
+};
+
+///
+/// Identifier parsing as it was before the parser avoided streams, kept for
+/// comparison (with the validation left out, as it does not affect speed).
+///
+static id_list legacy_parse_ids(const string &str)
+{
+    id_list v;
+    if (str == "")
+        return v;
+    semver::appended_identifier_part aip;
+    stringstream ss(str);
+    for (getline(ss, aip.str_value, '.');
+         (ss.rdstate() & stringstream::failbit) == 0;
+         getline(ss, aip.str_value, '.'))
+    {
+        aip.is_numeric = true;
+        for (auto c : aip.str_value)
+            if (!isdigit(c))
+                aip.is_numeric = false;
+        if (aip.is_numeric)
+            aip.numeric_value = atoi(aip.str_value.c_str());
+        v.push_back(aip);
+    }
+    return v;
+}
+
+///
+/// Version parsing as it was before the parser avoided streams.
+///
+static legacy_version legacy_parse(const string &version_str)
+{
+    string mj_str, mn_str, pt_str, pr_str, bm_str, ptprbm_str;
+    stringstream ss(version_str);
+    getline(ss, mj_str, '.');
+    getline(ss, mn_str, '.');
+    getline(ss, ptprbm_str);
+    size_t pr_pos = ptprbm_str.find('-');
+    size_t bm_pos = ptprbm_str.find('+');
+    if (pr_pos != string::npos && bm_pos != string::npos) {
+        pt_str = ptprbm_str.substr(0, pr_pos);
+        pr_str = ptprbm_str.substr(pr_pos + 1, bm_pos - pr_pos - 1);
+        bm_str = ptprbm_str.substr(bm_pos + 1);
+    }
+    else if (pr_pos != string::npos) {
+        pt_str = ptprbm_str.substr(0, pr_pos);
+        pr_str = ptprbm_str.substr(pr_pos + 1);
+    }
+    else if (bm_pos != string::npos) {
+        pt_str = ptprbm_str.substr(0, bm_pos);
+        bm_str = ptprbm_str.substr(bm_pos + 1);
+    }
+    else {
+        pt_str = ptprbm_str;
+    }
+    return legacy_version{
+        unsigned(atoi(mj_str.c_str())), unsigned(atoi(mn_str.c_str())),
+        unsigned(atoi(pt_str.c_str())), legacy_parse_ids(pr_str),
+        legacy_parse_ids(bm_str)};
+}
+
+///
+/// Build a mix of script versions, and the odd release-style version.
+///
+static vector<string> make_versions(size_t num_versions)
+{
+    vector<string> versions;
+    for (size_t i = 0; i < num_versions; ++i) {
+        if (i % 10 == 9)
+            versions.push_back(to_string(i / 1000) + "." + to_string(i % 100) +
+                               ".0-rc." + to_string(i % 7) + "+build.1234");
+        else
+            versions.push_back(to_string(i / 1000) + "." + to_string(i % 100) +
+                               "." + to_string(i % 10) + "+script." +
+                               to_string(i % 37 + 1));
+    }
+    return versions;
+}
+
+template <typename Func>
+static void report(const char *name, const vector<string> &versions,
+                   Func func)
+{
+    auto start = chrono::steady_clock::now();
+    unsigned long sum = 0;
+    for (auto &v : versions)
+        sum += func(v);
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << versions.size() << " versions (checksum " << sum
+         << ") in " << secs.count() << " s = "
+         << versions.size() / 1e6 / secs.count() << " M/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_versions = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    auto versions = make_versions(num_versions);
+
+    report("legacy stringstream parse", versions, [](const string &s)
+        {
+            auto v = legacy_parse(s);
+            return v.mj + v.mn + v.pt + v.bm_ids.size();
+        });
+    report("semver::parse", versions, [](const string &s)
+        {
+            auto v = semver::parse(s);
+            return v.mj() + v.mn() + v.pt() + v.bm_ids().size();
+        });
+    report("semver::try_parse", versions, [](const string &s)
+        {
+            semver v = semver::zero();
+            semver::try_parse(s.data(), s.data() + s.size(), v);
+            return v.mj() + v.mn() + v.pt() + v.bm_ids().size();
+        });
+
+    return 0;
+}
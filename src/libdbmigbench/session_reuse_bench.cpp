@@ -0,0 +1,115 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "migrate.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+#include <soci/soci.h>
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// Write the given number of trivial upgrade scripts, all for version 1.0.0.
+///
+static void make_scripts(const fs::path &path, size_t num_scripts)
+{
+    fs::create_directories(path / "1.0.0");
+    for (size_t n = 1; n <= num_scripts; ++n) {
+        nowide::ofstream ofs{
+            (path / "1.0.0" / (to_string(n) + "_select.sql")).string().c_str()};
+        ofs << "SELECT 1;\n";
+    }
+}
+
+template <typename Func>
+static void report(const string &name, size_t num_scripts, Func func)
+{
+    auto start = chrono::steady_clock::now();
+    func();
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << num_scripts << " scripts in " << secs.count()
+         << " s = " << secs.count() * 1e3 / num_scripts << " ms/script"
+         << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // Connecting costs what it costs on the far side, so there is nothing
+    // to measure without a real database.
+    const char *target = argc > 1 ? argv[1] : getenv("DBMIG_BENCH_TARGET");
+    if (!target) {
+        cout << "session_reuse_bench: skipped; give a connection string to "
+                "a scratch database (or set DBMIG_BENCH_TARGET)" << endl;
+        return 0;
+    }
+    string conn_str = target;
+    size_t num_scripts = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100;
+
+    auto path = fs::temp_directory_path() /
+                fs::unique_path("dbmig-bench-%%%%-%%%%");
+    make_scripts(path / "upgrade", num_scripts);
+    auto upgrade_path = (path / "upgrade").string();
+    repository repo{path.string()};
+    // Each run records its scripts under a changeset of its own.
+    auto changeset = path.filename().string();
+    auto version_of = [](size_t n)
+    {
+        return semver::parse("1.0.0+script." + to_string(n));
+    };
+    auto script_of = [](size_t n)
+    {
+        return "1.0.0/" + to_string(n) + "_select.sql";
+    };
+
+    report("session per script", num_scripts, [&]
+        {
+            for (size_t n = 1; n <= num_scripts; ++n)
+                run_upgrade_script(conn_str, changeset + "-fresh",
+                                   version_of(n), upgrade_path, script_of(n));
+        });
+    report("one session", num_scripts, [&]
+        {
+            soci::session session{conn_str};
+            transaction_batch batch{session};
+            for (size_t n = 1; n <= num_scripts; ++n)
+                run_upgrade_script(batch, changeset + "-shared",
+                                   version_of(n), repo, script_of(n));
+        });
+    report("session borrowed from a pool", num_scripts, [&]
+        {
+            soci::connection_pool pool{1};
+            pool.at(0).open(conn_str);
+            for (size_t n = 1; n <= num_scripts; ++n) {
+                soci::session session{pool};
+                transaction_batch batch{session};
+                run_upgrade_script(batch, changeset + "-pooled",
+                                   version_of(n), repo, script_of(n));
+            }
+        });
+
+    fs::remove_all(path);
+    return 0;
+}
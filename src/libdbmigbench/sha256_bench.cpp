@@ -0,0 +1,82 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hash.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace dbmig;
+
+///
+/// Hash a message of the given size, fed from a (possibly smaller) buffer in
+/// updates of the given size.
+///
+template <typename Backend>
+static void hash_message(const string &buf, size_t message_size,
+                         size_t chunk_size)
+{
+    dbmig::hash<Backend> h;
+    for (size_t done = 0; done < message_size; done += chunk_size) {
+        auto n = min(chunk_size, message_size - done);
+        h.update(buf.data() + done % buf.size(), n);
+    }
+    h.finalise();
+}
+
+template <typename Backend>
+static void report(const char *name, const string &buf, size_t message_size,
+                   size_t chunk_size, size_t total_size)
+{
+    size_t repeats = max<size_t>(total_size / message_size, 1);
+    auto start = chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; ++r)
+        hash_message<Backend>(buf, message_size, chunk_size);
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << repeats << " x " << message_size / 1e3
+         << " KB in " << chunk_size << " byte updates in " << secs.count()
+         << " s = " << repeats * message_size / 1e9 / secs.count()
+         << " GB/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t total_size = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000000;
+    cout << "SHA256 instructions supported: "
+         << (accelerated_sha256::hardware_supported() ? "yes" : "no") << endl;
+
+    // Larger messages are fed repeatedly from a smaller buffer, to keep
+    // memory use down.
+    for (size_t message_size : {1000, 1000000, 1000000000}) {
+        string buf(min<size_t>(message_size, 64000000), 'x');
+        // Line-sized updates, then the largest updates possible.
+        for (size_t chunk_size : {size_t{80}, buf.size()}) {
+            report<CryptoPP::SHA256>("cryptopp   ", buf, message_size,
+                                     chunk_size, total_size);
+            report<accelerated_sha256>("accelerated", buf, message_size,
+                                       chunk_size, total_size);
+        }
+    }
+
+    return 0;
+}
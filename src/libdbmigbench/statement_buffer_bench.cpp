@@ -0,0 +1,118 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "statement_buffer.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace dbmig;
+
+///
+/// Build a script of roughly the given number of lines: one large PL/pgSQL
+/// function followed by many small statements with quoted literals.
+///
+static vector<string> make_script(size_t num_lines)
+{
+    vector<string> lines;
+    lines.push_back("CREATE FUNCTION bench() RETURNS int AS $body$");
+    lines.push_back("DECLARE x int := 0;");
+    lines.push_back("BEGIN");
+    for (size_t i = 0; i < num_lines / 2; ++i)
+        lines.push_back("    x := x + 1; -- step " + to_string(i));
+    lines.push_back("    RETURN x;");
+    lines.push_back("END;");
+    lines.push_back("$body$ LANGUAGE plpgsql;");
+    for (size_t i = 0; i < num_lines / 2; ++i)
+        lines.push_back("INSERT INTO t VALUES (" + to_string(i) +
+                        ", 'it''s a ; test');");
+    for (auto &line : lines)
+        line += "\n";
+    return lines;
+}
+
+///
+/// The statement buffer as it was before sql_lexer, kept for comparison.
+///
+template <typename OutputIterator>
+static void legacy_split(const vector<string> &lines, OutputIterator oi)
+{
+    const boost::regex delim_regex{"'.*(?:go|;).*'|\".*(?:go|;).*\"|(go|;)",
+                                   boost::regex::icase};
+    string buf;
+    for (auto &line : lines) {
+        buf.append(line);
+        boost::smatch results;
+        while (boost::regex_search(buf, results, delim_regex) &&
+               !results.empty()) {
+            auto sm = results[0];
+            auto stmt = buf.substr(0, distance(buf.cbegin(), sm.first));
+            boost::trim(stmt);
+            buf.erase(0, distance(buf.cbegin(), sm.second));
+            *oi++ = stmt;
+        }
+    }
+}
+
+template <typename Func>
+static void report(const char *name, const vector<string> &lines, Func func)
+{
+    size_t bytes = 0;
+    for (auto &line : lines)
+        bytes += line.size();
+
+    vector<string> statements;
+    auto start = chrono::steady_clock::now();
+    func(lines, back_inserter(statements));
+    chrono::duration<double> secs = chrono::steady_clock::now() - start;
+
+    cout << name << ": " << lines.size() << " lines, "
+         << bytes / 1e6 << " MB, " << statements.size() << " statements in "
+         << secs.count() << " s = " << bytes / 1e6 / secs.count() << " MB/s"
+         << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_lines = argc > 1 ? strtoul(argv[1], nullptr, 10) : 400000;
+    size_t legacy_lines = argc > 2 ? strtoul(argv[2], nullptr, 10) : 4000;
+
+    report("sql_lexer", make_script(num_lines),
+        [](const vector<string> &lines,
+           back_insert_iterator<vector<string>> oi)
+        {
+            auto stmt_buf = make_statement_buffer(oi);
+            for (auto &line : lines)
+                stmt_buf.append(line);
+            stmt_buf.finalise();
+        });
+    report("legacy regex", make_script(legacy_lines),
+        [](const vector<string> &lines,
+           back_insert_iterator<vector<string>> oi)
+        {
+            legacy_split(lines, oi);
+        });
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bundle.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE bundle_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <string>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "pair_special.hpp"
+#include "repository.hpp"
+#include "mapped_script.hpp"
+#include "exception.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// A bundle file that is removed again at the end of a test
+///
+struct temp_bundle : temp_file
+{
+    temp_bundle() : temp_file{".dbmig"} {}
+};
+
+///
+/// Copy a list of statement views into strings, for easy comparison.
+///
+template<typename List>
+static vector<string> to_strings(const List &statements)
+{
+    vector<string> v;
+    for (auto &s : statements)
+        v.push_back(s.to_string());
+    return v;
+}
+
+///
+/// Write the given bytes to a file.
+///
+static void write_file(const string &path, const string &content)
+{
+    nowide::ofstream ofs{path.c_str(), ios::out | ios::binary};
+    ofs << content;
+}
+
+BOOST_AUTO_TEST_CASE (repo4_is_not_bundle)
+{
+    BOOST_CHECK(!is_bundle("data/repo4"));
+    BOOST_CHECK(!is_bundle("data/no_such_thing"));
+    repository r4("data/repo4");
+    BOOST_CHECK(r4.script_bundle() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE (repo4_pack_index)
+{
+    temp_bundle tb;
+    repository dir("data/repo4");
+    write_bundle(dir, tb.path);
+    BOOST_REQUIRE(is_bundle(tb.path));
+    
+    repository packed(tb.path);
+    BOOST_REQUIRE(packed.script_bundle() != nullptr);
+    BOOST_CHECK_EQUAL(packed.upgrade_script_path(), tb.path);
+    BOOST_CHECK_EQUAL(packed.install_script_path(), tb.path);
+    BOOST_CHECK_EQUAL(packed.latest_version(), dir.latest_version());
+    
+    for (auto action : {script_action::install, script_action::upgrade}) {
+        auto &expected = dir.scripts(action);
+        auto &actual = packed.scripts(action);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(),
+                                      expected.begin(), expected.end());
+    }
+    
+    // Ranges over the index behave as they do for a directory.
+    auto v = semver::parse("2.44.2+script.57");
+    auto t = semver::parse("2.45.1+script.1");
+    auto expected = dir.upgrade_scripts(v, t);
+    auto actual = packed.upgrade_scripts(v, t);
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(),
+                                  expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE (repo4_pack_statements_and_hashes)
+{
+    temp_bundle tb;
+    repository dir("data/repo4");
+    write_bundle(dir, tb.path);
+    repository packed(tb.path);
+    auto &b = *packed.script_bundle();
+    
+    for (auto action : {script_action::install, script_action::upgrade,
+                        script_action::rollback}) {
+        auto &base = action == script_action::install
+            ? dir.install_script_path() : dir.upgrade_script_path();
+        for (auto &script : dir.scripts(action)) {
+            mapped_script ms{base + "/" + script.second};
+            auto expected = to_strings(ms.statements(action));
+            auto actual = to_strings(b.statements(action, script.second));
+            BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(),
+                                          expected.begin(), expected.end());
+            BOOST_CHECK_EQUAL(b.sha256_sum(action, script.second),
+                              ms.sha256_sum());
+            BOOST_CHECK_EQUAL(
+                calculate_script_hash(packed, action, script.second),
+                calculate_script_hash(dir, action, script.second));
+        }
+    }
+    
+    auto rb = to_strings(b.statements(script_action::rollback,
+                                      "2.44.3/0001_foo.sql"));
+    BOOST_REQUIRE_EQUAL(rb.size(), 2);
+    BOOST_CHECK_EQUAL(rb[0], "SELECT 'baz'");
+    BOOST_CHECK_EQUAL(rb[1], "SELECT 'quux'");
+    
+    BOOST_CHECK_THROW(b.statements(script_action::upgrade, "nonexistent.sql"),
+                      out_of_range);
+    BOOST_CHECK_THROW(b.sha256_sum(script_action::install,
+                                   "2.44.3/0001_foo.sql"),
+                      out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE (repack_bundle_refused)
+{
+    temp_bundle tb, tb2;
+    write_bundle(repository{"data/repo4"}, tb.path);
+    BOOST_CHECK_THROW(write_bundle(repository{tb.path}, tb2.path),
+                      invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE (malformed_bundles)
+{
+    // Not a bundle at all.
+    BOOST_CHECK_THROW(repository{"data/regularfile.txt"}, bad_bundle);
+    
+    temp_bundle tb;
+    write_bundle(repository{"data/repo4"}, tb.path);
+    string content;
+    {
+        nowide::ifstream ifs{tb.path.c_str(), ios::in | ios::binary};
+        content.assign(istreambuf_iterator<char>(ifs),
+                       istreambuf_iterator<char>());
+    }
+    
+    // Truncated anywhere.
+    for (auto size : {size_t(4), size_t(40), size_t(100),
+                      content.size() - 1}) {
+        write_file(tb.path, content.substr(0, size));
+        BOOST_CHECK_THROW(bundle{tb.path}, bad_bundle);
+    }
+    
+    // A later format version.
+    string later = content;
+    later[8] = 2;
+    write_file(tb.path, later);
+    BOOST_CHECK_THROW(bundle{tb.path}, bad_bundle);
+    
+    // Intact again.
+    write_file(tb.path, content);
+    BOOST_CHECK_NO_THROW(bundle{tb.path});
+}
@@ -0,0 +1,179 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "char_scan.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE char_scan_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "getline.hpp"
+#include "mapped_script.hpp"
+#include "script_stream.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+
+///
+/// Instruction sets that can be tested on this CPU.
+///
+static vector<scan_isa> supported_isas()
+{
+    vector<scan_isa> isas{scan_isa::scalar};
+    if (best_scan_isa() >= scan_isa::sse2)
+        isas.push_back(scan_isa::sse2);
+    if (best_scan_isa() >= scan_isa::avx2)
+        isas.push_back(scan_isa::avx2);
+    return isas;
+}
+
+///
+/// Make a random string with characters drawn from an alphabet.
+///
+static string random_string(mt19937 &gen, size_t size, const string &alphabet)
+{
+    uniform_int_distribution<size_t> dist{0, alphabet.size() - 1};
+    string s(size, ' ');
+    for (auto &c : s)
+        c = alphabet[dist(gen)];
+    return s;
+}
+
+///
+/// Find all SQL script fixtures.
+///
+static vector<string> sql_fixtures()
+{
+    namespace fs = boost::filesystem;
+    vector<string> paths;
+    for (fs::recursive_directory_iterator i{"data"}, e; i != e; ++i) {
+        if (fs::is_regular_file(*i) && i->path().extension() == ".sql")
+            paths.push_back(i->path().string());
+    }
+    sort(paths.begin(), paths.end());
+    return paths;
+}
+
+typedef vector<pair<string, string>> line_list;
+
+static line_list lines_via_getline(istream &is)
+{
+    line_list lines;
+    string line, line_ending;
+    while (multiplatform_getline(is, line, line_ending))
+        lines.emplace_back(line, line_ending);
+    return lines;
+}
+
+static line_list lines_via_reader(istream &is, size_t block_size)
+{
+    line_list lines;
+    line_reader<istream> reader{is, block_size};
+    string line, line_ending;
+    while (reader.getline(line, line_ending))
+        lines.emplace_back(line, line_ending);
+    return lines;
+}
+
+BOOST_AUTO_TEST_CASE (find_first_of_matches_scalar)
+{
+    mt19937 gen{42};
+    const char_set sets[] = {
+        {'\n'}, {'\n', '\r'}, {';', '\'', '"', '\n', '\r', '-', '/', '$'}};
+    for (auto isa : supported_isas()) {
+        for (size_t size = 0; size < 200; ++size) {
+            auto s = random_string(gen, size, "abc;'\"\n\r-/$xyz");
+            auto b = s.data(), e = s.data() + s.size();
+            for (auto &set : sets) {
+                // Try each starting offset, to vary the alignment.
+                for (auto p = b; p != e; ++p)
+                    BOOST_REQUIRE(find_first_of(p, e, set, isa) ==
+                                  find_first_of(p, e, set, scan_isa::scalar));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (find_string_matches_scalar)
+{
+    mt19937 gen{42};
+    const string needles[] = {script_partition_marker, "--", "UNDO"};
+    for (auto isa : supported_isas()) {
+        for (size_t size = 0; size < 300; ++size) {
+            auto s = random_string(gen, size, "--//@UNDO\n ");
+            auto b = s.data(), e = s.data() + s.size();
+            for (auto &n : needles) {
+                auto nb = n.data(), ne = n.data() + n.size();
+                BOOST_REQUIRE(find_string(b, e, nb, ne, isa) ==
+                              search(b, e, nb, ne));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (line_reader_block_boundaries)
+{
+    // Small blocks split CRLF pairs across reads.
+    string text = "a\r\nbb\rccc\n\r\n\n\rd";
+    for (size_t block_size = 1; block_size < 8; ++block_size) {
+        istringstream expected_is{text}, actual_is{text};
+        auto expected = lines_via_getline(expected_is);
+        auto actual = lines_via_reader(actual_is, block_size);
+        BOOST_CHECK(actual == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (line_reader_fixtures)
+{
+    for (auto &path : sql_fixtures()) {
+        for (size_t block_size : {1, 3, 64, 65536}) {
+            nowide::ifstream expected_is{path.c_str()};
+            nowide::ifstream actual_is{path.c_str()};
+            auto expected = lines_via_getline(expected_is);
+            auto actual = lines_via_reader(actual_is, block_size);
+            BOOST_CHECK_MESSAGE(actual == expected, path);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (statements_fixtures)
+{
+    // The stream and mapped readers split lines independently, so check that
+    // they agree on the statements and hash of every fixture.
+    for (auto &path : sql_fixtures()) {
+        nowide::ifstream ifs{path.c_str()};
+        auto streamed = read_script(ifs, script_action::upgrade);
+        mapped_script mapped{path};
+        for (auto action : {script_action::upgrade, script_action::rollback}) {
+            auto &expected = streamed.statements(action);
+            vector<string> actual;
+            for (auto &s : mapped.statements(action))
+                actual.push_back(s.to_string());
+            BOOST_CHECK_MESSAGE(actual == expected, path);
+        }
+        BOOST_CHECK_EQUAL(mapped.sha256_sum(), streamed.sha256_sum());
+    }
+}
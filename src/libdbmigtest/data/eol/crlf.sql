@@ -0,0 +1,9 @@
+-- Script with a multi-line literal.
+
+insert into note (body)
+values ('first line
+second line');
+
+GO
+--//@UNDO
+delete from note;
@@ -0,0 +1,272 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dir_scan.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE dir_scan_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "script_dir.hpp"
+#include "exception.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// List a directory, sorted by name.
+///
+static dir_entry_list sorted_listing(const string &path)
+{
+    auto entries = list_directory(path);
+    sort(entries.begin(), entries.end(),
+         [](const dir_entry &a, const dir_entry &b) { return a.name < b.name; });
+    return entries;
+}
+
+static vector<string> paths_of(const script_dir &sd)
+{
+    vector<string> paths;
+    for (auto &script : sd)
+        paths.push_back(script.second);
+    return paths;
+}
+
+BOOST_AUTO_TEST_CASE (scriptdir1_listing)
+{
+    auto entries = sorted_listing("data/scriptdir1");
+    BOOST_REQUIRE_EQUAL(entries.size(), 4);
+    BOOST_CHECK_EQUAL(entries[0].name, "43.209.153");
+    BOOST_CHECK(entries[0].type == dir_entry_type::directory);
+    BOOST_CHECK_EQUAL(entries[1].name, "43.209.153+script.17389_foo.sql");
+    BOOST_CHECK(entries[1].type == dir_entry_type::file);
+    BOOST_CHECK_EQUAL(entries[2].name, "43.210.0");
+    BOOST_CHECK(entries[2].type == dir_entry_type::directory);
+    BOOST_CHECK_EQUAL(entries[3].name, "43.210.1");
+    BOOST_CHECK(entries[3].type == dir_entry_type::directory);
+}
+
+BOOST_AUTO_TEST_CASE (missing_directory)
+{
+    BOOST_CHECK_THROW(list_directory("data/no_such_dir"),
+                      fs::filesystem_error);
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE (symlinks_followed)
+{
+    temp_dir dir;
+    dir.touch("1.0.0+script.1.sql");
+    fs::create_directory(dir.path / "real");
+    fs::create_symlink("1.0.0+script.1.sql", dir.path / "link.sql");
+    fs::create_directory_symlink("real", dir.path / "link_dir");
+    fs::create_symlink("nowhere", dir.path / "dangling.sql");
+    
+    auto entries = sorted_listing(dir.path.string());
+    BOOST_REQUIRE_EQUAL(entries.size(), 5);
+    BOOST_CHECK_EQUAL(entries[0].name, "1.0.0+script.1.sql");
+    BOOST_CHECK(entries[0].type == dir_entry_type::file);
+    BOOST_CHECK_EQUAL(entries[1].name, "dangling.sql");
+    BOOST_CHECK(entries[1].type == dir_entry_type::other);
+    BOOST_CHECK_EQUAL(entries[2].name, "link.sql");
+    BOOST_CHECK(entries[2].type == dir_entry_type::file);
+    BOOST_CHECK_EQUAL(entries[3].name, "link_dir");
+    BOOST_CHECK(entries[3].type == dir_entry_type::directory);
+    BOOST_CHECK_EQUAL(entries[4].name, "real");
+    BOOST_CHECK(entries[4].type == dir_entry_type::directory);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE (many_sub_dirs)
+{
+    // Enough sub-directories to keep several threads busy.
+    temp_dir dir;
+    for (int v = 1; v <= 50; ++v) {
+        auto sub_dir = "1." + to_string(v) + ".0";
+        fs::create_directory(dir.path / sub_dir);
+        for (int n = 1; n <= 3; ++n)
+            dir.touch(sub_dir + "/000" + to_string(n) + "_change.sql");
+    }
+    
+    script_dir sd{dir.path.string()};
+    BOOST_REQUIRE_EQUAL(distance(sd.begin(), sd.end()), 150);
+    BOOST_CHECK_EQUAL(sd.begin()->first, semver::parse("1.1.0+script.1"));
+    BOOST_CHECK_EQUAL(sd.begin()->second, "1.1.0/0001_change.sql");
+    BOOST_CHECK_EQUAL(sd.rbegin()->first, semver::parse("1.50.0+script.3"));
+    BOOST_CHECK(is_sorted(sd.begin(), sd.end(),
+        [](const script_dir::value_type &a, const script_dir::value_type &b)
+        {
+            return a.first < b.first;
+        }));
+}
+
+BOOST_AUTO_TEST_CASE (errors_from_sub_dirs)
+{
+    temp_dir dir;
+    for (int v = 1; v <= 20; ++v)
+        fs::create_directory(dir.path / ("1." + to_string(v) + ".0"));
+    dir.touch("1.7.0/0001_change.sql");
+    dir.touch("1.9.0/bad_name.sql");
+    BOOST_CHECK_THROW(script_dir{dir.path.string()}, bad_subdir_filename);
+    
+    // Versions must still be unique, wherever the scripts were found.
+    fs::remove(dir.path / "1.9.0/bad_name.sql");
+    dir.touch("1.7.0+script.1.sql");
+    BOOST_CHECK_THROW(script_dir{dir.path.string()},
+                      script_dir_uniqueness_violation);
+}
+
+BOOST_AUTO_TEST_CASE (open_relative_to_parent)
+{
+    temp_dir dir;
+    fs::create_directories(dir.path / "a/b");
+    dir.touch("a/b/1.0.0+script.1.sql");
+    
+    open_dir root{dir.path.string()};
+    open_dir b{root, "a/b"};
+    BOOST_CHECK_EQUAL(b.path(), dir.path.string() + "/a/b");
+    auto entries = b.list();
+    BOOST_REQUIRE_EQUAL(entries.size(), 1);
+    BOOST_CHECK_EQUAL(entries[0].name, "1.0.0+script.1.sql");
+    BOOST_CHECK(entries[0].type == dir_entry_type::file);
+    
+    // Listing again starts from the beginning.
+    BOOST_CHECK_EQUAL(b.list().size(), 1);
+    
+    BOOST_CHECK(b.same_directory_as(open_dir{dir.file("a/b")}));
+    BOOST_CHECK(!b.same_directory_as(root));
+    BOOST_CHECK_THROW((open_dir{root, "missing"}), fs::filesystem_error);
+    BOOST_CHECK_THROW((open_dir{b, "1.0.0+script.1.sql"}),
+                      fs::filesystem_error);
+}
+
+BOOST_AUTO_TEST_CASE (tree_walked)
+{
+    temp_dir dir;
+    fs::create_directories(dir.path / "a/b/c");
+    fs::create_directories(dir.path / "a/d");
+    fs::create_directories(dir.path / "skipped/e");
+    dir.touch("a/f.sql");
+    
+    vector<string> visited;
+    walk_directory_tree(open_dir{dir.path.string()},
+        [&](const string &relative_path, const open_dir &d,
+            dir_entry_list &entries)
+        {
+            BOOST_CHECK_EQUAL(d.path(), relative_path.empty()
+                ? dir.path.string() : dir.file(relative_path));
+            visited.push_back(relative_path);
+            entries.erase(remove_if(entries.begin(), entries.end(),
+                [](const dir_entry &entry)
+                {
+                    return entry.name == "skipped";
+                }),
+                entries.end());
+        });
+    sort(visited.begin(), visited.end());
+    BOOST_CHECK((visited == vector<string>{"", "a", "a/b", "a/b/c", "a/d"}));
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE (grouped_and_linked_sub_dirs)
+{
+    // Version sub-directories grouped by major and minor version, one of
+    // them a link into a library of scripts shared with other repositories.
+    temp_dir library;
+    fs::create_directory(library.path / "2.1.0");
+    library.touch("2.1.0/0001_shared.sql");
+    
+    temp_dir dir;
+    fs::create_directories(dir.path / "1/1.0/1.0.0");
+    fs::create_directories(dir.path / "1/1.1/1.1.0");
+    fs::create_directories(dir.path / "2/2.1");
+    dir.touch("1/1.0/1.0.0/0001_a.sql");
+    dir.touch("1/1.0/1.0.0/0002_b.sql");
+    dir.touch("1/1.1/1.1.0/0001_c.sql");
+    dir.touch("1.0.1+script.1_d.sql");
+    fs::create_directory_symlink(library.path / "2.1.0",
+                                 dir.path / "2/2.1/2.1.0");
+    
+    auto expected = vector<string>{
+        "1/1.0/1.0.0/0001_a.sql", "1/1.0/1.0.0/0002_b.sql",
+        "1.0.1+script.1_d.sql", "1/1.1/1.1.0/0001_c.sql",
+        "2/2.1/2.1.0/0001_shared.sql"};
+    script_dir sd{dir.path.string()};
+    BOOST_CHECK(paths_of(sd) == expected);
+    BOOST_CHECK_EQUAL(sd.rbegin()->first, semver::parse("2.1.0+script.1"));
+    
+    script_dir lazy{dir.path.string(), ".sql", lazy_loading};
+    BOOST_REQUIRE_EQUAL(distance(lazy.latest().begin(), lazy.latest().end()),
+                        1);
+    BOOST_CHECK_EQUAL(lazy.latest().begin()->second,
+                      "2/2.1/2.1.0/0001_shared.sql");
+    BOOST_CHECK(paths_of(lazy) == expected);
+    
+    // A grouping directory may not hold scripts itself.
+    dir.touch("1/1.1/0001_stray.sql");
+    try {
+        script_dir{dir.path.string()};
+        BOOST_ERROR("a stray script was not reported");
+    }
+    catch (const bad_subdir_filename &e) {
+        BOOST_CHECK_EQUAL(e.path(), "1/1.1/0001_stray.sql");
+    }
+    
+    // Nor may a version sub-directory hold a badly-named one.
+    fs::remove(dir.path / "1/1.1/0001_stray.sql");
+    dir.touch("1/1.1/1.1.0/stray.sql");
+    try {
+        script_dir{dir.path.string()};
+        BOOST_ERROR("a bad filename was not reported");
+    }
+    catch (const bad_subdir_filename &e) {
+        BOOST_CHECK_EQUAL(e.path(), "1/1.1/1.1.0/stray.sql");
+    }
+}
+
+BOOST_AUTO_TEST_CASE (symlink_cycles_detected)
+{
+    temp_dir dir;
+    fs::create_directories(dir.path / "1/1.0/1.0.0");
+    dir.touch("1/1.0/1.0.0/0001_a.sql");
+    fs::create_directory_symlink("..", dir.path / "1/1.0/loop");
+    try {
+        script_dir{dir.path.string()};
+        BOOST_ERROR("a symbolic link cycle was followed");
+    }
+    catch (const fs::filesystem_error &e) {
+        BOOST_CHECK(e.code() == boost::system::errc::make_error_code(
+            boost::system::errc::too_many_symbolic_link_levels));
+    }
+    
+    // Two links to the same directory are no cycle, so long as neither
+    // leads back up the tree.
+    fs::remove(dir.path / "1/1.0/loop");
+    fs::create_directory(dir.path / "empty");
+    fs::create_directory_symlink("../../empty", dir.path / "1/1.0/link1");
+    fs::create_directory_symlink("../../empty", dir.path / "1/1.0/link2");
+    BOOST_CHECK_EQUAL(paths_of(script_dir{dir.path.string()}).size(), 1);
+}
+#endif
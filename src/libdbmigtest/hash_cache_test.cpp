@@ -0,0 +1,197 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hash_cache.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE hash_cache_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "repository.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+static const string foo_sum =
+    "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a";
+
+///
+/// Write a file, and backdate it so that the cache considers it safe.
+///
+static void write_file(const string &path, const string &content,
+                       const time_t age = 60)
+{
+    {
+        nowide::ofstream ofs{path.c_str()};
+        ofs << content;
+    }
+    fs::last_write_time(path, time(nullptr) - age);
+}
+
+BOOST_AUTO_TEST_CASE (lookup_requires_matching_stat)
+{
+    temp_dir dir;
+    hash_cache cache{dir.file(hash_cache_filename)};
+    script_file_stat st{10, 1000000000, 42};
+    string sum;
+    
+    BOOST_CHECK(!cache.lookup(script_action::upgrade, "1.0.0/0001_a.sql", st,
+                              sum));
+    cache.store(script_action::upgrade, "1.0.0/0001_a.sql", st, foo_sum);
+    BOOST_CHECK(cache.lookup(script_action::upgrade, "1.0.0/0001_a.sql", st,
+                             sum));
+    BOOST_CHECK_EQUAL(sum, foo_sum);
+    
+    // Rollback shares the upgrade entry, but install does not.
+    BOOST_CHECK(cache.lookup(script_action::rollback, "1.0.0/0001_a.sql", st,
+                             sum));
+    BOOST_CHECK(!cache.lookup(script_action::install, "1.0.0/0001_a.sql", st,
+                              sum));
+    
+    // Any change to the file's identity invalidates the entry.
+    for (auto changed : {script_file_stat{11, 1000000000, 42},
+                         script_file_stat{10, 1000000001, 42},
+                         script_file_stat{10, 1000000000, 43}}) {
+        BOOST_CHECK(!cache.lookup(script_action::upgrade, "1.0.0/0001_a.sql",
+                                  changed, sum));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (recent_files_not_stored)
+{
+    temp_dir dir;
+    hash_cache cache{dir.file(hash_cache_filename)};
+    auto script = dir.file("0001_a.sql");
+    {
+        nowide::ofstream ofs{script.c_str()};
+        ofs << "SELECT 1\n";
+    }
+    auto st = stat_script_file(script);
+    string sum;
+    cache.store(script_action::upgrade, "0001_a.sql", st, foo_sum);
+    BOOST_CHECK(!cache.lookup(script_action::upgrade, "0001_a.sql", st, sum));
+}
+
+BOOST_AUTO_TEST_CASE (save_and_reload)
+{
+    temp_dir dir;
+    auto path = dir.file(hash_cache_filename);
+    script_file_stat st{10, 1000000000, 42};
+    {
+        hash_cache cache{path};
+        cache.store(script_action::install, "1.0.0/with space\t.sql", st,
+                    foo_sum);
+        BOOST_CHECK(cache.save());
+    }
+    
+    hash_cache cache{path};
+    string sum;
+    BOOST_CHECK(cache.lookup(script_action::install, "1.0.0/with space\t.sql",
+                             st, sum));
+    BOOST_CHECK_EQUAL(sum, foo_sum);
+    
+    // Nothing but the cache itself is left behind.
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator{dir.path},
+                               fs::directory_iterator{}), 1);
+}
+
+BOOST_AUTO_TEST_CASE (corrupt_cache_ignored)
+{
+    temp_dir dir;
+    auto path = dir.file(hash_cache_filename);
+    write_file(path, "dbmig-hash-cache 1\nupgrade\tgarbage\n"
+                     "nonsense\t1 2 3 " + foo_sum + "\tx.sql\n");
+    hash_cache cache{path};
+    string sum;
+    BOOST_CHECK(!cache.lookup(script_action::upgrade, "x.sql", {1, 2, 3},
+                              sum));
+    
+    write_file(path, "not a cache at all");
+    BOOST_CHECK_NO_THROW(hash_cache{path});
+}
+
+BOOST_AUTO_TEST_CASE (calculate_with_cache)
+{
+    temp_dir dir;
+    fs::create_directories(dir.path / "install");
+    fs::create_directories(dir.path / "upgrade" / "1.0.0");
+    auto script = dir.file("upgrade/1.0.0/0001_a.sql");
+    write_file(script, "SELECT 1\n");
+    repository repo{dir.path.string()};
+    auto cache_path = dir.file(hash_cache_filename);
+    
+    string first_sum;
+    {
+        hash_cache cache{cache_path};
+        first_sum = calculate_script_hash(
+            repo, script_action::upgrade, "1.0.0/0001_a.sql", cache);
+        BOOST_CHECK_EQUAL(first_sum, calculate_script_hash(
+            repo, script_action::upgrade, "1.0.0/0001_a.sql"));
+        BOOST_CHECK(cache.save());
+    }
+    
+    // Changing the script invalidates its entry.
+    write_file(script, "SELECT 2\n", 30);
+    hash_cache cache{cache_path};
+    auto second_sum = calculate_script_hash(
+        repo, script_action::upgrade, "1.0.0/0001_a.sql", cache);
+    BOOST_CHECK(second_sum != first_sum);
+    BOOST_CHECK_EQUAL(second_sum, calculate_script_hash(
+        repo, script_action::upgrade, "1.0.0/0001_a.sql"));
+}
+
+BOOST_AUTO_TEST_CASE (concurrent_store_lookup)
+{
+    temp_dir dir;
+    hash_cache cache{dir.file(hash_cache_filename)};
+    // Boost.Test assertions are not thread-safe, so just count misses.
+    std::atomic<int> misses{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&cache, &misses, t]()
+        {
+            for (int i = 0; i < 1000; ++i) {
+                auto path = to_string(t) + "/" + to_string(i) + ".sql";
+                script_file_stat st{1, 1, static_cast<uint64_t>(i)};
+                string sum;
+                cache.store(script_action::upgrade, path, st, foo_sum);
+                if (!cache.lookup(script_action::upgrade, path, st, sum))
+                    ++misses;
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    BOOST_CHECK_EQUAL(misses, 0);
+    BOOST_CHECK(cache.save());
+}
+
+BOOST_AUTO_TEST_CASE (stat_nonexistent)
+{
+    BOOST_CHECK_THROW(stat_script_file("data/nonexistent/path.sql"),
+                      fs::filesystem_error);
+}
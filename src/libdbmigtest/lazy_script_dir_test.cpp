@@ -0,0 +1,227 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_dir.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE lazy_script_dir_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "repository.hpp"
+#include "exception.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+typedef vector<script_dir::value_type> script_list;
+
+///
+/// Make a directory with scripts in sub-directories 1.1.0 to 1.50.0, and a
+/// few more directly within it.
+///
+static void make_many_versions(const temp_dir &dir)
+{
+    for (int v = 1; v <= 50; ++v) {
+        auto sub_dir = "1." + to_string(v) + ".0";
+        fs::create_directory(dir.path / sub_dir);
+        for (int n = 1; n <= 3; ++n)
+            dir.touch(sub_dir + "/000" + to_string(n) + "_change.sql");
+    }
+    dir.touch("1.7.0+script.5_extra.sql");
+    dir.touch("1.20.1+script.1.sql");
+    fs::create_directory(dir.path / "1.30.0");
+}
+
+static script_list contents(const script_dir::const_iterator_range &r)
+{
+    return script_list(r.begin(), r.end());
+}
+
+static bool same(const script_list &a, const script_list &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].first != b[i].first || a[i].second != b[i].second)
+            return false;
+    }
+    return true;
+}
+
+///
+/// Versions worth querying a script directory for: each script's version,
+/// and versions just either side of each principal version.
+///
+static vector<semver> query_versions(const script_dir &sd)
+{
+    vector<semver> versions{semver::zero(), semver::parse("999.0.0")};
+    for (auto &script : sd) {
+        auto &v = script.first;
+        versions.push_back(v);
+        versions.push_back(semver{v.mj(), v.mn(), v.pt()});
+        versions.push_back(semver{v.mj(), v.mn(), v.pt() + 1});
+        versions.push_back(semver::parse(
+            to_string(v.mj()) + "." + to_string(v.mn()) + "." +
+            to_string(v.pt()) + "-alpha"));
+    }
+    sort(versions.begin(), versions.end(), semver::metadata_compare{});
+    versions.erase(unique(versions.begin(), versions.end()), versions.end());
+    return versions;
+}
+
+///
+/// Check that every query on a lazy script directory matches the same query
+/// on one scanned in full.
+///
+static void check_matches_full_scan(const string &path)
+{
+    script_dir full{path};
+    auto versions = query_versions(full);
+    
+    // One lazy directory for all queries, so that each query starts from
+    // whatever earlier ones happened to list.
+    script_dir shared{path, ".sql", lazy_loading};
+    BOOST_CHECK(same(contents(full.latest()), contents(shared.latest())));
+    for (auto &from : versions) {
+        script_dir fresh{path, ".sql", lazy_loading};
+        auto expected = contents(full.latest_not_after(from));
+        BOOST_CHECK(same(expected, contents(fresh.latest_not_after(from))));
+        BOOST_CHECK(same(expected, contents(shared.latest_not_after(from))));
+        
+        for (auto &to : versions) {
+            auto expected = contents(full.range(from, to));
+            BOOST_CHECK(same(expected, contents(shared.range(from, to))));
+        }
+    }
+    
+    // Walking the whole directory lists everything.
+    script_list all(shared.begin(), shared.end());
+    BOOST_CHECK(same(script_list(full.begin(), full.end()), all));
+}
+
+BOOST_AUTO_TEST_CASE (scriptdir1_matches_full_scan)
+{
+    check_matches_full_scan("data/scriptdir1");
+}
+
+BOOST_AUTO_TEST_CASE (many_versions_match_full_scan)
+{
+    temp_dir dir;
+    make_many_versions(dir);
+    check_matches_full_scan(dir.path.string());
+}
+
+BOOST_AUTO_TEST_CASE (grouped_sub_dirs_match_full_scan)
+{
+    // The same versions, grouped by major and minor version.
+    temp_dir dir;
+    for (int v = 1; v <= 50; ++v) {
+        auto group = "1/1." + to_string(v);
+        auto sub_dir = group + "/1." + to_string(v) + ".0";
+        fs::create_directories(dir.path / sub_dir);
+        for (int n = 1; n <= 3; ++n)
+            dir.touch(sub_dir + "/000" + to_string(n) + "_change.sql");
+    }
+    dir.touch("1.7.0+script.5_extra.sql");
+    fs::create_directories(dir.path / "1/1.30/1.30.1");
+    check_matches_full_scan(dir.path.string());
+}
+
+BOOST_AUTO_TEST_CASE (only_needed_sub_dirs_listed)
+{
+    // A bad filename is only reported once its sub-directory is listed,
+    // which the queries below have no need to do.
+    temp_dir dir;
+    make_many_versions(dir);
+    dir.touch("1.40.0/bad_name.sql");
+    dir.touch("1.2.0/bad_name.sql");
+    
+    script_dir sd{dir.path.string(), ".sql", lazy_loading};
+    auto r = contents(sd.range(semver::parse("1.10.0+script.3"),
+                               semver::parse("1.11.0")));
+    BOOST_REQUIRE_EQUAL(r.size(), 3);
+    BOOST_CHECK_EQUAL(r[0].second, "1.11.0/0001_change.sql");
+    BOOST_CHECK_EQUAL(r[2].second, "1.11.0/0003_change.sql");
+    
+    auto latest = contents(sd.latest());
+    BOOST_REQUIRE_EQUAL(latest.size(), 1);
+    BOOST_CHECK_EQUAL(latest[0].first, semver::parse("1.50.0+script.3"));
+    
+    auto before = contents(sd.latest_not_after(semver::parse("1.20.5")));
+    BOOST_REQUIRE_EQUAL(before.size(), 1);
+    BOOST_CHECK_EQUAL(before[0].second, "1.20.1+script.1.sql");
+    
+    BOOST_CHECK_THROW(sd.range(semver::parse("1.39.0"),
+                               semver::parse("1.41.0")),
+                      bad_subdir_filename);
+    BOOST_CHECK_THROW(sd.begin(), bad_subdir_filename);
+}
+
+BOOST_AUTO_TEST_CASE (unversioned_sub_dirs_listed_up_front)
+{
+    temp_dir dir;
+    make_many_versions(dir);
+    fs::create_directory(dir.path / "misc");
+    dir.touch("misc/0001_change.sql");
+    BOOST_CHECK_THROW((script_dir{dir.path.string(), ".sql", lazy_loading}),
+                      bad_subdir_filename);
+}
+
+BOOST_AUTO_TEST_CASE (uniqueness_checked_when_listed)
+{
+    temp_dir dir;
+    make_many_versions(dir);
+    dir.touch("1.9.0+script.2.sql");
+    
+    script_dir sd{dir.path.string(), ".sql", lazy_loading};
+    BOOST_CHECK_THROW(sd.range(semver::parse("1.8.0"), semver::parse("1.9.0")),
+                      script_dir_uniqueness_violation);
+    
+    // What was listed before is still intact.
+    auto latest = contents(sd.latest());
+    BOOST_REQUIRE_EQUAL(latest.size(), 1);
+    BOOST_CHECK_EQUAL(latest[0].first, semver::parse("1.50.0+script.3"));
+}
+
+BOOST_AUTO_TEST_CASE (lazy_repository_matches_full_scan)
+{
+    for (auto path : {"data/repo1", "data/repo4"}) {
+        repository full{path};
+        repository lazy{path, script_loading::lazy};
+        BOOST_CHECK_EQUAL(full.latest_version(), lazy.latest_version());
+    
+        for (auto &v : query_versions(full.scripts(script_action::upgrade))) {
+            BOOST_CHECK(same(contents(full.nearest_install_script(v)),
+                             contents(lazy.nearest_install_script(v))));
+            BOOST_CHECK(same(contents(full.upgrade_script_at(v)),
+                             contents(lazy.upgrade_script_at(v))));
+        }
+    
+        auto from = semver::parse("2.44.2+script.57");
+        auto to = full.latest_version();
+        BOOST_CHECK(same(contents(full.upgrade_scripts(from, to)),
+                         contents(lazy.upgrade_scripts(from, to))));
+    }
+}
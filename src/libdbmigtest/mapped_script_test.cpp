@@ -0,0 +1,161 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mapped_script.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE mapped_script_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+#include <string>
+#include <vector>
+#include "script_stream.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+
+///
+/// Copy a list of statement views into strings, for easy comparison.
+///
+static vector<string> to_strings(const mapped_script::list_type &statements)
+{
+    vector<string> v;
+    for (auto &s : statements)
+        v.push_back(s.to_string());
+    return v;
+}
+
+///
+/// Read statements for an action through the stream-based reader.
+///
+static vector<string> read_via_stream(const string &path, script_action action)
+{
+    nowide::ifstream ifs{path.c_str()};
+    script_statement_stream<nowide::ifstream> statements{ifs, action};
+    return vector<string>(statements.begin(), statements.end());
+}
+
+BOOST_AUTO_TEST_CASE (repo4_upgrade_rollback)
+{
+    mapped_script script{"data/repo4/upgrade/2.44.3/0001_foo.sql"};
+    
+    auto u = to_strings(script.statements(script_action::upgrade));
+    BOOST_REQUIRE_EQUAL(u.size(), 2);
+    BOOST_CHECK_EQUAL(u[0], "SELECT 'foo'");
+    BOOST_CHECK_EQUAL(u[1], "SELECT 'bar'");
+    
+    auto r = to_strings(script.statements(script_action::rollback));
+    BOOST_REQUIRE_EQUAL(r.size(), 2);
+    BOOST_CHECK_EQUAL(r[0], "SELECT 'baz'");
+    BOOST_CHECK_EQUAL(r[1], "SELECT 'quux'");
+    
+    BOOST_CHECK_EQUAL(
+        script.sha256_sum(),
+        "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a");
+}
+
+BOOST_AUTO_TEST_CASE (repo4_empty)
+{
+    // Empty files can't be mapped, but should behave as an empty script.
+    mapped_script script{"data/repo4/upgrade/2.45.0/0001_quux.sql"};
+    BOOST_CHECK(script.statements(script_action::install).empty());
+    BOOST_CHECK_EQUAL(
+        script.sha256_sum(),
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+BOOST_AUTO_TEST_CASE (nonexistent_path)
+{
+    BOOST_CHECK_THROW(mapped_script{"data/nonexistent/path.sql"},
+        boost::filesystem::filesystem_error);
+}
+
+BOOST_AUTO_TEST_CASE (eol_statements)
+{
+    // Whatever the line endings, statements come out with LF endings.
+    vector<string> expected{
+        "-- Script with a multi-line literal.\n\n"
+        "insert into note (body)\n"
+        "values ('first line\nsecond line')"};
+    for (auto eol : {"lf", "crlf", "cr"}) {
+        mapped_script script{string("data/eol/") + eol + ".sql"};
+        auto u = to_strings(script.statements(script_action::upgrade));
+        BOOST_CHECK_EQUAL_COLLECTIONS(
+            u.begin(), u.end(), expected.begin(), expected.end());
+        auto r = to_strings(script.statements(script_action::rollback));
+        BOOST_REQUIRE_EQUAL(r.size(), 1);
+        BOOST_CHECK_EQUAL(r[0], "delete from note");
+    }
+}
+
+BOOST_AUTO_TEST_CASE (statement_lines)
+{
+    typedef mapped_script::line_range lines;
+    mapped_script::line_list l;
+    mapped_script foo{"data/repo4/upgrade/2.44.3/0001_foo.sql"};
+    foo.statements(script_action::upgrade, l);
+    BOOST_CHECK((l == mapped_script::line_list{lines{1, 1}, lines{3, 3}}));
+    foo.statements(script_action::rollback, l);
+    BOOST_CHECK((l == mapped_script::line_list{lines{6, 6}, lines{8, 8}}));
+    
+    // Lines are counted the same whatever the line endings.
+    for (auto eol : {"lf", "crlf", "cr"}) {
+        mapped_script script{string("data/eol/") + eol + ".sql"};
+        script.statements(script_action::upgrade, l);
+        BOOST_CHECK((l == mapped_script::line_list{lines{1, 5}}));
+        script.statements(script_action::rollback, l);
+        BOOST_CHECK((l == mapped_script::line_list{lines{9, 9}}));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (eol_hashes)
+{
+    // The hash covers the original line endings, as sha256sum would.
+    BOOST_CHECK_EQUAL(
+        mapped_script{"data/eol/lf.sql"}.sha256_sum(),
+        "6f712a2dc95136f052a10d816baed7d44c095ee7dcf89f7ff25394dbe973f511");
+    BOOST_CHECK_EQUAL(
+        mapped_script{"data/eol/crlf.sql"}.sha256_sum(),
+        "27c54d8e59f318b52c178c1a28eb42ce77219413e09c99087bf4c2a9882e9f72");
+    BOOST_CHECK_EQUAL(
+        mapped_script{"data/eol/cr.sql"}.sha256_sum(),
+        "7be76bb7c7bb776bcdfb271d32b85fb892c55fc019e250e750013f87389f28be");
+}
+
+BOOST_AUTO_TEST_CASE (same_as_stream_reader)
+{
+    vector<string> paths{
+        "data/eol/lf.sql", "data/eol/crlf.sql", "data/eol/cr.sql",
+        "data/repo1/install/1.0.0/1.0.0+script.0001_install.sql",
+        "data/repo1/upgrade/1.0.0/0002_more_fields.sql",
+        "data/repo1/upgrade/2.0.0/0001_strategic_shoe_sizes.sql",
+        "data/repo1/upgrade/2.0.0/0002_shoe_size_tactical_migration.sql",
+        "data/repo4/upgrade/2.44.3/0002_bar.sql"};
+    for (auto &path : paths) {
+        mapped_script script{path};
+        for (auto action : {script_action::install, script_action::upgrade,
+                            script_action::rollback}) {
+            auto mapped = to_strings(script.statements(action));
+            auto streamed = read_via_stream(path, action);
+            BOOST_CHECK_EQUAL_COLLECTIONS(mapped.begin(), mapped.end(),
+                                          streamed.begin(), streamed.end());
+        }
+    }
+}
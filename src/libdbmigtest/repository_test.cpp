@@ -21,7 +21,10 @@
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE repository_test
 #include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include "pair_special.hpp"
 
 #include "exception.hpp"
@@ -74,7 +77,7 @@ BOOST_AUTO_TEST_CASE (repo2_latest_version)
 BOOST_AUTO_TEST_CASE (repo4_nearest_install_script)
 {
     repository r4("data/repo4");
-    pair<const semver, string> exp1{
+    script_dir::value_type exp1{
         semver{2, 44, 2, "", "script.57"},
         "2.44.2/2.44.2+script.0057_install.sql"};
     
@@ -117,13 +120,13 @@ BOOST_AUTO_TEST_CASE (repo2_nearest_install_script)
 BOOST_AUTO_TEST_CASE (repo4_upgrade_scripts)
 {
     repository r4("data/repo4");
-    pair<const semver, string> exp1{
+    script_dir::value_type exp1{
         semver{2, 44, 3, "", "script.1"},
         "2.44.3/0001_foo.sql"};
-    pair<const semver, string> exp2{
+    script_dir::value_type exp2{
         semver{2, 44, 3, "", "script.2"},
         "2.44.3/0002_bar.sql"};
-    pair<const semver, string> exp3{
+    script_dir::value_type exp3{
         semver{2, 45, 0, "", "script.1"},
         "2.45.0/0001_quux.sql"};
     
@@ -165,13 +168,13 @@ BOOST_AUTO_TEST_CASE (repo2_upgrade_scripts)
 BOOST_AUTO_TEST_CASE (repo4_upgrade_script_at)
 {
     repository r4("data/repo4");
-    pair<const semver, string> exp1{
+    script_dir::value_type exp1{
         semver{2, 44, 3, "", "script.1"},
         "2.44.3/0001_foo.sql"};
-    pair<const semver, string> exp2{
+    script_dir::value_type exp2{
         semver{2, 44, 3, "", "script.2"},
         "2.44.3/0002_bar.sql"};
-    pair<const semver, string> exp3{
+    script_dir::value_type exp3{
         semver{2, 45, 0, "", "script.1"},
         "2.45.0/0001_quux.sql"};
     
@@ -207,17 +210,17 @@ BOOST_AUTO_TEST_CASE (repo3_upgrade_scripts_contiguous)
     // The below scripts in repository 3 should all be contiguous, and not
     // present any problems when asking for upgrade scripts across their range.
     repository repo3{"data/repo3"};
-    pair<const semver, string> e1{
+    script_dir::value_type e1{
         semver{5, 0, 0, "", "script.5"}, "5.0.0+script.5.sql"};
-    pair<const semver, string> e2{
+    script_dir::value_type e2{
         semver{5, 0, 0, "", "script.6"}, "5.0.0+script.6.sql"};
-    pair<const semver, string> e3{
+    script_dir::value_type e3{
         semver{5, 0, 0, "", "script.100"}, "5.0.0+script.100.sql"};
-    pair<const semver, string> e4{
+    script_dir::value_type e4{
         semver{5, 0, 1, "", "script.1"}, "5.0.1+script.1.sql"};
-    pair<const semver, string> e5{
+    script_dir::value_type e5{
         semver{5, 1, 0, "", "script.1"}, "5.1.0+script.1.sql"};
-    pair<const semver, string> e6{
+    script_dir::value_type e6{
         semver{6, 0, 0, "", "script.1"}, "6.0.0+script.1.sql"};
     
     // Single-number increment in script number is good.
@@ -284,5 +287,45 @@ BOOST_AUTO_TEST_CASE (repo3_upgrade_scripts_noncontiguous)
         dbmig::script_noncontiguous);
     BOOST_CHECK_THROW(repo3.upgrade_scripts(semver{33,0,0}, semver{35,0,0}),
         dbmig::script_noncontiguous);
+    
+    // The error names the version that the script should have followed on
+    // from.
+    try {
+        repo3.upgrade_scripts(semver{13,0,0}, semver{13,0,2});
+        BOOST_FAIL("Expected script_noncontiguous");
+    }
+    catch (const dbmig::script_noncontiguous &e) {
+        BOOST_CHECK_EQUAL(e.base_version(), semver::parse("13.0.0+script.13"));
+        BOOST_CHECK_EQUAL(e.script_version(),
+                          semver::parse("13.0.2+script.13"));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (script_dirs_opened_on_first_use)
+{
+    // Neither script directory exists, but that only matters once one is
+    // needed, and each attempt to open one tries again.
+    repository repo("data/scriptdir1");
+    BOOST_CHECK_EQUAL(repo.upgrade_script_path(), "data/scriptdir1/upgrade");
+    BOOST_CHECK_THROW(repo.upgrade_script_at(semver::parse("1.0.0+script.1")),
+        boost::filesystem::filesystem_error);
+    BOOST_CHECK_THROW(repo.upgrade_script_at(semver::parse("1.0.0+script.1")),
+        boost::filesystem::filesystem_error);
 }
 
+BOOST_AUTO_TEST_CASE (repo4_script_dirs_opened_once)
+{
+    repository r4("data/repo4");
+    vector<const script_dir *> opened(8);
+    vector<thread> threads;
+    for (auto &dir : opened) {
+        threads.emplace_back([&r4,&dir]
+            {
+                dir = &r4.scripts(script_action::upgrade);
+            });
+    }
+    for (auto &t : threads)
+        t.join();
+    for (auto dir : opened)
+        BOOST_CHECK_EQUAL(dir, &r4.scripts(script_action::rollback));
+}
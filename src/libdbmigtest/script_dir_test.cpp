@@ -23,6 +23,8 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/filesystem.hpp>
 #include "pair_special.hpp"
+#include "exception.hpp"
+#include "semver_compare.hpp"
 
 // Specialise some non-member operators for pair<semver, string>, so that we
 // can pass pairs to the macros directly.
@@ -339,3 +341,84 @@ BOOST_AUTO_TEST_CASE (scriptdir1_range)
     BOOST_CHECK(p51.first == p51.second);
 }
 
+
+BOOST_AUTO_TEST_CASE (known_scripts_sorted)
+{
+    // Scripts supplied out of order are sorted, and searchable.
+    script_dir::list_type scripts{
+        {semver{1,0,1,"","script.1"}, "1.0.1/0001_b.sql"},
+        {semver{1,0,0,"","script.2"}, "1.0.0/0002_a.sql"},
+        {semver{1,0,0,"","script.1"}, "1.0.0/0001_a.sql"}};
+    script_dir sd("bundled", std::move(scripts));
+    BOOST_CHECK_EQUAL(sd.path(), "bundled");
+    BOOST_REQUIRE_EQUAL(distance(sd.begin(), sd.end()), 3);
+    BOOST_CHECK_EQUAL(sd.begin()->second, "1.0.0/0001_a.sql");
+    BOOST_CHECK_EQUAL(sd.rbegin()->second, "1.0.1/0001_b.sql");
+    
+    auto r = sd.range(semver{1,0,0,"","script.1"}, semver{1,0,1});
+    BOOST_REQUIRE_EQUAL(distance(r.first, r.second), 2);
+    BOOST_CHECK_EQUAL(r.first->second, "1.0.0/0002_a.sql");
+}
+
+BOOST_AUTO_TEST_CASE (known_scripts_uniqueness)
+{
+    script_dir::list_type scripts{
+        {semver{1,0,0,"","script.1"}, "1.0.0/0001_a.sql"},
+        {semver{1,0,1,"","script.1"}, "1.0.1/0001_b.sql"},
+        {semver{1,0,0,"","script.1"}, "1.0.0+script.1_c.sql"}};
+    BOOST_CHECK_THROW(script_dir("bundled", std::move(scripts)),
+                      script_dir_uniqueness_violation);
+}
+
+BOOST_AUTO_TEST_CASE (script_key_matches_full_compare)
+{
+    // Packed keys must order every pair of versions exactly as the full
+    // comparisons do, including versions that cannot be packed at all.
+    vector<semver> versions{
+        semver{1,0,0}, semver{1,0,0,"","script.1"},
+        semver{1,0,0,"","script.2"}, semver{1,0,0,"","script.10"},
+        semver{1,0,1}, semver{1,0,1,"","script.1"},
+        semver{1,1,0,"","script.1"}, semver{2,0,0},
+        semver{1,0,0,"rc.1",""}, semver{1,0,0,"","build.7"},
+        semver{1,0,0,"","script.2.hotfix"}, semver{4294967295u,0,0}};
+    semver::metadata_compare mcmp;
+    script_key_metadata_compare kmcmp;
+    semver_script_compare<non_script_alignment::low> lcmp;
+    semver_script_compare<non_script_alignment::high> hcmp;
+    for (auto &a : versions) {
+        for (auto &b : versions) {
+            script_key ka{a}, kb{b};
+            BOOST_CHECK_EQUAL(kmcmp(ka, a, kb, b), mcmp(a, b));
+            BOOST_CHECK_EQUAL(lcmp(ka, a, kb, b), lcmp(a, b));
+            BOOST_CHECK_EQUAL(hcmp(ka, a, kb, b), hcmp(a, b));
+        }
+    }
+    BOOST_CHECK(script_key{versions[1]}.packed());
+    BOOST_CHECK(script_key{versions[0]}.packed());
+    BOOST_CHECK(!script_key{versions[8]}.packed());
+    BOOST_CHECK(!script_key{versions[9]}.packed());
+    BOOST_CHECK(!script_key{versions[10]}.packed());
+}
+
+BOOST_AUTO_TEST_CASE (known_scripts_unpacked_metadata)
+{
+    // Scripts with build metadata that cannot be packed still sort and
+    // search correctly alongside those that can.
+    script_dir::list_type scripts{
+        {semver{1,0,0,"","script.2.hotfix"}, "1.0.0/0002_hotfix.sql"},
+        {semver{1,0,0,"","script.2"}, "1.0.0/0002_a.sql"},
+        {semver{1,0,0,"","script.1"}, "1.0.0/0001_a.sql"},
+        {semver{1,0,1,"","script.1"}, "1.0.1/0001_b.sql"}};
+    script_dir sd("bundled", std::move(scripts));
+    vector<string> paths;
+    for (auto &script : sd)
+        paths.push_back(script.second);
+    vector<string> expected{"1.0.0/0001_a.sql", "1.0.0/0002_a.sql",
+                            "1.0.0/0002_hotfix.sql", "1.0.1/0001_b.sql"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(paths.begin(), paths.end(),
+                                  expected.begin(), expected.end());
+    
+    auto r = sd.range(semver{1,0,0,"","script.2"}, semver{1,0,1});
+    BOOST_REQUIRE_EQUAL(distance(r.first, r.second), 2);
+    BOOST_CHECK_EQUAL(r.first->second, "1.0.0/0002_hotfix.sql");
+}
@@ -0,0 +1,94 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_filename.hpp"
+#include "exception.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE script_filename_test
+#include <boost/test/unit_test.hpp>
+#include <string>
+
+
+using namespace std;
+using namespace dbmig;
+
+BOOST_AUTO_TEST_CASE (toplevel_filenames)
+{
+    BOOST_CHECK_EQUAL(parse_script_filename("1.2.3+script.4_foo.sql"),
+                      semver::parse("1.2.3+script.4"));
+    BOOST_CHECK_EQUAL(parse_script_filename("1.2.3+script.4.sql"),
+                      semver::parse("1.2.3+script.4"));
+    BOOST_CHECK_EQUAL(parse_script_filename("43.209.153+script.017389.sql"),
+                      semver::parse("43.209.153+script.17389"));
+    
+    // The script number is numeric, with any leading zeroes removed.
+    auto v = parse_script_filename("0.0.1+script.0042_x.sql");
+    BOOST_REQUIRE_EQUAL(v.bm_ids().size(), 2);
+    BOOST_CHECK(v.bm_ids()[1].is_numeric);
+    BOOST_CHECK_EQUAL(v.bm_ids()[1].numeric_value, 42);
+    BOOST_CHECK_EQUAL(v.to_str(), "0.0.1+script.42");
+}
+
+BOOST_AUTO_TEST_CASE (bad_toplevel_filenames)
+{
+    for (auto &f : {"foo.sql", "1.2+script.4.sql", "1.2.3.sql",
+                    "1.2.3+script.sql", "1.2.3+script.4x.sql",
+                    "1.2.3-rc.1+script.4.sql", "01.2.3+script.4.sql",
+                    "1.2.3+script.99999999999.sql", "4_foo.sql"})
+        BOOST_CHECK_THROW(parse_script_filename(f), bad_toplevel_filename);
+}
+
+BOOST_AUTO_TEST_CASE (subdir_filenames)
+{
+    auto expected = semver::parse("1.2.3+script.4");
+    for (auto &f : {"1.2.3+script.4_foo.sql", "1.2.3+script.4.sql",
+                    "script.4_foo.sql", "script.4.sql", "4_foo.sql",
+                    "4.sql", "0004_foo.sql", "1.2.3+4.sql"})
+        BOOST_CHECK_EQUAL(parse_script_filename("1.2.3", f), expected);
+    
+    // A filename starting with some other version is read from its start.
+    BOOST_CHECK_EQUAL(parse_script_filename("1.2.3", "1.2.4+script.4.sql"),
+                      semver::parse("1.2.3+script.1"));
+    BOOST_CHECK_EQUAL(parse_script_filename("1.2.3", "1.2.3+foo.sql"),
+                      semver::parse("1.2.3+script.1"));
+}
+
+BOOST_AUTO_TEST_CASE (bad_subdir_filenames)
+{
+    BOOST_CHECK_THROW(parse_script_filename("1.2", "4.sql"),
+                      bad_subdir_filename);
+    BOOST_CHECK_THROW(parse_script_filename("1.2.3.4", "4.sql"),
+                      bad_subdir_filename);
+    BOOST_CHECK_THROW(parse_script_filename("1.02.3", "4.sql"),
+                      bad_subdir_filename);
+    BOOST_CHECK_THROW(parse_script_filename("foo", "4.sql"),
+                      bad_subdir_filename);
+    for (auto &f : {"foo.sql", "script.sql", "script.x.sql", "4x.sql",
+                    "scrip.4.sql", "-4.sql"})
+        BOOST_CHECK_THROW(parse_script_filename("1.2.3", f),
+                          bad_subdir_filename);
+    
+    try {
+        parse_script_filename("1.2.3", "foo.sql");
+        BOOST_FAIL("Expected bad_subdir_filename");
+    }
+    catch (const bad_subdir_filename &e) {
+        BOOST_CHECK_EQUAL(e.path(), "1.2.3/foo.sql");
+    }
+}
@@ -0,0 +1,235 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_index.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE script_index_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "script_dir.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// A temporary script directory, with its index alongside it, both removed
+/// again at the end of a test
+///
+struct temp_script_dir
+{
+    temp_script_dir() : path(base.path / "upgrade")
+    {
+        fs::create_directories(path);
+    }
+    string index_path() const
+    {
+        return path.string() + script_dir_index_suffix;
+    }
+    void touch(const string &name) const
+    {
+        base.touch("upgrade/" + name);
+    }
+    ///
+    /// Backdate every directory, so that its time may be recorded.
+    ///
+    void backdate() const
+    {
+        auto t = std::time(nullptr) - 3600;
+        fs::last_write_time(path, t);
+        for (auto it = fs::recursive_directory_iterator(path);
+             it != fs::recursive_directory_iterator(); ++it) {
+            if (fs::is_directory(it->path()))
+                fs::last_write_time(it->path(), t);
+        }
+    }
+    script_dir scan() const
+    {
+        return script_dir{path.string(), ".sql", index_path()};
+    }
+    string read_index() const
+    {
+        nowide::ifstream ifs{index_path().c_str()};
+        stringstream ss;
+        ss << ifs.rdbuf();
+        return ss.str();
+    }
+    void write_index(const string &contents) const
+    {
+        nowide::ofstream ofs{index_path().c_str()};
+        ofs << contents;
+    }
+    
+    temp_dir base;
+    fs::path path;
+};
+
+static vector<string> paths_of(const script_dir &sd)
+{
+    vector<string> paths;
+    for (auto &script : sd)
+        paths.push_back(script.second);
+    return paths;
+}
+
+static void replace(string &str, const string &from, const string &to)
+{
+    auto pos = str.find(from);
+    BOOST_REQUIRE(pos != string::npos);
+    str.replace(pos, from.size(), to);
+}
+
+BOOST_AUTO_TEST_CASE (index_written_and_reused)
+{
+    temp_script_dir dir;
+    fs::create_directory(dir.path / "1.0.0");
+    fs::create_directory(dir.path / "1.1.0");
+    dir.touch("1.0.0/0001_a.sql");
+    dir.touch("1.0.0/0002_b.sql");
+    dir.touch("1.1.0/0001_c.sql");
+    dir.touch("1.0.1+script.1_d.sql");
+    dir.backdate();
+    
+    auto expected = vector<string>{"1.0.0/0001_a.sql", "1.0.0/0002_b.sql",
+                                   "1.0.1+script.1_d.sql", "1.1.0/0001_c.sql"};
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+    BOOST_REQUIRE(fs::exists(dir.index_path()));
+    
+    script_index index;
+    BOOST_REQUIRE(load_script_index(dir.index_path(), ".sql", index));
+    BOOST_CHECK_EQUAL(index.root_mtime_ns, fs::last_write_time(dir.path) *
+                      std::int64_t(1000000000));
+    BOOST_CHECK_EQUAL(index.sub_dir_mtimes.size(), 2);
+    BOOST_REQUIRE_EQUAL(index.scripts.size(), 4);
+    BOOST_CHECK_EQUAL(index.scripts[3].first,
+                      semver::parse("1.1.0+script.1"));
+    
+    // Nothing has changed, so the scripts come from the index alone, as can
+    // be seen by doctoring it.
+    auto contents = dir.read_index();
+    replace(contents, "1.1.0/0001_c.sql", "1.1.0/0001_doctored.sql");
+    dir.write_index(contents);
+    expected[3] = "1.1.0/0001_doctored.sql";
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+    
+    // Whereas a change to a sub-directory causes it (alone) to be rescanned.
+    replace(contents, "1.0.0/0002_b.sql", "1.0.0/0002_doctored.sql");
+    dir.write_index(contents);
+    dir.touch("1.1.0/0002_e.sql");
+    expected = vector<string>{"1.0.0/0001_a.sql", "1.0.0/0002_doctored.sql",
+                              "1.0.1+script.1_d.sql", "1.1.0/0001_c.sql",
+                              "1.1.0/0002_e.sql"};
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+    
+    // Removing a sub-directory changes the root.
+    fs::remove_all(dir.path / "1.1.0");
+    expected.resize(3);
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+}
+
+BOOST_AUTO_TEST_CASE (grouped_sub_dirs_indexed)
+{
+    temp_script_dir dir;
+    fs::create_directories(dir.path / "1/1.0/1.0.0");
+    fs::create_directories(dir.path / "1/1.1/1.1.0");
+    dir.touch("1/1.0/1.0.0/0001_a.sql");
+    dir.touch("1/1.1/1.1.0/0001_b.sql");
+    dir.backdate();
+    
+    auto expected = vector<string>{"1/1.0/1.0.0/0001_a.sql",
+                                   "1/1.1/1.1.0/0001_b.sql"};
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+    
+    // Grouping directories are recorded along with version sub-directories.
+    script_index index;
+    BOOST_REQUIRE(load_script_index(dir.index_path(), ".sql", index));
+    BOOST_CHECK_EQUAL(index.sub_dir_mtimes.size(), 5);
+    BOOST_CHECK(index.sub_dir_mtimes.count("1/1.1"));
+    BOOST_CHECK(index.sub_dir_mtimes.count("1/1.1/1.1.0"));
+    
+    auto contents = dir.read_index();
+    replace(contents, "1/1.0/1.0.0/0001_a.sql",
+            "1/1.0/1.0.0/0001_doctored.sql");
+    dir.write_index(contents);
+    expected[0] = "1/1.0/1.0.0/0001_doctored.sql";
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+    
+    // A new version sub-directory changes only its grouping directory, not
+    // the root, but is found all the same.
+    fs::create_directory(dir.path / "1/1.1/1.1.1");
+    dir.touch("1/1.1/1.1.1/0001_c.sql");
+    expected.push_back("1/1.1/1.1.1/0001_c.sql");
+    BOOST_CHECK(paths_of(dir.scan()) == expected);
+}
+
+BOOST_AUTO_TEST_CASE (recent_changes_not_trusted)
+{
+    // Directories modified just now may yet change again within the same
+    // tick of a coarse clock, so their times are not recorded.
+    temp_script_dir dir;
+    fs::create_directory(dir.path / "1.0.0");
+    dir.touch("1.0.0/0001_a.sql");
+    dir.scan();
+    
+    script_index index;
+    BOOST_REQUIRE(load_script_index(dir.index_path(), ".sql", index));
+    BOOST_CHECK_EQUAL(index.root_mtime_ns, -1);
+    BOOST_CHECK_EQUAL(index.sub_dir_mtimes["1.0.0"], -1);
+    
+    dir.touch("1.0.0/0002_b.sql");
+    BOOST_CHECK_EQUAL(paths_of(dir.scan()).size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE (bad_indexes_ignored)
+{
+    temp_script_dir dir;
+    fs::create_directory(dir.path / "1.0.0");
+    dir.touch("1.0.0/0001_a.sql");
+    dir.backdate();
+    dir.scan();
+    auto good = dir.read_index();
+    
+    script_index index;
+    BOOST_CHECK(load_script_index(dir.index_path(), ".sql", index));
+    BOOST_CHECK(!load_script_index(dir.index_path(), ".ddl", index));
+    
+    // Any malformed line spoils the whole index.
+    for (auto bad : {string{"garbage\n"}, good + "X\tfoo\tbar\n",
+                     good + "S\tnot-a-version\t1.0.0/0002_b.sql\n",
+                     good + "S\t2.0.0+script.1\t2.0.0/0001_b.sql\n",
+                     good + "D\tsoon\t2.0.0\n"}) {
+        dir.write_index(bad);
+        BOOST_CHECK(!load_script_index(dir.index_path(), ".sql", index));
+        auto paths = paths_of(dir.scan());
+        BOOST_REQUIRE_EQUAL(paths.size(), 1);
+        BOOST_CHECK_EQUAL(paths[0], "1.0.0/0001_a.sql");
+    }
+    
+    // The index is not essential.
+    fs::remove(dir.index_path());
+    fs::create_directory(dir.index_path());
+    BOOST_CHECK_EQUAL(paths_of(dir.scan()).size(), 1);
+}
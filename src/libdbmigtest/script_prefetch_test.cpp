@@ -0,0 +1,176 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "script_prefetch.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE script_prefetch_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "repository.hpp"
+#include "bundle.hpp"
+#include "mapped_script.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// A temporary repository that is removed again at the end of a test
+///
+struct temp_repo : temp_dir
+{
+    temp_repo()
+    {
+        fs::create_directories(path / "upgrade/1.0.0");
+        fs::create_directories(path / "install");
+    }
+};
+
+///
+/// Copy a list of statement views into strings, for easy comparison.
+///
+template<typename List>
+static vector<string> to_strings(const List &statements)
+{
+    vector<string> v;
+    for (auto &s : statements)
+        v.push_back(s.to_string());
+    return v;
+}
+
+static vector<string> upgrade_paths(const repository &repo)
+{
+    vector<string> paths;
+    for (auto &script : repo.scripts(script_action::upgrade))
+        paths.push_back(script.second);
+    return paths;
+}
+
+BOOST_AUTO_TEST_CASE (prepared_as_mapped)
+{
+    repository repo{"data/repo4"};
+    auto paths = upgrade_paths(repo);
+    BOOST_REQUIRE_EQUAL(paths.size(), 4);
+    
+    for (auto action : {script_action::upgrade, script_action::rollback}) {
+        // A depth of one means each script waits for the one before it to
+        // be taken.
+        script_prefetcher prefetcher{repo, action, paths, 1};
+        for (auto &path : paths) {
+            auto script = prefetcher.next();
+            mapped_script mapped{repo.upgrade_script_path() + "/" + path};
+            mapped_script::line_list lines;
+            BOOST_CHECK_EQUAL(script.path(), path);
+            BOOST_CHECK_EQUAL(script.sha256_sum(), mapped.sha256_sum());
+            BOOST_CHECK(to_strings(script.statements()) ==
+                        to_strings(mapped.statements(action, lines)));
+            BOOST_CHECK(script.lines() == lines);
+        }
+        BOOST_CHECK_THROW(prefetcher.next(), std::out_of_range);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (prepared_from_bundle)
+{
+    temp_file bundle_file{".dbmig"};
+    repository dir{"data/repo4"};
+    write_bundle(dir, bundle_file.path);
+    {
+        repository packed{bundle_file.path};
+        auto paths = upgrade_paths(packed);
+        script_prefetcher prefetcher{packed, script_action::upgrade, paths};
+        for (auto &path : paths) {
+            auto script = prefetcher.next();
+            prepared_script expected{dir, script_action::upgrade, path};
+            BOOST_CHECK_EQUAL(script.sha256_sum(), expected.sha256_sum());
+            BOOST_CHECK(to_strings(script.statements()) ==
+                        to_strings(expected.statements()));
+            
+            // Bundles do not keep the layout of their scripts.
+            BOOST_CHECK(script.lines().empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (big_scripts_left_to_stream)
+{
+    temp_repo repo;
+    repo.write("upgrade/1.0.0/0001_small.sql", "SELECT 1;\n");
+    repo.write("upgrade/1.0.0/0002_big.sql",
+               "SELECT 2;\n" + string(100, '-') + "\nSELECT 3;\n");
+    repo.write("upgrade/1.0.0/0003_small.sql", "SELECT 4;\n");
+    repository r{repo.path.string()};
+    auto paths = upgrade_paths(r);
+    
+    // Only the script bigger than max_bytes is left unprepared.
+    script_prefetcher prefetcher{r, script_action::upgrade, paths, 4, 64};
+    for (auto &path : paths) {
+        auto script = prefetcher.next();
+        bool big = path == "1.0.0/0002_big.sql";
+        BOOST_CHECK_EQUAL(script.streamed(), big);
+        BOOST_CHECK_EQUAL(script.statements().empty(), big);
+        BOOST_CHECK_EQUAL(script.sha256_sum().empty(), big);
+        BOOST_CHECK_EQUAL(script.file_path(),
+                          r.upgrade_script_path() + "/" + path);
+        BOOST_CHECK(script.action() == script_action::upgrade);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (error_surfaces_in_turn)
+{
+    temp_repo repo;
+    repo.write("upgrade/1.0.0/0001_a.sql", "SELECT 1;\n");
+    repo.write("upgrade/1.0.0/0002_b.sql", "SELECT 2;\n");
+    repo.write("upgrade/1.0.0/0003_c.sql", "SELECT 3;\n");
+    repo.write("upgrade/1.0.0/0004_d.sql", "SELECT 4;\n");
+    repository r{repo.path.string()};
+    auto paths = upgrade_paths(r);
+    
+    // A script that goes missing after the repository was scanned is only
+    // reported once the scripts before it have been taken.
+    fs::remove(repo.path / "upgrade/1.0.0/0003_c.sql");
+    script_prefetcher prefetcher{r, script_action::upgrade, paths};
+    BOOST_CHECK_EQUAL(prefetcher.next().path(), "1.0.0/0001_a.sql");
+    BOOST_CHECK_EQUAL(prefetcher.next().path(), "1.0.0/0002_b.sql");
+    BOOST_CHECK_THROW(prefetcher.next(), fs::filesystem_error);
+    
+    // Nothing after it is prepared.
+    BOOST_CHECK_THROW(prefetcher.next(), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE (stopped_early)
+{
+    temp_repo repo;
+    for (int n = 1; n <= 9; ++n)
+        repo.write("upgrade/1.0.0/000" + to_string(n) + "_x.sql",
+                   "SELECT 1;\n");
+    repository r{repo.path.string()};
+    auto paths = upgrade_paths(r);
+    
+    // Destroying the prefetcher with scripts untaken (or unprepared, given
+    // the small byte budget) must not hang.
+    script_prefetcher prefetcher{r, script_action::upgrade, paths, 4, 1};
+    BOOST_CHECK_EQUAL(prefetcher.next().path(), "1.0.0/0001_x.sql");
+}
@@ -36,7 +36,8 @@ BOOST_AUTO_TEST_CASE (repo4_install_nonempty)
     ifstream ifs{path};
 
     // Check lines
-    auto statements = read_install_statements(ifs);
+    auto script = read_script(ifs, script_action::install);
+    auto &statements = script.statements(script_action::install);
     auto b = statements.begin();
     auto e = statements.end();
     BOOST_CHECK_EQUAL(*b++, "SELECT 'foo'");
@@ -46,7 +47,7 @@ BOOST_AUTO_TEST_CASE (repo4_install_nonempty)
     
     // Check hash
     BOOST_CHECK_EQUAL(
-        statements.sha256_sum(),
+        script.sha256_sum(),
         "f9851f80e0e17c734469b86ea96045f01cb82a68c44966ea9fb7f9999b4cb125");
     
     ifs.close();
@@ -59,7 +60,8 @@ BOOST_AUTO_TEST_CASE (repo4_upgrade_nonempty)
     ifstream ifs{path};
     
     // Check lines
-    auto statements = read_upgrade_statements(ifs);
+    auto script = read_script(ifs, script_action::upgrade);
+    auto &statements = script.statements(script_action::upgrade);
     auto b = statements.begin();
     auto e = statements.end();
     BOOST_CHECK_EQUAL(*b++, "SELECT 'foo'");
@@ -69,7 +71,7 @@ BOOST_AUTO_TEST_CASE (repo4_upgrade_nonempty)
     
     // Check hash
     BOOST_CHECK_EQUAL(
-        statements.sha256_sum(),
+        script.sha256_sum(),
         "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a");
     
     ifs.close();
@@ -82,14 +84,15 @@ BOOST_AUTO_TEST_CASE (repo4_upgrade_empty)
     ifstream ifs{path};
     
     // Check lines
-    auto statements = read_upgrade_statements(ifs);
+    auto script = read_script(ifs, script_action::upgrade);
+    auto &statements = script.statements(script_action::upgrade);
     auto b = statements.begin();
     auto e = statements.end();
     BOOST_CHECK(b == e);
     
     // Check hash
     BOOST_CHECK_EQUAL(
-        statements.sha256_sum(),
+        script.sha256_sum(),
         "3396754a69a86991d06dbe921bcd84e0316c39a843294c1667a324b7b22f3a70");
     
     ifs.close();
@@ -102,7 +105,8 @@ BOOST_AUTO_TEST_CASE (repo4_rollback_nonempty)
     ifstream ifs{path};
     
     // Check lines
-    auto statements = read_rollback_statements(ifs);
+    auto script = read_script(ifs, script_action::upgrade);
+    auto &statements = script.statements(script_action::rollback);
     auto b = statements.begin();
     auto e = statements.end();
     BOOST_CHECK_EQUAL(*b++, "SELECT 'baz'");
@@ -112,7 +116,7 @@ BOOST_AUTO_TEST_CASE (repo4_rollback_nonempty)
     
     // Check hash
     BOOST_CHECK_EQUAL(
-        statements.sha256_sum(),
+        script.sha256_sum(),
         "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a");
     
     ifs.close();
@@ -125,18 +129,132 @@ BOOST_AUTO_TEST_CASE (repo4_rollback_empty)
     ifstream ifs{path};
     
     // Check lines
-    auto statements = read_rollback_statements(ifs);
+    auto script = read_script(ifs, script_action::upgrade);
+    auto &statements = script.statements(script_action::rollback);
     auto b = statements.begin();
     auto e = statements.end();
     BOOST_CHECK(b == e);
     
     // Check hash
     BOOST_CHECK_EQUAL(
-        statements.sha256_sum(),
+        script.sha256_sum(),
         "3396754a69a86991d06dbe921bcd84e0316c39a843294c1667a324b7b22f3a70");
     
     ifs.close();
 }
 
+BOOST_AUTO_TEST_CASE (repo4_both_partitions)
+{
+    // A single read yields both partitions of an upgrade script.
+    auto path = "data/repo4/upgrade/2.44.3/0001_foo.sql";
+    ifstream ifs{path};
+    auto script = read_script(ifs, script_action::upgrade);
+    
+    auto &u = script.statements(script_action::upgrade);
+    BOOST_REQUIRE_EQUAL(u.size(), 2);
+    BOOST_CHECK_EQUAL(u[0], "SELECT 'foo'");
+    BOOST_CHECK_EQUAL(u[1], "SELECT 'bar'");
+    auto &r = script.statements(script_action::rollback);
+    BOOST_REQUIRE_EQUAL(r.size(), 2);
+    BOOST_CHECK_EQUAL(r[0], "SELECT 'baz'");
+    BOOST_CHECK_EQUAL(r[1], "SELECT 'quux'");
+}
+
+BOOST_AUTO_TEST_CASE (repo4_install_unpartitioned)
+{
+    // The magic text has no special meaning in an install script.
+    auto path = "data/repo4/upgrade/2.44.3/0001_foo.sql";
+    ifstream ifs{path};
+    auto script = read_script(ifs, script_action::install);
+    
+    auto &i = script.statements(script_action::install);
+    BOOST_REQUIRE_EQUAL(i.size(), 4);
+    BOOST_CHECK_EQUAL(i[1], "SELECT 'bar'");
+    BOOST_CHECK_EQUAL(i[2], "--//@UNDO\nSELECT 'baz'");
+    BOOST_CHECK(script.statements(script_action::rollback).empty());
+}
+
+BOOST_AUTO_TEST_CASE (repo4_install_stream)
+{
+    auto path = "data/repo4/install/2.44.2/2.44.2+script.0057_install.sql";
+    ifstream ifs{path};
+
+    // Check lines are yielded lazily, in the same way as the eager reader.
+    script_statement_stream<ifstream> statements{ifs, script_action::install};
+    auto b = statements.begin();
+    auto e = statements.end();
+    BOOST_CHECK_EQUAL(*b++, "SELECT 'foo'");
+    BOOST_CHECK(b != e);
+    BOOST_CHECK_EQUAL(*b, "SELECT 'bar'");
+    BOOST_CHECK(++b == e);
+    
+    // Check hash
+    BOOST_CHECK_EQUAL(
+        statements.sha256_sum(),
+        "f9851f80e0e17c734469b86ea96045f01cb82a68c44966ea9fb7f9999b4cb125");
+}
+
+BOOST_AUTO_TEST_CASE (repo4_upgrade_rollback_stream)
+{
+    auto path = "data/repo4/upgrade/2.44.3/0001_foo.sql";
+    
+    // Upgrade statements stop at the magic text.
+    ifstream ifs_u{path};
+    script_statement_stream<ifstream> upgrade{ifs_u, script_action::upgrade};
+    std::vector<std::string> u(upgrade.begin(), upgrade.end());
+    BOOST_REQUIRE_EQUAL(u.size(), 2);
+    BOOST_CHECK_EQUAL(u[0], "SELECT 'foo'");
+    BOOST_CHECK_EQUAL(u[1], "SELECT 'bar'");
+    BOOST_CHECK_EQUAL(
+        upgrade.sha256_sum(),
+        "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a");
+    
+    // Rollback statements start after the magic text.
+    ifstream ifs_r{path};
+    script_statement_stream<ifstream> rollback{ifs_r, script_action::rollback};
+    std::vector<std::string> r(rollback.begin(), rollback.end());
+    BOOST_REQUIRE_EQUAL(r.size(), 2);
+    BOOST_CHECK_EQUAL(r[0], "SELECT 'baz'");
+    BOOST_CHECK_EQUAL(r[1], "SELECT 'quux'");
+    BOOST_CHECK_EQUAL(rollback.sha256_sum(), upgrade.sha256_sum());
+}
+
+BOOST_AUTO_TEST_CASE (repo4_stream_hash_drains)
+{
+    // Asking for the hash before iterating drains the whole stream.
+    auto path = "data/repo4/upgrade/2.44.3/0001_foo.sql";
+    ifstream ifs{path};
+    script_statement_stream<ifstream> statements{ifs, script_action::upgrade};
+    BOOST_CHECK_EQUAL(
+        statements.sha256_sum(),
+        "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a");
+    BOOST_CHECK(statements.begin() == statements.end());
+}
+
+BOOST_AUTO_TEST_CASE (repo4_read_statements_compat)
+{
+    // The per-action readers agree with read_script().
+    auto path = "data/repo4/upgrade/2.44.3/0001_foo.sql";
+    ifstream ifs_u{path};
+    auto upgrade = read_upgrade_statements(ifs_u);
+    std::vector<std::string> u(upgrade.begin(), upgrade.end());
+    BOOST_REQUIRE_EQUAL(u.size(), 2);
+    BOOST_CHECK_EQUAL(u[1], "SELECT 'bar'");
+    BOOST_CHECK_EQUAL(
+        upgrade.sha256_sum(),
+        "3e1a6103040506d0e526880e739546567eb8282de831e8ae666a5fb2baf8849a");
+    
+    ifstream ifs_r{path};
+    auto rollback = read_rollback_statements(ifs_r);
+    std::vector<std::string> r(rollback.begin(), rollback.end());
+    BOOST_REQUIRE_EQUAL(r.size(), 2);
+    BOOST_CHECK_EQUAL(r[0], "SELECT 'baz'");
+    BOOST_CHECK_EQUAL(rollback.sha256_sum(), upgrade.sha256_sum());
+    
+    ifstream ifs_i{path};
+    auto install = read_install_statements(ifs_i);
+    BOOST_CHECK_EQUAL(std::distance(install.begin(), install.end()), 4);
+}
+
 // TODO - add test cases with files that use different EOL encodings
 
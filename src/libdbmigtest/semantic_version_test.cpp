@@ -29,6 +29,7 @@
 #define BOOST_TEST_MODULE semantic_version_test
 #include <boost/test/unit_test.hpp>
 #include <sstream>
+#include <type_traits>
 
 using namespace std;
 using namespace dbmig;
@@ -140,6 +141,52 @@ BOOST_AUTO_TEST_CASE (parse_tests)
 	    u8"99.88.77-utf8.\u010F+more.utf8.\u0126.foo"), std::domain_error);
 }
 
+BOOST_AUTO_TEST_CASE (parse_edge_tests)
+{
+	// Hyphens within build metadata do not start a pre-release.
+	const semver sv1 = semver::parse("1.2.3+build-7.x");
+	BOOST_CHECK_EQUAL(sv1.prerelease_str(), "");
+	BOOST_CHECK_EQUAL(sv1.build_metadata_str(), "build-7.x");
+	const semver sv2 = semver::parse("1.2.3-rc-1+build-7");
+	BOOST_CHECK_EQUAL(sv2.prerelease_str(), "rc-1");
+	BOOST_CHECK_EQUAL(sv2.build_metadata_str(), "build-7");
+	
+	// Numeric identifiers are not limited in size, but version parts are.
+	const semver sv3 = semver::parse("1.0.0+20130313144700");
+	BOOST_CHECK(sv3.bm_ids()[0].is_numeric);
+	BOOST_CHECK_EQUAL(sv3.bm_ids()[0].str_value, "20130313144700");
+	BOOST_CHECK_EQUAL(semver::parse("4294967295.0.0").mj(), 4294967295u);
+	BOOST_CHECK_THROW(semver::parse("4294967296.0.0"), std::domain_error);
+	
+	// Parse from a range of characters.
+	const string padded = "[3.4.5+script.6]";
+	const semver sv4 = semver::parse(padded.data() + 1,
+	                                 padded.data() + padded.size() - 1);
+	BOOST_CHECK_EQUAL(sv4, semver(3, 4, 5, "", "script.6"));
+	BOOST_CHECK_THROW(semver::parse(padded.data(), padded.data() + 4),
+	                  std::domain_error);
+}
+
+BOOST_AUTO_TEST_CASE (try_parse_tests)
+{
+	semver v = semver::zero();
+	const char *error = nullptr;
+	const string good = "6.0.2-alpha.1+build3927.whatever";
+	BOOST_CHECK(semver::try_parse(good.data(), good.data() + good.size(),
+	                              v, &error));
+	BOOST_CHECK(error == nullptr);
+	BOOST_CHECK_EQUAL(v, semver::parse(good));
+	
+	for (const string bad : {"", "1.2", "1.2.3-", "1.2.03", "1.2.3+a..b",
+	                         "1.2.3-foo?"})
+	{
+		BOOST_CHECK(!semver::try_parse(bad.data(), bad.data() + bad.size(),
+		                               v, &error));
+		BOOST_CHECK(error != nullptr);
+		BOOST_CHECK_THROW(semver::parse(bad), std::domain_error);
+	}
+}
+
 BOOST_AUTO_TEST_CASE (to_str_tests)
 {
 	const semver sv1(3);
@@ -414,3 +461,49 @@ BOOST_AUTO_TEST_CASE (comparison_operator_tests)
 	BOOST_CHECK(sv6 >= sv5);
 	BOOST_CHECK(sv7 >= sv6);
 }
+
+BOOST_AUTO_TEST_CASE (move_tests)
+{
+	BOOST_CHECK(is_nothrow_move_constructible<semver>::value);
+	BOOST_CHECK(is_nothrow_move_assignable<semver>::value);
+	
+	semver sv1 = semver::parse("1.2.3-rc.1+script.4");
+	BOOST_CHECK_EQUAL(sv1.to_str(), "1.2.3-rc.1+script.4");
+	
+	// The cached string representation moves along with the parts.
+	semver sv2{move(sv1)};
+	BOOST_CHECK_EQUAL(sv2.to_str(), "1.2.3-rc.1+script.4");
+	BOOST_CHECK_EQUAL(sv2.pr_ids().size(), 2);
+	BOOST_CHECK_EQUAL(sv2.bm_ids().size(), 2);
+	BOOST_CHECK(sv1.is_zero());
+	BOOST_CHECK(sv1.pr_ids().empty());
+	BOOST_CHECK(sv1.bm_ids().empty());
+	BOOST_CHECK_EQUAL(sv1.to_str(), "0.0.0");
+	
+	semver sv3{4};
+	sv3 = move(sv2);
+	BOOST_CHECK_EQUAL(sv3.to_str(), "1.2.3-rc.1+script.4");
+	BOOST_CHECK(sv2.is_zero());
+	BOOST_CHECK_EQUAL(sv2.to_str(), "0.0.0");
+	
+	// Moved-from versions remain usable.
+	sv2 = semver::parse("5.6.7+script.8");
+	BOOST_CHECK_EQUAL(sv2.to_str(), "5.6.7+script.8");
+}
+
+BOOST_AUTO_TEST_CASE (id_list_ctor_tests)
+{
+	semver::id_list bm_ids = semver::parse("0.0.0+script.12").bm_ids();
+	semver sv{3, 4, 5, semver::id_list{}, move(bm_ids)};
+	BOOST_CHECK_EQUAL(sv.to_str(), "3.4.5+script.12");
+	BOOST_CHECK(sv.bm_ids()[1].is_numeric);
+	BOOST_CHECK_EQUAL(sv.bm_ids()[1].numeric_value, 12);
+	BOOST_CHECK(sv == semver::parse("3.4.5+script.12"));
+	
+	// Lists longer than the inline capacity still work.
+	auto sv2 = semver::parse("1.0.0-a.b.c.d+e.f.g");
+	BOOST_CHECK_EQUAL(sv2.pr_ids().size(), 4);
+	BOOST_CHECK_EQUAL(sv2.bm_ids().size(), 3);
+	semver sv3{move(sv2)};
+	BOOST_CHECK_EQUAL(sv3.to_str(), "1.0.0-a.b.c.d+e.f.g");
+}
@@ -0,0 +1,90 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hash.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE sha256_backend_test
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <string>
+
+
+using namespace std;
+using namespace dbmig;
+
+template <typename Backend>
+static string digest_of(const string &message, size_t chunk_size)
+{
+    dbmig::hash<Backend> h;
+    for (size_t i = 0; i < message.size(); i += chunk_size)
+        h.update(message.substr(i, chunk_size));
+    h.finalise();
+    string hex;
+    h.hex_encode(hex);
+    return hex;
+}
+
+BOOST_AUTO_TEST_CASE (known_digests)
+{
+    BOOST_TEST_MESSAGE("SHA256 instructions supported: " <<
+                       accelerated_sha256::hardware_supported());
+    BOOST_CHECK_EQUAL(
+        digest_of<accelerated_sha256>("", 1),
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    BOOST_CHECK_EQUAL(
+        digest_of<accelerated_sha256>("abc", 1),
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    BOOST_CHECK_EQUAL(
+        digest_of<accelerated_sha256>(
+            "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 7),
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    BOOST_CHECK_EQUAL(
+        digest_of<accelerated_sha256>(string(1000000, 'a'), 100000),
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+BOOST_AUTO_TEST_CASE (same_as_cryptopp)
+{
+    // Cover every padding case, and updates that straddle block and buffer
+    // boundaries.
+    mt19937 gen{42};
+    uniform_int_distribution<int> byte_dist{0, 255};
+    string message;
+    for (size_t size = 0; size < 40000; size += size < 300 ? 1 : 4999) {
+        while (message.size() < size)
+            message += static_cast<char>(byte_dist(gen));
+        for (size_t chunk_size : {1, 63, 64, 65, 20000}) {
+            BOOST_REQUIRE_EQUAL(
+                digest_of<accelerated_sha256>(message, chunk_size),
+                digest_of<CryptoPP::SHA256>(message, chunk_size));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (backend_reusable_after_final)
+{
+    accelerated_sha256 backend;
+    unsigned char first[32], second[32];
+    const unsigned char abc[] = {'a', 'b', 'c'};
+    backend.Update(abc, 3);
+    backend.Final(first);
+    backend.Update(abc, 3);
+    backend.Final(second);
+    BOOST_CHECK_EQUAL_COLLECTIONS(first, first + 32, second, second + 32);
+}
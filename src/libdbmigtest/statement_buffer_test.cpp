@@ -0,0 +1,136 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "statement_buffer.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE statement_buffer_test
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace dbmig;
+
+///
+/// Feed the given lines through a statement buffer and return the statements.
+///
+static vector<string> split(const vector<string> &lines)
+{
+    vector<string> statements;
+    auto stmt_buf = make_statement_buffer(back_inserter(statements));
+    for (auto &line : lines)
+        stmt_buf.append(line + "\n");
+    stmt_buf.finalise();
+    return statements;
+}
+
+BOOST_AUTO_TEST_CASE (semicolon_delimiters)
+{
+    auto s = split({"SELECT 1; SELECT 2;", "SELECT", "3;", "SELECT 4"});
+    BOOST_REQUIRE_EQUAL(s.size(), 4);
+    BOOST_CHECK_EQUAL(s[0], "SELECT 1");
+    BOOST_CHECK_EQUAL(s[1], "SELECT 2");
+    BOOST_CHECK_EQUAL(s[2], "SELECT\n3");
+    BOOST_CHECK_EQUAL(s[3], "SELECT 4");
+}
+
+BOOST_AUTO_TEST_CASE (batch_separators)
+{
+    // GO only separates batches when it is on a line of its own.
+    auto s = split({"SELECT 'foo';", "  go  ", "SELECT category", "GO",
+                    "SELECT 'bar'", "GOTO"});
+    BOOST_REQUIRE_EQUAL(s.size(), 3);
+    BOOST_CHECK_EQUAL(s[0], "SELECT 'foo'");
+    BOOST_CHECK_EQUAL(s[1], "SELECT category");
+    BOOST_CHECK_EQUAL(s[2], "SELECT 'bar'\nGOTO");
+}
+
+BOOST_AUTO_TEST_CASE (quoted_delimiters)
+{
+    auto s = split({"SELECT 'a;b', \"c;d\" FROM t;",
+                    "SELECT 'multi", "go", "line;''';"});
+    BOOST_REQUIRE_EQUAL(s.size(), 2);
+    BOOST_CHECK_EQUAL(s[0], "SELECT 'a;b', \"c;d\" FROM t");
+    BOOST_CHECK_EQUAL(s[1], "SELECT 'multi\ngo\nline;'''");
+}
+
+BOOST_AUTO_TEST_CASE (commented_delimiters)
+{
+    auto s = split({"SELECT 1 -- not here;", "/* nor; /* nested; */",
+                    "go", "here; */ + 2;", "SELECT 3;"});
+    BOOST_REQUIRE_EQUAL(s.size(), 2);
+    BOOST_CHECK_EQUAL(s[0], "SELECT 1 -- not here;\n/* nor; /* nested; */\n"
+                            "go\nhere; */ + 2");
+    BOOST_CHECK_EQUAL(s[1], "SELECT 3");
+}
+
+BOOST_AUTO_TEST_CASE (dollar_quoted_delimiters)
+{
+    auto s = split({"CREATE FUNCTION f() RETURNS int AS $body$",
+                    "BEGIN",
+                    "    RETURN $$;$$ || $1;",
+                    "END;",
+                    "$body$ LANGUAGE plpgsql;",
+                    "SELECT f$x$y;"});
+    BOOST_REQUIRE_EQUAL(s.size(), 2);
+    BOOST_CHECK_EQUAL(s[0], "CREATE FUNCTION f() RETURNS int AS $body$\n"
+                            "BEGIN\n    RETURN $$;$$ || $1;\nEND;\n"
+                            "$body$ LANGUAGE plpgsql");
+    BOOST_CHECK_EQUAL(s[1], "SELECT f$x$y");
+}
+
+BOOST_AUTO_TEST_CASE (tokens_split_across_appends)
+{
+    // Feed one byte at a time, so every multi-character token straddles the
+    // end of the buffer at some point.
+    string script = "SELECT 1 -- c;\n/* c; */ $q$;$q$;\nGO\nSELECT 2";
+    vector<string> statements;
+    auto stmt_buf = make_statement_buffer(back_inserter(statements));
+    for (auto c : script)
+        stmt_buf.append(string(1, c));
+    stmt_buf.finalise();
+    BOOST_REQUIRE_EQUAL(statements.size(), 2);
+    BOOST_CHECK_EQUAL(statements[0], "SELECT 1 -- c;\n/* c; */ $q$;$q$");
+    BOOST_CHECK_EQUAL(statements[1], "SELECT 2");
+}
+
+BOOST_AUTO_TEST_CASE (empty_statements_skipped)
+{
+    auto s = split({";;", "SELECT 1;", "GO", "", "  "});
+    BOOST_REQUIRE_EQUAL(s.size(), 1);
+    BOOST_CHECK_EQUAL(s[0], "SELECT 1");
+}
+
+BOOST_AUTO_TEST_CASE (delimiter_regex)
+{
+    // Only the regex that the lexer replaced is accepted.
+    typedef back_insert_iterator<vector<string>> iterator_type;
+    vector<string> statements;
+    statement_buffer<iterator_type> stmt_buf{
+        back_inserter(statements),
+        statement_buffer<iterator_type>::default_delim_regex()};
+    stmt_buf.append("SELECT 1; SELECT 2\n");
+    stmt_buf.finalise();
+    BOOST_CHECK_EQUAL(statements.size(), 2);
+    
+    BOOST_CHECK_THROW(
+        (statement_buffer<iterator_type>{back_inserter(statements), "\\|"}),
+        std::invalid_argument);
+}
@@ -0,0 +1,101 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DBMIG_TEST_TEMP_DIR_INCLUDED
+#define DBMIG_TEST_TEMP_DIR_INCLUDED
+
+#include <string>
+#include <boost/filesystem.hpp>
+#include <nowide/fstream.hpp>
+
+///
+/// A fresh path in the temporary directory, ending with the given suffix
+///
+inline boost::filesystem::path unique_temp_path(const std::string &suffix = "")
+{
+    namespace fs = boost::filesystem;
+    return fs::temp_directory_path() /
+        fs::unique_path("dbmig-test-%%%%-%%%%" + suffix);
+}
+
+///
+/// A temporary directory that is removed again at the end of a test
+///
+struct temp_dir
+{
+    temp_dir() : path(unique_temp_path())
+    {
+        boost::filesystem::create_directories(path);
+    }
+    ~temp_dir()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(path, ec);
+    }
+    temp_dir(const temp_dir &) = delete;
+    temp_dir &operator=(const temp_dir &) = delete;
+    
+    ///
+    /// The path of a file (or directory) within the directory
+    ///
+    std::string file(const std::string &name) const
+    {
+        return (path / name).string();
+    }
+    
+    ///
+    /// Write a file within the directory
+    ///
+    void write(const std::string &name, const std::string &content) const
+    {
+        nowide::ofstream ofs{file(name).c_str()};
+        ofs << content;
+    }
+    
+    ///
+    /// Write a one-statement script within the directory
+    ///
+    void touch(const std::string &name) const
+    {
+        write(name, "SELECT 1;\n");
+    }
+    
+    boost::filesystem::path path;
+};
+
+///
+/// A temporary file path, with the file removed again (if it was ever
+/// created) at the end of a test
+///
+struct temp_file
+{
+    explicit temp_file(const std::string &suffix = "") :
+        path(unique_temp_path(suffix).string())
+    {}
+    ~temp_file()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(path, ec);
+    }
+    temp_file(const temp_file &) = delete;
+    temp_file &operator=(const temp_file &) = delete;
+    
+    std::string path;
+};
+
+#endif // DBMIG_TEST_TEMP_DIR_INCLUDED
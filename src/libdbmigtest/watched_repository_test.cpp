@@ -0,0 +1,247 @@
+/*
+    dbmig - Database schema migration tool
+    Copyright (C) 2012-2014  Adam Szmigin (adam.szmigin@xsco.net)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "watched_repository.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE watched_repository_test
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nowide/fstream.hpp>
+#include "script_dir.hpp"
+#include "exception.hpp"
+#include "temp_dir.hpp"
+
+
+using namespace std;
+using namespace dbmig;
+namespace fs = boost::filesystem;
+
+///
+/// A temporary repository that is removed again at the end of a test
+///
+struct temp_repo : temp_dir
+{
+    temp_repo()
+    {
+        fs::create_directories(path / "upgrade/1.0.0");
+        fs::create_directories(path / "install/1.0.0");
+        touch("upgrade/1.0.0/0001_change.sql");
+        touch("install/1.0.0/1.0.0+script.1_install.sql");
+    }
+};
+
+static vector<string> paths_of(const script_dir &sd)
+{
+    vector<string> paths;
+    for (auto &script : sd)
+        paths.push_back(script.second);
+    return paths;
+}
+
+///
+/// Wait for a snapshot other than the given one to be published.
+///
+static shared_ptr<const repository> next_snapshot(
+    const watched_repository &watched,
+    const shared_ptr<const repository> &previous)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    auto snapshot = watched.snapshot();
+    while (snapshot == previous && chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        snapshot = watched.snapshot();
+    }
+    BOOST_REQUIRE(snapshot != previous);
+    return snapshot;
+}
+
+BOOST_AUTO_TEST_CASE (rescan_changed_sub_dirs_only)
+{
+    temp_repo repo;
+    auto upgrade_path = (repo.path / "upgrade").string();
+    fs::create_directory(repo.path / "upgrade/1.0.1");
+    repo.touch("upgrade/1.0.1/0001_change.sql");
+    script_dir before{upgrade_path};
+    
+    // Unlisted changes go unnoticed...
+    repo.touch("upgrade/1.0.0/0002_change.sql");
+    repo.touch("upgrade/1.0.1/0002_change.sql");
+    script_dir after{before, {"1.0.1"}};
+    BOOST_CHECK((paths_of(after) == vector<string>{
+        "1.0.0/0001_change.sql", "1.0.1/0001_change.sql",
+        "1.0.1/0002_change.sql"}));
+    
+    // ...while a change to the root brings in new sub-directories, and
+    // drops any that have gone.
+    fs::remove_all(repo.path / "upgrade/1.0.1");
+    fs::create_directory(repo.path / "upgrade/1.1.0");
+    repo.touch("upgrade/1.1.0/0001_change.sql");
+    repo.touch("upgrade/1.2.0+script.1.sql");
+    script_dir root_changed{after, {""}};
+    BOOST_CHECK((paths_of(root_changed) == vector<string>{
+        "1.0.0/0001_change.sql", "1.1.0/0001_change.sql",
+        "1.2.0+script.1.sql"}));
+    
+    // A vanished sub-directory can only be dropped along with the root.
+    BOOST_CHECK_THROW((script_dir{root_changed, {"1.1.0", "1.0.1"}}),
+                      boost::filesystem::filesystem_error);
+}
+
+BOOST_AUTO_TEST_CASE (bundles_not_watched)
+{
+    temp_repo repo;
+    auto bundle_path = (repo.path / "repo.dbmig").string();
+    {
+        nowide::ofstream ofs{bundle_path.c_str()};
+        ofs << "not really a bundle";
+    }
+    BOOST_CHECK_THROW(watched_repository{bundle_path}, std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE (snapshot_kept_while_held)
+{
+    temp_repo repo;
+    watched_repository watched{repo.path.string()};
+    auto first = watched.snapshot();
+    BOOST_CHECK_EQUAL(first->latest_version(),
+                      semver::parse("1.0.0+script.1"));
+    BOOST_CHECK(first == watched.snapshot());
+    
+    // A refresh publishes a new snapshot, but the old one is unchanged.
+    fs::create_directory(repo.path / "upgrade/1.0.1");
+    repo.touch("upgrade/1.0.1/0001_change.sql");
+    watched.refresh();
+    auto second = watched.snapshot();
+    BOOST_CHECK(second != first);
+    BOOST_CHECK_EQUAL(second->latest_version(),
+                      semver::parse("1.0.1+script.1"));
+    BOOST_CHECK_EQUAL(first->latest_version(),
+                      semver::parse("1.0.0+script.1"));
+}
+
+#ifdef __linux__
+BOOST_AUTO_TEST_CASE (changes_followed)
+{
+    temp_repo repo;
+    watched_repository watched{repo.path.string()};
+    auto snapshot = watched.snapshot();
+    
+    // A new version sub-directory.
+    fs::create_directory(repo.path / "upgrade/1.0.1");
+    repo.touch("upgrade/1.0.1/0001_change.sql");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK((paths_of(snapshot->scripts(script_action::upgrade)) ==
+                 vector<string>{"1.0.0/0001_change.sql",
+                                "1.0.1/0001_change.sql"}));
+    
+    // A new script within a watched sub-directory.
+    repo.touch("upgrade/1.0.1/0002_change.sql");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK_EQUAL(snapshot->latest_version(),
+                      semver::parse("1.0.1+script.2"));
+    
+    // A sub-directory renamed, and a new install script.
+    fs::rename(repo.path / "upgrade/1.0.1", repo.path / "upgrade/1.1.0");
+    repo.touch("install/1.1.0+script.2_install.sql");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK((paths_of(snapshot->scripts(script_action::upgrade)) ==
+                 vector<string>{"1.0.0/0001_change.sql",
+                                "1.1.0/0001_change.sql",
+                                "1.1.0/0002_change.sql"}));
+    BOOST_CHECK((paths_of(snapshot->scripts(script_action::install)) ==
+                 vector<string>{"1.0.0/1.0.0+script.1_install.sql",
+                                "1.1.0+script.2_install.sql"}));
+    
+    // The renamed sub-directory is still watched under its new name.
+    fs::remove(repo.path / "upgrade/1.1.0/0002_change.sql");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK_EQUAL(snapshot->latest_version(),
+                      semver::parse("1.1.0+script.2"));
+    BOOST_CHECK((paths_of(snapshot->scripts(script_action::upgrade)) ==
+                 vector<string>{"1.0.0/0001_change.sql",
+                                "1.1.0/0001_change.sql"}));
+    
+    // A sub-directory removed.
+    fs::remove_all(repo.path / "upgrade/1.0.0");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK((paths_of(snapshot->scripts(script_action::upgrade)) ==
+                 vector<string>{"1.1.0/0001_change.sql"}));
+    BOOST_CHECK(!watched.last_error());
+}
+
+BOOST_AUTO_TEST_CASE (grouped_changes_followed)
+{
+    temp_repo repo;
+    fs::create_directories(repo.path / "upgrade/1/1.1");
+    watched_repository watched{repo.path.string()};
+    auto snapshot = watched.snapshot();
+    
+    // A version sub-directory within a grouping directory.
+    fs::create_directory(repo.path / "upgrade/1/1.1/1.1.0");
+    repo.touch("upgrade/1/1.1/1.1.0/0001_change.sql");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK((paths_of(snapshot->scripts(script_action::upgrade)) ==
+                 vector<string>{"1.0.0/0001_change.sql",
+                                "1/1.1/1.1.0/0001_change.sql"}));
+    
+    // ...which is watched in turn.
+    repo.touch("upgrade/1/1.1/1.1.0/0002_change.sql");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK_EQUAL(snapshot->latest_version(),
+                      semver::parse("1.1.0+script.2"));
+    
+    // A new grouping directory, with a version sub-directory already in it.
+    fs::create_directories(repo.path / "staging/1.2.0");
+    repo.touch("staging/1.2.0/0001_change.sql");
+    fs::rename(repo.path / "staging", repo.path / "upgrade/1/1.2");
+    snapshot = next_snapshot(watched, snapshot);
+    BOOST_CHECK_EQUAL(snapshot->latest_version(),
+                      semver::parse("1.2.0+script.1"));
+    BOOST_CHECK(!watched.last_error());
+}
+
+BOOST_AUTO_TEST_CASE (bad_changes_reported)
+{
+    temp_repo repo;
+    watched_repository watched{repo.path.string()};
+    auto good = watched.snapshot();
+    
+    // The last good snapshot is kept while the repository is broken.
+    repo.touch("upgrade/1.0.0/bad_name.sql");
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (!watched.last_error() && chrono::steady_clock::now() < deadline)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    BOOST_REQUIRE(watched.last_error());
+    BOOST_CHECK_THROW(rethrow_exception(watched.last_error()),
+                      bad_subdir_filename);
+    BOOST_CHECK(watched.snapshot() == good);
+    
+    // Once mended, everything is scanned again.
+    fs::remove(repo.path / "upgrade/1.0.0/bad_name.sql");
+    auto mended = next_snapshot(watched, good);
+    BOOST_CHECK(!watched.last_error());
+    BOOST_CHECK_EQUAL(mended->latest_version(),
+                      semver::parse("1.0.0+script.1"));
+}
+#endif